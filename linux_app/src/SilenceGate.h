@@ -0,0 +1,135 @@
+#ifndef SILENCE_GATE_H
+#define SILENCE_GATE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+// Sits between the audio source and the output component; once captured audio
+// has been silent for the idle timeout, it stops passing audio through (the
+// idle callback should arrange for the output to be flushed, off the capture
+// thread, so speakers stop being streamed to) and passes audio through again
+// as soon as the signal returns.
+//
+// The resume latency runs from the first non-silent block after an idle period
+// to the first audio sent once streaming restarts, so it includes waiting for
+// the flush to finish; the writer marks the restart and the output reports
+// audio sent, from any thread.
+class SilenceGate {
+public:
+    using WriteCallback = std::function<void(const uint8_t* data, size_t size)>;
+    using IdleCallback = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    // idleTimeout of zero disables the gate; threshold is the largest sample
+    // magnitude (16-bit signed PCM) that still counts as silence
+    SilenceGate(std::chrono::milliseconds idleTimeout, int threshold, size_t bytesPerSecond)
+        : idleBytes(static_cast<uint64_t>(idleTimeout.count()) * bytesPerSecond / 1000),
+          threshold(threshold), silentBytes(0), idle(false), idlePeriods(0),
+          resumeStart(0), lastResumeLatency(0), maxResumeLatency(0) {}
+
+    void onWrite(WriteCallback callback) { writeCallback = callback; }
+    void onIdle(IdleCallback callback) { idleCallback = callback; }
+
+    void process(const uint8_t* data, size_t size) {
+        if (idleBytes == 0) {
+            writeCallback(data, size);
+            return;
+        }
+
+        if (isSilence(data, size)) {
+            silentBytes += size;
+
+            if (idle) {
+                return; // keep speakers idle
+            }
+            if (silentBytes >= idleBytes) {
+                idle = true;
+                idlePeriods += 1;
+                if (idleCallback) {
+                    idleCallback();
+                }
+                return;
+            }
+        } else {
+            silentBytes = 0;
+
+            // resume streaming; the next write restarts the stream on the
+            // existing sessions
+            if (idle) {
+                idle = false;
+                reopenTime = Clock::now();
+            }
+        }
+
+        writeCallback(data, size);
+    }
+
+    // called by the writer once the output is ready to restart, just before
+    // audio is written to it again
+    void restarted() {
+        resumeStart.store(reopenTime.time_since_epoch().count(), std::memory_order_release);
+    }
+
+    // called when the output has sent audio; returns true if that completed
+    // a resume, whose latency is then available
+    bool sent() {
+        if (resumeStart.load(std::memory_order_relaxed) == 0) {
+            return false;
+        }
+        const Clock::rep start = resumeStart.exchange(0, std::memory_order_acquire);
+        if (start == 0) {
+            return false;
+        }
+
+        const int64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now().time_since_epoch() - Clock::duration(start)).count();
+        lastResumeLatency.store(latency);
+        if (latency > maxResumeLatency.load()) {
+            maxResumeLatency.store(latency);
+        }
+        return true;
+    }
+
+    bool isIdle() const { return idle; }
+    uint64_t idleCount() const { return idlePeriods; }
+    std::chrono::microseconds resumeLatency() const {
+        return std::chrono::microseconds(lastResumeLatency.load());
+    }
+    std::chrono::microseconds maxLatency() const {
+        return std::chrono::microseconds(maxResumeLatency.load());
+    }
+
+private:
+    const uint64_t idleBytes;
+    const int threshold;
+    uint64_t silentBytes;
+    bool idle;
+
+    uint64_t idlePeriods;
+
+    Clock::time_point reopenTime;
+    std::atomic<Clock::rep> resumeStart; // of resume not yet completed, or 0
+    std::atomic<int64_t> lastResumeLatency; // microseconds
+    std::atomic<int64_t> maxResumeLatency;
+
+    WriteCallback writeCallback;
+    IdleCallback idleCallback;
+
+    bool isSilence(const uint8_t* data, size_t size) const {
+        const size_t count = size / sizeof(int16_t);
+        for (size_t i = 0; i < count; ++i) {
+            int16_t sample;
+            std::memcpy(&sample, data + i * sizeof(int16_t), sizeof(sample));
+            if (std::abs(static_cast<int>(sample)) > threshold) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // SILENCE_GATE_H
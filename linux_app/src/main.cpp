@@ -1,11 +1,11 @@
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QSystemTrayIcon>
 #include <QMenu>
 #include <QAction>
 #include <QMessageBox>
 #include <QTimer>
-#include <QMutex>
-#include <QMutexLocker>
+#include <future>
 #include <vector>
 #include <string>
 #include <memory>
@@ -13,6 +13,7 @@
 
 #include "LinuxPlayer.h"
 #include "PulseAudioSource.h"
+#include "SilenceGate.h"
 #include "OutputComponent.h"
 #include "OutputFormat.h"
 #include "OutputMetadata.h"
@@ -24,9 +25,9 @@ public:
         setQuitOnLastWindowClosed(false);
     }
 
-    void init() {
+    void init(std::chrono::milliseconds idleTimeout, int silenceThreshold) {
         setupTrayIcon();
-        startBackend();
+        startBackend(idleTimeout, silenceThreshold);
     }
 
 private:
@@ -35,10 +36,12 @@ private:
     QMenu *devicesMenu;
     
     std::unique_ptr<LinuxPlayer> player;
+    // outlives output, whose sender thread reports audio sent to it
+    std::unique_ptr<SilenceGate> silenceGate;
     std::unique_ptr<OutputComponent> output;
+    std::future<void> pendingReset;
+    // declared last so capture stops before anything it uses is destroyed
     std::unique_ptr<PulseAudioSource> audioSource;
-    
-    QMutex audioMutex;
 
     void setupTrayIcon() {
         trayIcon = new QSystemTrayIcon(this);
@@ -68,21 +71,53 @@ private:
         trayIcon->setToolTip("AirPlay Free (Linux)");
     }
 
-    void startBackend() {
+    void startBackend(std::chrono::milliseconds idleTimeout, int silenceThreshold) {
         try {
             player = std::make_unique<LinuxPlayer>();
             output = std::make_unique<OutputComponent>(*player);
             
             // Configure Output Format (CD Quality)
-            OutputFormat fmt(SampleRate(44100), SampleSize(16), ChannelCount(2));
+            OutputFormat fmt(SampleRate(44100), SampleSize(2), ChannelCount(2));
             output->open(fmt);
             
-            // Start PulseAudio Capture
+            // Stop streaming to speakers while captured audio is silent
+            const size_t bytesPerSecond = static_cast<size_t>(
+                int(fmt.sampleRate()) * int(fmt.sampleSize()) * int(fmt.channelCount()));
+            silenceGate = std::make_unique<SilenceGate>(idleTimeout, silenceThreshold, bytesPerSecond);
+            silenceGate->onWrite([this](const uint8_t* data, size_t size) {
+                // output must not be written while it is still being reset
+                if (pendingReset.valid()) {
+                    pendingReset.get();
+                    silenceGate->restarted();
+                }
+                output->write(data, size);
+            });
+            output->setProgressCallback([this](size_t) {
+                // called on the engine's sender thread as each packet goes out
+                if (silenceGate->sent()) {
+                    std::cout << "Audio resumed; streaming restarted after "
+                              << silenceGate->resumeLatency().count() / 1000.0 << " ms (max "
+                              << silenceGate->maxLatency().count() / 1000.0 << " ms)." << std::endl;
+                }
+            });
+            silenceGate->onIdle([this]() {
+                // discard buffered audio and flush speakers, which waits on
+                // each speaker, so not on the capture thread; sessions stay open
+                pendingReset = std::async(std::launch::async, [this]() {
+                    try {
+                        output->reset(0);
+                    } catch (const std::exception& e) {
+                        std::cerr << "Output reset failed: " << e.what() << std::endl;
+                    }
+                });
+                std::cout << "Audio idle; streaming paused." << std::endl;
+            });
+
+            // Start PulseAudio Capture; its thread is the only one writing output
             audioSource = std::make_unique<PulseAudioSource>();
             bool started = audioSource->start([this](const uint8_t* data, size_t size) {
-                QMutexLocker locker(&audioMutex);
                 if (output) {
-                    output->write(data, size);
+                    silenceGate->process(data, size);
                 }
             });
 
@@ -100,6 +135,18 @@ private:
 
 int main(int argc, char *argv[]) {
     AirplayApp app(argc, argv);
-    app.init();
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption idleTimeoutOption("idle-timeout",
+        "Seconds of silence before streaming is paused (0 to never pause).", "seconds", "0");
+    QCommandLineOption silenceThresholdOption("silence-threshold",
+        "Largest 16-bit sample magnitude that counts as silence.", "level", "0");
+    parser.addOption(idleTimeoutOption);
+    parser.addOption(silenceThresholdOption);
+    parser.process(app);
+
+    app.init(std::chrono::seconds(parser.value(idleTimeoutOption).toUInt()),
+             parser.value(silenceThresholdOption).toInt());
     return app.exec();
 }
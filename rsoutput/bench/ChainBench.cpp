@@ -0,0 +1,143 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+// Benchmark of the output chain: time per write of 64 frames, the smallest
+// writes players make, through the output buffer alone and through reformatter
+// and buffer, with the chain composed for a final device sink (direct calls,
+// as for RAOPEngine) and for the OutputSink interface (virtual calls, as for
+// any other device sink). Each write first polls canWrite and buffered, as the
+// output component does. The device sink accepts a packet at a time and drops
+// it, so only the chain is timed.
+
+#include "OutputBuffer.h"
+#include "OutputReformatter.h"
+#include "OutputSink.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+static const size_t WRITE_FRAMES = 64;
+static const size_t PACKET_FRAMES = 352;
+static const size_t BUFFER_FRAMES = 4096;
+static const size_t WRITES = 2000000;
+static const int RUNS = 3;
+
+
+// the application instantiates this in OutputBuffer.cpp, along with the one
+// for RAOPEngine, which would bring in the whole engine
+template class BasicOutputBuffer<OutputSink>;
+
+
+// stands in for RAOPEngine, which is also final
+class NullSink final : public OutputSink
+{
+public:
+	explicit NullSink(const size_t packetSize) : _packetSize(packetSize), _written(0) {}
+
+	time_t latency(const OutputFormat&) const { return 0; }
+	size_t buffered() const { return 0; }
+	size_t canWrite() const { return _packetSize; }
+
+	void write(const byte_t* buffer, const size_t length) { _written += length + buffer[0]; }
+	void flush() {}
+	void reset() {}
+
+	size_t written() const { return _written; }
+
+private:
+	const size_t _packetSize;
+	size_t _written;
+};
+
+
+template <class Sink>
+static OutputSink::SharedPtr composeChain(const Poco::SharedPtr<Sink>& sink,
+	const OutputFormat& inFormat, const OutputFormat& outFormat)
+{
+	typedef BasicOutputBuffer<Sink> Buffer;
+	typedef BasicOutputReformatter<Buffer> Reformatter;
+
+	const size_t frameSize = outFormat.sampleSize() * outFormat.channelCount();
+	const Poco::SharedPtr<Buffer> buffer = new Buffer(sink, BUFFER_FRAMES * frameSize);
+	if (inFormat == outFormat)
+	{
+		return buffer;
+	}
+
+	return new Reformatter(inFormat, outFormat, buffer);
+}
+
+
+// returns nanoseconds per write, best of several runs
+static double timeWrites(const OutputSink::SharedPtr& chain, const size_t frameSize)
+{
+	const std::vector<byte_t> input(WRITE_FRAMES * frameSize, 1);
+	const size_t length = input.size();
+
+	double best = 0.0;
+	for (int r = 0; r < RUNS; ++r)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t w = 0; w < WRITES; ++w)
+		{
+			if (chain->canWrite() >= length && chain->buffered() < ~static_cast<size_t>(0))
+			{
+				chain->write(&input[0], length);
+			}
+		}
+		const double nanos = std::chrono::duration<double, std::nano>(
+			std::chrono::steady_clock::now() - start).count() / WRITES;
+
+		if (r == 0 || nanos < best)
+			best = nanos;
+	}
+	return best;
+}
+
+
+static void bench(const char* name, const OutputFormat& inFormat, const OutputFormat& outFormat)
+{
+	const size_t inFrameSize = inFormat.sampleSize() * inFormat.channelCount();
+	const size_t packetSize = PACKET_FRAMES * outFormat.sampleSize() * outFormat.channelCount();
+
+	const Poco::SharedPtr<NullSink> finalSink = new NullSink(packetSize);
+	const double direct = timeWrites(composeChain(finalSink, inFormat, outFormat), inFrameSize);
+
+	const OutputSink::SharedPtr virtualSink = new NullSink(packetSize);
+	const double indirect = timeWrites(composeChain(virtualSink, inFormat, outFormat), inFrameSize);
+
+	std::printf("%-28s %12.1f %12.1f %9.1f%%\n", name, direct, indirect,
+		100.0 * (indirect - direct) / indirect);
+}
+
+
+int main()
+{
+	const OutputFormat cd(SampleRate(44100));
+	const OutputFormat hiRes(SampleRate(44100), SampleSize(3));
+	const OutputFormat floating(SampleRate(44100), SampleSize(4), ChannelCount(2),
+		SampleEncoding(SampleEncoding::FLOAT));
+
+	std::printf("%u-frame writes, ns per write\n", static_cast<unsigned int>(WRITE_FRAMES));
+	std::printf("%-28s %12s %12s %10s\n", "chain", "direct", "virtual", "saved");
+	bench("buffer", cd, cd);
+	bench("reformat 24-bit + buffer", hiRes, cd);
+	bench("reformat float + buffer", floating, cd);
+
+	return 0;
+}
@@ -96,7 +96,7 @@ static const uint32_t sSupportediPodSampleRates[] =
     Constructor
 */
 ALACEncoder::ALACEncoder() : mBitDepth(0),
-                             mFastMode(0),
+                             mEffort(kEffortDefault),
                              mMixBufferU(nil),
                              mMixBufferV(nil),
                              mPredictorU(nil),
@@ -179,10 +179,12 @@ int32_t ALACEncoder::Encode(AudioFormatDescription theInputFormat, AudioFormatDe
         BitBufferWrite(&bitstream, 0, 4);
 
         // encode stereo input buffer
-        if (mFastMode == false)
-            status = this->EncodeStereo(&bitstream, theReadBuffer, 2, 0, numFrames);
-        else
+        if (mEffort == kEffortUncompressed)
+            status = this->EncodeStereoEscape(&bitstream, theReadBuffer, 2, numFrames);
+        else if (mEffort == kEffortFast)
             status = this->EncodeStereoFast(&bitstream, theReadBuffer, 2, 0, numFrames);
+        else
+            status = this->EncodeStereo(&bitstream, theReadBuffer, 2, 0, numFrames);
         RequireNoErr(status, goto Exit;);
     }
     else if (theInputFormat.mChannelsPerFrame == 1)
@@ -563,7 +565,7 @@ int32_t ALACEncoder::EncodeStereo(BitBuffer *bitstream, void *inputBuffer, uint3
     uint32_t dilate;
     int32_t mixBits, mixRes, maxRes;
     uint32_t minBits, minBits1, minBits2;
-    uint32_t numU, numV;
+    uint32_t numU, numV, maxUV;
     uint32_t mode;
     uint32_t pbFactor;
     uint32_t chanBits;
@@ -611,7 +613,7 @@ int32_t ALACEncoder::EncodeStereo(BitBuffer *bitstream, void *inputBuffer, uint3
     denShift = DENSHIFT_DEFAULT;
     mode = 0;
     pbFactor = 4;
-    dilate = 8;
+    dilate = (mEffort == kEffortExhaustive) ? 1 : 8;
 
     minBits = minBits1 = minBits2 = 1ul << 31;
 
@@ -687,7 +689,10 @@ int32_t ALACEncoder::EncodeStereo(BitBuffer *bitstream, void *inputBuffer, uint3
     numU = numV = kMinUV;
     minBits1 = minBits2 = 1ul << 31;
 
-    for (uint32_t numUV = kMinUV; numUV <= kMaxUV; numUV += 4)
+    // exhaustive effort also tries longer predictors and evaluates each on all of the input
+    maxUV = (mEffort == kEffortExhaustive) ? kALACMaxCoefs : kMaxUV;
+
+    for (uint32_t numUV = kMinUV; numUV <= maxUV; numUV += 4)
     {
         BitBufferInit(&workBits, mWorkBuffer, mMaxOutputBytes);
 
@@ -700,7 +705,17 @@ int32_t ALACEncoder::EncodeStereo(BitBuffer *bitstream, void *inputBuffer, uint3
             pc_block(mMixBufferV, mPredictorV, numSamples / dilate, coefsV[numUV - 1], numUV, chanBits, DENSHIFT_DEFAULT);
         }
 
-        dilate = 8;
+        if (mEffort == kEffortExhaustive)
+        {
+            dilate = 1;
+
+            pc_block(mMixBufferU, mPredictorU, numSamples, coefsU[numUV - 1], numUV, chanBits, DENSHIFT_DEFAULT);
+            pc_block(mMixBufferV, mPredictorV, numSamples, coefsV[numUV - 1], numUV, chanBits, DENSHIFT_DEFAULT);
+        }
+        else
+        {
+            dilate = 8;
+        }
 
         set_ag_params(&agParams, MB0, (pbFactor * PB0) / 4, KB0, numSamples / dilate, numSamples / dilate, MAX_RUN_DEFAULT);
         status = dyn_comp(&agParams, mPredictorU, &workBits, numSamples / dilate, chanBits, &bits1);
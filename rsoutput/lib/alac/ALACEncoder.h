@@ -33,6 +33,15 @@ struct BitBuffer;
 class ALACEncoder
 {
 public:
+    // trade-off between compression ratio and CPU time for stereo input
+    enum Effort
+    {
+        kEffortUncompressed = 0, // escape frames only, i.e. PCM in an ALAC frame
+        kEffortFast = 1,         // default mixing and predictor parameters, no search
+        kEffortDefault = 2,      // search mixing and predictor parameters on dilated input
+        kEffortExhaustive = 3    // search on all input and with up to 16 predictor coefficients
+    };
+
     ALACEncoder();
     virtual ~ALACEncoder();
 
@@ -40,7 +49,9 @@ public:
                            unsigned char *theReadBuffer, unsigned char *theWriteBuffer, int32_t *ioNumBytes);
     virtual int32_t Finish();
 
-    void SetFastMode(bool fast) { mFastMode = fast; };
+    void SetFastMode(bool fast) { mEffort = fast ? kEffortFast : kEffortDefault; };
+    void SetEffort(Effort effort) { mEffort = effort; };
+    Effort GetEffort() const { return mEffort; };
 
     // this must be called *before* InitializeEncoder()
     void SetFrameSize(uint32_t frameSize) { mFrameSize = frameSize; };
@@ -61,7 +72,7 @@ protected:
 
     // ALAC encoder parameters
     int16_t mBitDepth;
-    bool mFastMode;
+    Effort mEffort;
 
     // encoding state
     int16_t mLastMixRes[kALACMaxChannels];
@@ -42,6 +42,9 @@
 		#include <libkern/OSByteOrder.h>
 	#endif
 #endif
+#if _MSC_VER
+	#include <intrin.h>
+#endif
 
 #define CODE_TO_LONG_MAXBITS	32
 #define N_MAX_MEAN_CLAMP		0xffff
@@ -64,6 +67,13 @@
 // note: implementing this with some kind of "count leading zeros" assembly is a big performance win
 static inline int32_t lead( int32_t m )
 {
+#if defined(__GNUC__)
+	return (m == 0) ? 32 : __builtin_clz( (uint32_t) m );
+#elif defined(_MSC_VER)
+	unsigned long	index;
+
+	return _BitScanReverse( &index, (unsigned long) m ) ? (int32_t)(31 - index) : 32;
+#else
 	long j;
 	unsigned long c = (1ul << 31);
 
@@ -74,6 +84,7 @@ static inline int32_t lead( int32_t m )
 		c >>= 1;
 	}
 	return (j);
+#endif
 }
 
 #define arithmin(a, b) ((a) < (b) ? (a) : (b))
@@ -0,0 +1,225 @@
+/*
+	File:		effort_bench.cpp
+
+	Contains:	Benchmark of the ALACEncoder effort levels: encodes a fixed PCM
+				corpus in 352-frame packets, as the RAOP engine does, at each
+				level and reports encode time per packet, its share of a
+				packet's duration, and compression ratio.  The corpus is
+				generated (tonal music-like signal, quiet passages and noise)
+				unless a file of raw 16-bit little-endian stereo PCM is given.
+
+				usage: alac-effort-bench [pcm-file]
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "ALACAudioTypes.h"
+#include "ALACEncoder.h"
+
+#define kFramesPerPacket	352
+#define kChannels			2
+#define kSampleRate			44100
+#define kCorpusPackets		5000
+#define kRuns				3
+
+static const char * const kEffortNames[] =
+{
+	"uncompressed",
+	"fast",
+	"default",
+	"exhaustive"
+};
+
+// deterministic noise, so the corpus is the same on every run
+static uint32_t sSeed = 12345;
+
+static double noise( void )
+{
+	sSeed = sSeed * 1664525u + 1013904223u;
+	return (double) (int32_t) sSeed / 2147483648.0;
+}
+
+static int32_t clip( double value, int32_t maxValue )
+{
+	const double limited = std::min( std::max( value, (double) -maxValue - 1 ), (double) maxValue );
+	return (int32_t) lrint( limited );
+}
+
+// a quarter each of: harmonic tones with a slow envelope and correlated channels,
+// the same 30 dB down, tones over a noise floor, and wideband noise
+static void makeCorpus( std::vector<int32_t> & samples, uint32_t numFrames )
+{
+	const double kTwoPi = 6.283185307179586;
+	const int32_t kFull = (1 << 23) - 1;
+
+	samples.resize( numFrames * kChannels );
+	for ( uint32_t f = 0; f < numFrames; f++ )
+	{
+		const uint32_t section = (f * 4) / numFrames;
+		const double t = (double) f / kSampleRate;
+		const double envelope = 0.5 + 0.4 * sin( kTwoPi * 0.25 * t );
+
+		double tone = 0.0;
+		for ( int h = 1; h <= 6; h++ )
+			tone += sin( kTwoPi * 220.0 * h * t + h ) / h;
+		tone *= 0.35 * envelope;
+
+		double l, r;
+		switch ( section )
+		{
+			case 0:		l = tone; r = 0.8 * tone + 0.1 * sin( kTwoPi * 330.0 * t ); break;
+			case 1:		l = 0.03 * tone; r = 0.025 * tone; break;
+			case 2:		l = tone + 0.02 * noise(); r = 0.9 * tone + 0.02 * noise(); break;
+			default:	l = 0.7 * noise(); r = 0.7 * noise(); break;
+		}
+
+		samples[f * kChannels + 0] = clip( l * kFull, kFull );
+		samples[f * kChannels + 1] = clip( r * kFull, kFull );
+	}
+}
+
+static bool readCorpus( const char * path, std::vector<int32_t> & samples )
+{
+	FILE * file = fopen( path, "rb" );
+	if ( file == NULL )
+		return false;
+
+	int16_t frame[kChannels];
+	while ( fread( frame, sizeof(frame), 1, file ) == 1 )
+	{
+		for ( int c = 0; c < kChannels; c++ )
+		{
+			const uint8_t * bytes = (const uint8_t *) &frame[c];
+			samples.push_back( (int32_t) (int16_t) (bytes[0] | (bytes[1] << 8)) << 8 );
+		}
+	}
+	fclose( file );
+
+	return !samples.empty();
+}
+
+// packs 24-bit samples into little-endian PCM of the given size
+static void packPCM( const std::vector<int32_t> & samples, uint32_t bitDepth, std::vector<uint8_t> & pcm )
+{
+	const uint32_t bytes = bitDepth / 8;
+
+	pcm.resize( samples.size() * bytes );
+	for ( size_t i = 0; i < samples.size(); i++ )
+	{
+		const int32_t value = samples[i] >> (24 - bitDepth);
+		for ( uint32_t b = 0; b < bytes; b++ )
+			pcm[i * bytes + b] = (uint8_t) (value >> (8 * b));
+	}
+}
+
+static AudioFormatDescription inputFormat( uint32_t bitDepth )
+{
+	AudioFormatDescription afd;
+	memset( &afd, 0, sizeof(afd) );
+
+	afd.mFormatID = kALACFormatLinearPCM;
+	afd.mFormatFlags = kALACFormatFlagIsSignedInteger | kALACFormatFlagIsPacked;
+	afd.mSampleRate = kSampleRate;
+	afd.mBitsPerChannel = bitDepth;
+	afd.mChannelsPerFrame = kChannels;
+	afd.mFramesPerPacket = 1;
+	afd.mBytesPerFrame = (bitDepth / 8) * kChannels;
+	afd.mBytesPerPacket = afd.mBytesPerFrame;
+
+	return afd;
+}
+
+static AudioFormatDescription outputFormat( uint32_t bitDepth )
+{
+	AudioFormatDescription afd;
+	memset( &afd, 0, sizeof(afd) );
+
+	afd.mFormatID = kALACFormatAppleLossless;
+	afd.mFormatFlags = (bitDepth == 24 ? 3 : 1); // source bit depth (1 = 16, 3 = 24)
+	afd.mSampleRate = kSampleRate;
+	afd.mChannelsPerFrame = kChannels;
+	afd.mFramesPerPacket = kFramesPerPacket;
+
+	return afd;
+}
+
+static void bench( const std::vector<int32_t> & samples, uint32_t bitDepth )
+{
+	std::vector<uint8_t> pcm;
+	packPCM( samples, bitDepth, pcm );
+
+	const AudioFormatDescription inFormat = inputFormat( bitDepth );
+	const AudioFormatDescription outFormat = outputFormat( bitDepth );
+	const uint32_t packetBytes = kFramesPerPacket * inFormat.mBytesPerFrame;
+	const size_t numPackets = pcm.size() / packetBytes;
+	const double packetMicros = 1e6 * kFramesPerPacket / kSampleRate;
+
+	// encoder may write past an uncompressed frame before it falls back to one
+	std::vector<uint8_t> output( kFramesPerPacket * kChannels * 4 + 64 );
+
+	printf( "%u-bit stereo, %u packets of %u frames (%.0f us each)\n",
+		bitDepth, (unsigned) numPackets, kFramesPerPacket, packetMicros );
+	printf( "  %-13s %10s %10s %8s\n", "effort", "us/packet", "% packet", "ratio" );
+
+	for ( int effort = ALACEncoder::kEffortUncompressed; effort <= ALACEncoder::kEffortExhaustive; effort++ )
+	{
+		double bestMicros = 0.0;
+		uint64_t encodedBytes = 0;
+
+		for ( int run = 0; run < kRuns; run++ )
+		{
+			ALACEncoder encoder;
+			encoder.SetFrameSize( kFramesPerPacket );
+			encoder.SetEffort( (ALACEncoder::Effort) effort );
+			encoder.InitializeEncoder( outFormat );
+
+			encodedBytes = 0;
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for ( size_t p = 0; p < numPackets; p++ )
+			{
+				int32_t numBytes = (int32_t) packetBytes;
+				encoder.Encode( inFormat, outFormat, &pcm[p * packetBytes], &output[0], &numBytes );
+				encodedBytes += numBytes;
+			}
+			const double micros = std::chrono::duration<double, std::micro>(
+				std::chrono::steady_clock::now() - start ).count() / numPackets;
+
+			if ( run == 0 || micros < bestMicros )
+				bestMicros = micros;
+		}
+
+		printf( "  %-13s %10.1f %9.2f%% %8.3f\n", kEffortNames[effort], bestMicros,
+			100.0 * bestMicros / packetMicros, (double) encodedBytes / (numPackets * packetBytes) );
+	}
+}
+
+int main( int argc, char * argv[] )
+{
+	std::vector<int32_t> samples;
+
+	if ( argc > 1 )
+	{
+		if ( !readCorpus( argv[1], samples ) )
+		{
+			fprintf( stderr, "Unable to read PCM from %s\n", argv[1] );
+			return 1;
+		}
+	}
+	else
+	{
+		makeCorpus( samples, kCorpusPackets * kFramesPerPacket );
+	}
+
+	bench( samples, 16 );
+	bench( samples, 24 );
+
+	return 0;
+}
@@ -28,6 +28,7 @@
 
 #include "matrixlib.h"
 #include "ALACAudioTypes.h"
+#include "simdlib.h"
 
 // up to 24-bit "offset" macros for the individual bytes of a 20/24-bit word
 #if TARGET_RT_BIG_ENDIAN
@@ -57,7 +58,7 @@
 
 // 16-bit routines
 
-void mix16( int16_t * in, uint32_t stride, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
+static void mix16_c( int16_t * in, uint32_t stride, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
 {
 	int16_t	*	ip = in;
 	int32_t			j;
@@ -92,6 +93,144 @@ void mix16( int16_t * in, uint32_t stride, int32_t * u, int32_t * v, int32_t num
 	}
 }
 
+#if ALAC_SIMD_X86
+
+// - matrixed stereo is computed as pairwise dot products of interleaved (l, r) samples with (mixres, m2)
+//	 and (1, -1), which are exact in 32 bits since mixres and m2 are at most 1 << 14
+
+static void ALAC_TARGET("sse2") mix16_sse2( int16_t * in, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
+{
+	int32_t			j = 0;
+
+	if ( mixres != 0 )
+	{
+		int32_t		m2 = (1 << mixbits) - mixres;
+		__m128i		coefsU = _mm_set1_epi32( (int32_t)(((uint32_t)m2 << 16) | (uint16_t)mixres) );
+		__m128i		coefsV = _mm_set1_epi32( (int32_t)0xFFFF0001 );
+		__m128i		shift = _mm_cvtsi32_si128( mixbits );
+
+		for ( ; j + 4 <= numSamples; j += 4 )
+		{
+			__m128i		lr = _mm_loadu_si128( (const __m128i *)(in + 2 * j) );
+
+			_mm_storeu_si128( (__m128i *)(u + j), _mm_sra_epi32( _mm_madd_epi16( lr, coefsU ), shift ) );
+			_mm_storeu_si128( (__m128i *)(v + j), _mm_madd_epi16( lr, coefsV ) );
+		}
+	}
+	else
+	{
+		for ( ; j + 4 <= numSamples; j += 4 )
+		{
+			__m128i		lr = _mm_loadu_si128( (const __m128i *)(in + 2 * j) );
+
+			_mm_storeu_si128( (__m128i *)(u + j), _mm_srai_epi32( _mm_slli_epi32( lr, 16 ), 16 ) );
+			_mm_storeu_si128( (__m128i *)(v + j), _mm_srai_epi32( lr, 16 ) );
+		}
+	}
+
+	mix16_c( in + 2 * j, 2, u + j, v + j, numSamples - j, mixbits, mixres );
+}
+
+static void ALAC_TARGET("avx2") mix16_avx2( int16_t * in, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
+{
+	int32_t			j = 0;
+
+	if ( mixres != 0 )
+	{
+		int32_t		m2 = (1 << mixbits) - mixres;
+		__m256i		coefsU = _mm256_set1_epi32( (int32_t)(((uint32_t)m2 << 16) | (uint16_t)mixres) );
+		__m256i		coefsV = _mm256_set1_epi32( (int32_t)0xFFFF0001 );
+		__m128i		shift = _mm_cvtsi32_si128( mixbits );
+
+		for ( ; j + 8 <= numSamples; j += 8 )
+		{
+			__m256i		lr = _mm256_loadu_si256( (const __m256i *)(in + 2 * j) );
+
+			_mm256_storeu_si256( (__m256i *)(u + j), _mm256_sra_epi32( _mm256_madd_epi16( lr, coefsU ), shift ) );
+			_mm256_storeu_si256( (__m256i *)(v + j), _mm256_madd_epi16( lr, coefsV ) );
+		}
+	}
+	else
+	{
+		for ( ; j + 8 <= numSamples; j += 8 )
+		{
+			__m256i		lr = _mm256_loadu_si256( (const __m256i *)(in + 2 * j) );
+
+			_mm256_storeu_si256( (__m256i *)(u + j), _mm256_srai_epi32( _mm256_slli_epi32( lr, 16 ), 16 ) );
+			_mm256_storeu_si256( (__m256i *)(v + j), _mm256_srai_epi32( lr, 16 ) );
+		}
+	}
+
+	mix16_c( in + 2 * j, 2, u + j, v + j, numSamples - j, mixbits, mixres );
+}
+
+#elif ALAC_SIMD_NEON
+
+static void mix16_neon( int16_t * in, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
+{
+	int32_t			j = 0;
+
+	if ( mixres != 0 )
+	{
+		int16x4_t	res = vdup_n_s16( (int16_t) mixres );
+		int16x4_t	m2 = vdup_n_s16( (int16_t)((1 << mixbits) - mixres) );
+		int32x4_t	shift = vdupq_n_s32( -mixbits );
+
+		for ( ; j + 8 <= numSamples; j += 8 )
+		{
+			int16x8x2_t	lr = vld2q_s16( in + 2 * j );
+
+			vst1q_s32( u + j, vshlq_s32( vmlal_s16( vmull_s16( vget_low_s16( lr.val[0] ), res ), vget_low_s16( lr.val[1] ), m2 ), shift ) );
+			vst1q_s32( u + j + 4, vshlq_s32( vmlal_s16( vmull_s16( vget_high_s16( lr.val[0] ), res ), vget_high_s16( lr.val[1] ), m2 ), shift ) );
+			vst1q_s32( v + j, vsubl_s16( vget_low_s16( lr.val[0] ), vget_low_s16( lr.val[1] ) ) );
+			vst1q_s32( v + j + 4, vsubl_s16( vget_high_s16( lr.val[0] ), vget_high_s16( lr.val[1] ) ) );
+		}
+	}
+	else
+	{
+		for ( ; j + 8 <= numSamples; j += 8 )
+		{
+			int16x8x2_t	lr = vld2q_s16( in + 2 * j );
+
+			vst1q_s32( u + j, vmovl_s16( vget_low_s16( lr.val[0] ) ) );
+			vst1q_s32( u + j + 4, vmovl_s16( vget_high_s16( lr.val[0] ) ) );
+			vst1q_s32( v + j, vmovl_s16( vget_low_s16( lr.val[1] ) ) );
+			vst1q_s32( v + j + 4, vmovl_s16( vget_high_s16( lr.val[1] ) ) );
+		}
+	}
+
+	mix16_c( in + 2 * j, 2, u + j, v + j, numSamples - j, mixbits, mixres );
+}
+
+#endif
+
+void mix16( int16_t * in, uint32_t stride, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
+{
+	// vectorized routines handle interleaved stereo only and need mixres/m2 to fit in 16 bits
+	if ( (stride == 2) && (mixbits <= 14) )
+	{
+#if ALAC_SIMD_X86
+		uint32_t	features = alac_simd_features();
+
+		if ( features & kALACSimdAVX2 )
+		{
+			mix16_avx2( in, u, v, numSamples, mixbits, mixres );
+			return;
+		}
+		if ( features & kALACSimdSSE2 )
+		{
+			mix16_sse2( in, u, v, numSamples, mixbits, mixres );
+			return;
+		}
+#elif ALAC_SIMD_NEON
+		mix16_neon( in, u, v, numSamples, mixbits, mixres );
+		return;
+#endif
+	}
+
+	mix16_c( in, stride, u, v, numSamples, mixbits, mixres );
+}
+
 // 20-bit routines
 // - the 20 bits of data are left-justified in 3 bytes of storage but right-aligned for input/output predictor buffers
 
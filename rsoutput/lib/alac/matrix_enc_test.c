@@ -0,0 +1,351 @@
+/*
+	File:		matrix_enc_test.c
+
+	Contains:	Bit-exactness test of the mixing routines in matrix_enc.c against
+				the original scalar routines, over a PCM corpus that includes
+				extreme values, odd lengths, unaligned input and non-interleaved
+				strides.  Whichever vectorized routine the running CPU selects
+				is the one checked; returns non-zero if any output differs.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "matrixlib.h"
+#include "ALACAudioTypes.h"
+#include "simdlib.h"
+
+#if TARGET_RT_BIG_ENDIAN
+	#define LBYTE	2
+	#define MBYTE	1
+	#define HBYTE	0
+#else
+	#define LBYTE	0
+	#define MBYTE	1
+	#define HBYTE	2
+#endif
+
+#define kMaxSamples		4100
+#define kMaxStride		16
+#define kGuardSamples	16
+#define kGuardValue		0x5A5A5A5A
+
+// reference routines, as in matrix_enc.c before it was vectorized
+
+static void ref_mix16( int16_t * in, uint32_t stride, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
+{
+	int16_t *	ip = in;
+	int32_t		j;
+
+	if ( mixres != 0 )
+	{
+		int32_t		m2 = (1 << mixbits) - mixres;
+
+		for ( j = 0; j < numSamples; j++ )
+		{
+			int32_t		l = (int32_t) ip[0];
+			int32_t		r = (int32_t) ip[1];
+
+			ip += stride;
+			u[j] = (mixres * l + m2 * r) >> mixbits;
+			v[j] = l - r;
+		}
+	}
+	else
+	{
+		for ( j = 0; j < numSamples; j++ )
+		{
+			u[j] = (int32_t) ip[0];
+			v[j] = (int32_t) ip[1];
+			ip += stride;
+		}
+	}
+}
+
+static int32_t ref_read24( const uint8_t * ip )
+{
+	return (int32_t)( ((uint32_t)ip[HBYTE] << 16) | ((uint32_t)ip[MBYTE] << 8) | (uint32_t)ip[LBYTE] );
+}
+
+static void ref_mix20( uint8_t * in, uint32_t stride, int32_t * u, int32_t * v, int32_t numSamples, int32_t mixbits, int32_t mixres )
+{
+	uint8_t *	ip = in;
+	int32_t		m2 = (1 << mixbits) - mixres;
+	int32_t		j;
+
+	for ( j = 0; j < numSamples; j++ )
+	{
+		int32_t		l = (ref_read24( ip ) << 8) >> 12;
+		int32_t		r = (ref_read24( ip + 3 ) << 8) >> 12;
+
+		ip += stride * 3;
+		if ( mixres != 0 )
+		{
+			u[j] = (mixres * l + m2 * r) >> mixbits;
+			v[j] = l - r;
+		}
+		else
+		{
+			u[j] = l;
+			v[j] = r;
+		}
+	}
+}
+
+static void ref_mix24( uint8_t * in, uint32_t stride, int32_t * u, int32_t * v, int32_t numSamples,
+					   int32_t mixbits, int32_t mixres, uint16_t * shiftUV, int32_t bytesShifted )
+{
+	uint8_t *	ip = in;
+	int32_t		shift = bytesShifted * 8;
+	uint32_t	mask = (1ul << shift) - 1;
+	int32_t		m2 = (1 << mixbits) - mixres;
+	int32_t		j;
+
+	for ( j = 0; j < numSamples; j++ )
+	{
+		int32_t		l = (ref_read24( ip ) << 8) >> 8;
+		int32_t		r = (ref_read24( ip + 3 ) << 8) >> 8;
+
+		ip += stride * 3;
+		if ( bytesShifted != 0 )
+		{
+			shiftUV[2 * j + 0] = (uint16_t)(l & mask);
+			shiftUV[2 * j + 1] = (uint16_t)(r & mask);
+			l >>= shift;
+			r >>= shift;
+		}
+		if ( mixres != 0 )
+		{
+			u[j] = (mixres * l + m2 * r) >> mixbits;
+			v[j] = l - r;
+		}
+		else
+		{
+			u[j] = l;
+			v[j] = r;
+		}
+	}
+}
+
+// corpus
+
+enum
+{
+	kPatternRandom,
+	kPatternExtremes,		// alternating minimum and maximum, out of phase between channels
+	kPatternMinimum,
+	kPatternMaximum,
+	kPatternSilence,
+	kPatternQuiet,			// small values of either sign
+	kPatternRamp,
+	kPatternCount
+};
+
+static uint32_t sRandomState = 0x12345678;
+
+static uint32_t nextRandom( void )
+{
+	// xorshift32, so the corpus is the same on every run
+	sRandomState ^= sRandomState << 13;
+	sRandomState ^= sRandomState >> 17;
+	sRandomState ^= sRandomState << 5;
+	return sRandomState;
+}
+
+static int32_t patternSample( int32_t pattern, int32_t index, int32_t channel, int32_t bits )
+{
+	int32_t		maxValue = (1 << (bits - 1)) - 1;
+	int32_t		minValue = -maxValue - 1;
+
+	switch ( pattern )
+	{
+		case kPatternRandom:
+			return (int32_t)(nextRandom() & ((1u << bits) - 1)) + minValue;
+		case kPatternExtremes:
+			return ((index + channel) & 1) ? maxValue : minValue;
+		case kPatternMinimum:
+			return minValue;
+		case kPatternMaximum:
+			return maxValue;
+		case kPatternSilence:
+			return 0;
+		case kPatternQuiet:
+			return (int32_t)(nextRandom() % 7) - 3;
+		default:
+		{
+			// channels ramp across the full range in opposite directions
+			int32_t		step = (int32_t)(((int64_t)index * (maxValue - minValue)) / (kMaxSamples - 1));
+
+			return channel ? (maxValue - step) : (minValue + step);
+		}
+	}
+}
+
+static void fill16( int16_t * buffer, int32_t count, int32_t stride, int32_t pattern )
+{
+	int32_t		i, c;
+
+	for ( i = 0; i < count; i++ )
+		for ( c = 0; c < stride; c++ )
+			buffer[i * stride + c] = (int16_t) patternSample( pattern, i, c, 16 );
+}
+
+static void fill24( uint8_t * buffer, int32_t count, int32_t stride, int32_t pattern, int32_t bits )
+{
+	int32_t		i, c;
+
+	for ( i = 0; i < count; i++ )
+	{
+		for ( c = 0; c < stride; c++ )
+		{
+			// 20-bit samples are left-justified in their 3 bytes
+			uint32_t	value = (uint32_t) patternSample( pattern, i, c, bits ) << (24 - bits);
+			uint8_t *	op = &buffer[(i * stride + c) * 3];
+
+			op[HBYTE] = (uint8_t)(value >> 16);
+			op[MBYTE] = (uint8_t)(value >> 8);
+			op[LBYTE] = (uint8_t) value;
+		}
+	}
+}
+
+// comparison
+
+static int32_t	sU[kMaxSamples + kGuardSamples], sV[kMaxSamples + kGuardSamples];
+static int32_t	sRefU[kMaxSamples], sRefV[kMaxSamples];
+static uint16_t	sShiftUV[2 * kMaxSamples], sRefShiftUV[2 * kMaxSamples];
+
+static int32_t	sCaseCount = 0;
+static int32_t	sFailureCount = 0;
+
+static void resetOutput( void )
+{
+	int32_t		i;
+
+	for ( i = 0; i < kMaxSamples + kGuardSamples; i++ )
+		sU[i] = sV[i] = kGuardValue;
+	memset( sShiftUV, 0, sizeof(sShiftUV) );
+	memset( sRefShiftUV, 0, sizeof(sRefShiftUV) );
+}
+
+static void check( const char * routine, int32_t pattern, int32_t numSamples, int32_t stride, int32_t offset,
+				   int32_t mixbits, int32_t mixres, int32_t bytesShifted )
+{
+	int32_t		i;
+	int32_t		mismatch = -1;
+
+	sCaseCount += 1;
+
+	for ( i = 0; i < numSamples && mismatch < 0; i++ )
+	{
+		if ( sU[i] != sRefU[i] || sV[i] != sRefV[i] )
+			mismatch = i;
+		else if ( bytesShifted != 0 && (sShiftUV[2 * i] != sRefShiftUV[2 * i] || sShiftUV[2 * i + 1] != sRefShiftUV[2 * i + 1]) )
+			mismatch = i;
+	}
+	for ( i = numSamples; i < numSamples + kGuardSamples && mismatch < 0; i++ )
+	{
+		if ( sU[i] != (int32_t) kGuardValue || sV[i] != (int32_t) kGuardValue )
+			mismatch = i;
+	}
+
+	if ( mismatch >= 0 )
+	{
+		sFailureCount += 1;
+		if ( sFailureCount <= 20 )
+		{
+			printf( "%s mismatch at sample %d: pattern %d, %d samples, stride %d, offset %d, mixbits %d, mixres %d, shifted %d\n",
+					routine, mismatch, pattern, numSamples, stride, offset, mixbits, mixres, bytesShifted );
+		}
+	}
+}
+
+static const int32_t	kLengths[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 352, 353, 4096, 4099 };
+static const int32_t	kStrides[] = { 2, 3, 4, kMaxStride };
+static const int32_t	kOffsets[] = { 0, 1 };
+
+#define countof(x)	((int32_t)(sizeof(x) / sizeof((x)[0])))
+
+static void testMix16( void )
+{
+	static int16_t	input[(kMaxSamples + 1) * kMaxStride];
+	int32_t			p, n, s, o, mixbits, m;
+
+	for ( p = 0; p < kPatternCount; p++ )
+	for ( s = 0; s < countof(kStrides); s++ )
+	for ( o = 0; o < countof(kOffsets); o++ )
+	{
+		int32_t		stride = kStrides[s];
+		int16_t *	in = input + kOffsets[o];
+
+		fill16( in, kMaxSamples, stride, p );
+
+		// mixbits of 15 exceeds what the vectorized routines take
+		for ( mixbits = 0; mixbits <= 15; mixbits++ )
+		{
+			const int32_t	mod = 1 << mixbits;
+			const int32_t	mixresValues[] = { 0, 1, mod / 2, mod - 1, mod };
+
+			for ( m = 0; m < countof(mixresValues); m++ )
+			for ( n = 0; n < countof(kLengths); n++ )
+			{
+				resetOutput();
+				mix16( in, stride, sU, sV, kLengths[n], mixbits, mixresValues[m] );
+				ref_mix16( in, stride, sRefU, sRefV, kLengths[n], mixbits, mixresValues[m] );
+				check( "mix16", p, kLengths[n], stride, kOffsets[o], mixbits, mixresValues[m], 0 );
+			}
+		}
+	}
+}
+
+static void testMix20And24( void )
+{
+	static uint8_t	input[(kMaxSamples + 1) * kMaxStride * 3];
+	int32_t			p, n, s, o, mixbits, m, shifted;
+
+	for ( p = 0; p < kPatternCount; p++ )
+	for ( s = 0; s < countof(kStrides); s++ )
+	for ( o = 0; o < countof(kOffsets); o++ )
+	{
+		int32_t		stride = kStrides[s];
+		uint8_t *	in = input + kOffsets[o] * 3;
+
+		// products of mixres and 24-bit samples must fit in 32 bits
+		for ( mixbits = 0; mixbits <= 7; mixbits++ )
+		{
+			const int32_t	mod = 1 << mixbits;
+			const int32_t	mixresValues[] = { 0, 1, mod / 2, mod - 1, mod };
+
+			for ( m = 0; m < countof(mixresValues); m++ )
+			for ( n = 0; n < countof(kLengths); n++ )
+			{
+				fill24( in, kMaxSamples, stride, p, 20 );
+				resetOutput();
+				mix20( in, stride, sU, sV, kLengths[n], mixbits, mixresValues[m] );
+				ref_mix20( in, stride, sRefU, sRefV, kLengths[n], mixbits, mixresValues[m] );
+				check( "mix20", p, kLengths[n], stride, kOffsets[o], mixbits, mixresValues[m], 0 );
+
+				fill24( in, kMaxSamples, stride, p, 24 );
+				for ( shifted = 0; shifted <= 2; shifted++ )
+				{
+					resetOutput();
+					mix24( in, stride, sU, sV, kLengths[n], mixbits, mixresValues[m], sShiftUV, shifted );
+					ref_mix24( in, stride, sRefU, sRefV, kLengths[n], mixbits, mixresValues[m], sRefShiftUV, shifted );
+					check( "mix24", p, kLengths[n], stride, kOffsets[o], mixbits, mixresValues[m], shifted );
+				}
+			}
+		}
+	}
+}
+
+int main( void )
+{
+	testMix16();
+	testMix20And24();
+
+	printf( "matrix_enc: %d of %d cases bit-exact (SIMD features 0x%x)\n",
+			sCaseCount - sFailureCount, sCaseCount, (unsigned) alac_simd_features() );
+
+	return (sFailureCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,79 @@
+/*
+	File:		simdlib.h
+
+	Contains:	CPU feature detection for the vectorized encode routines.
+				Each vectorized routine is bit-exact with its C counterpart
+				and is only selected when the running CPU supports it.
+*/
+
+#ifndef __SIMDLIB_H
+#define __SIMDLIB_H
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define ALAC_SIMD_X86		1
+	#define ALAC_TARGET(x)		__attribute__((target(x)))
+	#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#define ALAC_SIMD_X86		1
+	#define ALAC_TARGET(x)
+	#include <intrin.h>
+	#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+	#define ALAC_SIMD_NEON		1
+	#include <arm_neon.h>
+#endif
+
+enum
+{
+	kALACSimdSSE2	= 1 << 0,
+	kALACSimdSSE41	= 1 << 1,
+	kALACSimdAVX2	= 1 << 2,
+	kALACSimdNEON	= 1 << 3
+};
+
+static inline uint32_t alac_simd_features( void )
+{
+	static volatile int32_t	features = -1;		// detected once; racing callers store the same value
+
+	if ( features < 0 )
+	{
+		uint32_t	found = 0;
+
+#if ALAC_SIMD_X86 && defined(_MSC_VER)
+		int			info[4];
+
+		__cpuid( info, 1 );
+		if ( info[3] & (1 << 26) )
+			found |= kALACSimdSSE2;
+		if ( info[2] & (1 << 19) )
+			found |= kALACSimdSSE41;
+		if ( (info[2] & (1 << 27)) && ((_xgetbv( 0 ) & 6) == 6) )
+		{
+			// OS saves YMM registers, so AVX2 is usable if the CPU has it
+			__cpuidex( info, 7, 0 );
+			if ( info[1] & (1 << 5) )
+				found |= kALACSimdAVX2;
+		}
+#elif ALAC_SIMD_X86
+		__builtin_cpu_init();
+		if ( __builtin_cpu_supports( "sse2" ) )
+			found |= kALACSimdSSE2;
+		if ( __builtin_cpu_supports( "sse4.1" ) )
+			found |= kALACSimdSSE41;
+		if ( __builtin_cpu_supports( "avx2" ) )
+			found |= kALACSimdAVX2;
+#elif ALAC_SIMD_NEON
+		found |= kALACSimdNEON;
+#endif
+
+		features = (int32_t) found;
+	}
+
+	return (uint32_t) features;
+}
+
+#endif	/* __SIMDLIB_H */
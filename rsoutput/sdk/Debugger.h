@@ -33,6 +33,10 @@ public:
 	static void printException(const std::exception&, const std::string& scope = "");
 	static void printLastError(const std::string& scope = "", const char* file = NULL, int line = 0);
 
+	// whether printed output is seen, by print callback or attached debugger,
+	// so that output costly to build can be skipped when it would not be
+	static bool isEnabled();
+
 	typedef void (*PrintCallback)(const char*);
 	static void setPrintCallback(PrintCallback);
 
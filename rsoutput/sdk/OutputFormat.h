@@ -55,17 +55,36 @@ private:
 };
 
 
+class RSOUTPUT_API SampleEncoding
+{
+public:
+	enum Type
+	{
+		INTEGER = 0, // signed, little-endian
+		FLOAT   = 1  // IEEE single precision; sample size must be 4
+	};
+
+	explicit SampleEncoding(Type);
+	operator Type() const;
+
+private:
+	Type _value;
+};
+
+
 class RSOUTPUT_API OutputFormat
 {
 public:
 	explicit OutputFormat(
 		SampleRate rate = SampleRate(std::numeric_limits<int>::max()), // max Hz
 		SampleSize size = SampleSize(2),                               // 16-bit
-		ChannelCount count = ChannelCount(2));                         // stereo
+		ChannelCount count = ChannelCount(2),                          // stereo
+		SampleEncoding encoding = SampleEncoding(SampleEncoding::INTEGER));
 
 	const SampleRate& sampleRate() const;
 	const SampleSize& sampleSize() const;
 	const ChannelCount& channelCount() const;
+	const SampleEncoding& sampleEncoding() const;
 
 	bool operator ==(const OutputFormat&) const;
 
@@ -73,6 +92,7 @@ private:
 	SampleRate _sampleRate;
 	SampleSize _sampleSize;
 	ChannelCount _channelCount;
+	SampleEncoding _sampleEncoding;
 };
 
 
@@ -18,6 +18,7 @@
 #define DeviceInfo_h
 
 
+#include "OutputFormat.h"
 #include <set>
 #include <string>
 #include <utility>
@@ -36,6 +37,13 @@ public:
 		ANY = 99 // Any other
 	};
 
+	enum AudioCodec {
+		PCM     = 0x01, // L16 (cn=0)
+		ALAC    = 0x02, // Apple Lossless (cn=1)
+		AAC     = 0x04, // (cn=2)
+		AAC_ELD = 0x08  // (cn=3)
+	};
+
 	typedef std::string DeviceName;
 	typedef std::pair<std::string,std::string> DeviceAddr;
 
@@ -43,19 +51,26 @@ public:
 		const DeviceType& type,
 		const DeviceName& name,
 		const DeviceAddr& addr,
-		bool zeroConf
+		bool zeroConf,
+		int audioCodecs = ALAC,
+		const OutputFormat& audioFormat = OutputFormat(SampleRate(44100))
 	);
 
 	const DeviceType& type() const { return _type; }
 	const DeviceName& name() const { return _name; }
 	const DeviceAddr& addr() const { return _addr; }
 	bool isZeroConf() const { return _zeroConf; }
+	int audioCodecs() const { return _audioCodecs; }
+	bool acceptsCodec(AudioCodec codec) const { return (_audioCodecs & codec) != 0; }
+	const OutputFormat& audioFormat() const { return _audioFormat; }
 
 private:
 	DeviceType _type;
 	DeviceName _name;
 	DeviceAddr _addr;
 	bool _zeroConf;
+	int _audioCodecs; // as advertised; not part of device identity
+	OutputFormat _audioFormat; // ditto
 };
 
 
@@ -31,6 +31,32 @@ class Options
 public:
 	typedef Poco::SharedPtr<Options> SharedPtr;
 
+	/** ALAC encoder effort; adaptive lowers effort when encoding falls behind */
+	enum EncoderEffort
+	{
+		ENCODER_EFFORT_UNCOMPRESSED = 0,
+		ENCODER_EFFORT_FAST = 1,
+		ENCODER_EFFORT_DEFAULT = 2,
+		ENCODER_EFFORT_EXHAUSTIVE = 3,
+		ENCODER_EFFORT_ADAPTIVE = 4
+	};
+
+	/** resampling filter length for common sample rate ratios like 48000->44100 */
+	enum ResamplerQuality
+	{
+		RESAMPLER_QUALITY_FAST = 0,
+		RESAMPLER_QUALITY_MEDIUM = 1,
+		RESAMPLER_QUALITY_BEST = 2
+	};
+
+	/** channels folded into the front pair when mixing surround input down to stereo */
+	enum DownmixChannel
+	{
+		DOWNMIX_CENTER = 0,
+		DOWNMIX_SURROUND = 1,
+		DOWNMIX_LFE = 2
+	};
+
 	static SharedPtr getOptions();
 	static void setOptions(SharedPtr);
 
@@ -47,6 +73,18 @@ public:
 	void setPlayerControl(bool);
 	bool getResetOnPause() const;
 	void setResetOnPause(bool);
+	bool getBatchedSend() const;
+	void setBatchedSend(bool);
+	unsigned int getMaxSendFailures() const;
+	void setMaxSendFailures(unsigned int);
+	EncoderEffort getEncoderEffort() const;
+	void setEncoderEffort(EncoderEffort);
+	ResamplerQuality getResamplerQuality() const;
+	void setResamplerQuality(ResamplerQuality);
+	float getDownmixLevel(DownmixChannel) const;
+	void setDownmixLevel(DownmixChannel, float);
+	unsigned int getOutputBufferFrames() const;
+	void setOutputBufferFrames(unsigned int);
 
 	const DeviceInfoSet &devices() const;
 	DeviceInfoSet &devices();
@@ -67,6 +105,12 @@ private:
 	bool _volumeControl;
 	bool _playerControl;
 	bool _resetOnPause;
+	bool _batchedSend;
+	unsigned int _maxSendFailures;
+	EncoderEffort _encoderEffort;
+	ResamplerQuality _resamplerQuality;
+	float _downmixLevels[3];
+	unsigned int _outputBufferFrames;
 
 	DeviceInfoSet _devices;
 	// _activatedDevices removed - activation check disabled
@@ -0,0 +1,135 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "ChannelMixer.h"
+#include <stdexcept>
+
+
+// WAVE channel positions
+enum Position { FL, FR, FC, LFE, BL, BR, BC, SL, SR };
+
+static const Position LAYOUTS[8][8] =
+{
+	{ FC },
+	{ FL, FR },
+	{ FL, FR, FC },
+	{ FL, FR, BL, BR },
+	{ FL, FR, FC, BL, BR },
+	{ FL, FR, FC, LFE, BL, BR },
+	{ FL, FR, FC, LFE, BC, SL, SR },
+	{ FL, FR, FC, LFE, BL, BR, SL, SR }
+};
+
+static const float MINUS_3DB = 0.70710678F;
+
+
+// gains of a position in the left and right of a stereo fold-down
+static void stereo_gains(const Position position, const ChannelMixer::Levels& levels,
+	const int inChannelCount, float& left, float& right)
+{
+	left = right = 0.0F;
+
+	switch (position)
+	{
+	case FL: left = 1.0F; break;
+	case FR: right = 1.0F; break;
+	case FC: left = right = (inChannelCount == 1 ? 1.0F : levels.center); break;
+	case LFE: left = right = levels.lfe; break;
+	case BL: case SL: left = levels.surround; break;
+	case BR: case SR: right = levels.surround; break;
+	case BC: left = right = levels.surround * MINUS_3DB; break;
+	}
+}
+
+
+//------------------------------------------------------------------------------
+
+
+ChannelMixer::Levels::Levels()
+:
+	center(MINUS_3DB),
+	surround(MINUS_3DB),
+	lfe(0.0F)
+{
+}
+
+
+ChannelMixer::ChannelMixer(const ChannelCount& in, const ChannelCount& out,
+	const Levels& levels)
+:
+	_inChannelCount(in),
+	_outChannelCount(out),
+	_columns(in * SampleConversion::MIX_STRIDE, 0.0F),
+	_mix(SampleConversion::mix())
+{
+	for (int i = 0; i < _inChannelCount; ++i)
+	{
+		const Position position = LAYOUTS[_inChannelCount - 1][i];
+
+		if (_outChannelCount <= 2)
+		{
+			float left, right;
+			stereo_gains(position, levels, _inChannelCount, left, right);
+
+			if (_outChannelCount == 1)
+			{
+				setCoefficient(0, i, (left + right) / 2.0F);
+			}
+			else
+			{
+				setCoefficient(0, i, left);
+				setCoefficient(1, i, right);
+			}
+		}
+		else
+		{
+			// pass through channels the output layout has in the same place
+			for (int o = 0; o < _outChannelCount; ++o)
+			{
+				if (LAYOUTS[_outChannelCount - 1][o] == position)
+					setCoefficient(o, i, 1.0F);
+			}
+		}
+	}
+}
+
+
+float ChannelMixer::coefficient(const int out, const int in) const
+{
+	if (out < 0 || out >= _outChannelCount || in < 0 || in >= _inChannelCount)
+	{
+		throw std::out_of_range("channel");
+	}
+
+	return _columns[(in * SampleConversion::MIX_STRIDE) + out];
+}
+
+
+void ChannelMixer::setCoefficient(const int out, const int in, const float gain)
+{
+	if (out < 0 || out >= _outChannelCount || in < 0 || in >= _inChannelCount)
+	{
+		throw std::out_of_range("channel");
+	}
+
+	_columns[(in * SampleConversion::MIX_STRIDE) + out] = gain;
+}
+
+
+void ChannelMixer::mix(const float* const in, float* const out, const size_t frameCount) const
+{
+	_mix(in, out, frameCount, &_columns[0], _inChannelCount, _outChannelCount);
+}
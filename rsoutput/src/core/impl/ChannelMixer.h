@@ -0,0 +1,62 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ChannelMixer_h
+#define ChannelMixer_h
+
+
+#include "OutputFormat.h"
+#include "SampleConversion.h"
+#include <vector>
+
+
+/**
+ * Mixes interleaved floating-point frames from one channel layout to another
+ * through a matrix of gains. Input channels are taken to be in WAVE order:
+ * front left, front right, front center, LFE, back left, back right, side left,
+ * side right (3: L R C, 4: L R BL BR, 5: L R C BL BR, 7: L R C LFE BC SL SR).
+ */
+class ChannelMixer
+{
+public:
+	/** gains for folding channels into the front pair; defaults per ITU-R BS.775 */
+	struct Levels
+	{
+		Levels();
+
+		float center;
+		float surround;
+		float lfe;
+	};
+
+	ChannelMixer(const ChannelCount& in, const ChannelCount& out,
+		const Levels& = Levels());
+
+	float coefficient(int out, int in) const;
+	void setCoefficient(int out, int in, float);
+
+	void mix(const float* in, float* out, size_t frameCount) const;
+
+private:
+	const int _inChannelCount;
+	const int _outChannelCount;
+
+	std::vector<float> _columns; // SampleConversion::MIX_STRIDE per input channel
+	const SampleConversion::Mix _mix;
+};
+
+
+#endif // ChannelMixer_h
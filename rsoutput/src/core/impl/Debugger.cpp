@@ -133,6 +133,12 @@ void Debugger::printLastError(const std::string& scope, const char* const file,
 }
 
 
+bool Debugger::isEnabled()
+{
+	return _echo != NULL || Poco::Debugger::isAvailable();
+}
+
+
 void Debugger::setPrintCallback(const PrintCallback proc)
 {
 	_echo = proc;
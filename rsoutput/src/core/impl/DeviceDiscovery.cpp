@@ -20,6 +20,7 @@
 #include "Uncopyable.h"
 #include <stdexcept>
 #include <cassert>
+#include <cstdlib>
 #include <exception>
 #include <map>
 #include <set>
@@ -56,6 +57,8 @@ class DeviceDiscoveryImpl
 	void onServiceQueried(DNSServiceRef, std::string, uint16_t, uint16_t, const void*, uint32_t);
 
 	DeviceInfo::DeviceType determineDeviceType(const ServiceDiscovery::TXTRecord&) const;
+	int determineAudioCodecs(const ServiceDiscovery::TXTRecord&) const;
+	OutputFormat determineAudioFormat(const ServiceDiscovery::TXTRecord&) const;
 
 	struct ServiceInfo { std::string name; std::string type; };
 	std::map<DNSServiceRef,const ServiceInfo> _services;
@@ -211,7 +214,8 @@ void DeviceDiscoveryImpl::onServiceQueried(
 
 	const DeviceInfo device(
 		determineDeviceType(txtRecord), part_two_of(info.name),
-		std::make_pair(info.name, info.type), /*zeroConf:*/true);
+		std::make_pair(info.name, info.type), /*zeroConf:*/true,
+		determineAudioCodecs(txtRecord), determineAudioFormat(txtRecord));
 
 	ScopedLock lock(_mutex);
 
@@ -481,8 +485,8 @@ DeviceInfo::DeviceType DeviceDiscoveryImpl::determineDeviceType(
 
 	// check common properties of all device types
 	assert(!txtRecord.has("txtvers") || txtRecord.get("txtvers") == "1");
-	assert(!txtRecord.has("sr") || txtRecord.get("sr") == "44100");
-	assert(!txtRecord.has("ss") || txtRecord.get("ss") == "16");
+	assert(!txtRecord.has("sr") || txtRecord.test("sr", "44100|48000|88200|96000"));
+	assert(!txtRecord.has("ss") || txtRecord.test("ss", "16|24"));
 	assert(!txtRecord.has("ch") || txtRecord.get("ch") == "2");
 	assert(!txtRecord.has("pw") || txtRecord.test("pw", "true|false"));
 	assert(!txtRecord.has("sv") || txtRecord.test("sv", "true|false"));
@@ -684,3 +688,42 @@ DeviceInfo::DeviceType DeviceDiscoveryImpl::determineDeviceType(
 	// store encryption and metadata settings with device type
 	return DeviceInfo::DeviceType(MAKELONG(DeviceInfo::ANY, bits));
 }
+
+
+int DeviceDiscoveryImpl::determineAudioCodecs(
+	const ServiceDiscovery::TXTRecord& txtRecord) const
+{
+	// devices that do not list their codings are assumed to accept only ALAC
+	if (!txtRecord.has("cn"))
+	{
+		return DeviceInfo::ALAC;
+	}
+
+	int codecs = 0;
+	if (txtRecord.test("cn", "(\\d,)*0(,\\d)*")) codecs |= DeviceInfo::PCM;
+	if (txtRecord.test("cn", "(\\d,)*1(,\\d)*")) codecs |= DeviceInfo::ALAC;
+	if (txtRecord.test("cn", "(\\d,)*2(,\\d)*")) codecs |= DeviceInfo::AAC;
+	if (txtRecord.test("cn", "(\\d,)*3(,\\d)*")) codecs |= DeviceInfo::AAC_ELD;
+
+	return codecs;
+}
+
+
+OutputFormat DeviceDiscoveryImpl::determineAudioFormat(
+	const ServiceDiscovery::TXTRecord& txtRecord) const
+{
+	// devices that do not state their format are assumed to accept CD audio
+	int sampleRate = 44100, sampleSize = 16;
+
+	if (txtRecord.has("sr") && txtRecord.test("sr", "44100|48000|88200|96000"))
+	{
+		sampleRate = std::atoi(txtRecord.get("sr").c_str());
+	}
+	if (txtRecord.has("ss") && txtRecord.test("ss", "16|24"))
+	{
+		sampleSize = std::atoi(txtRecord.get("ss").c_str());
+	}
+
+	// a stereo stream is always sent, whatever channel count is advertised
+	return OutputFormat(SampleRate(sampleRate), SampleSize(sampleSize / 8), ChannelCount(2));
+}
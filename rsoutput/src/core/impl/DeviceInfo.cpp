@@ -21,12 +21,16 @@ DeviceInfo::DeviceInfo(
 	const DeviceType& type,
 	const DeviceName& name,
 	const DeviceAddr& addr,
-	const bool zeroConf)
+	const bool zeroConf,
+	const int audioCodecs,
+	const OutputFormat& audioFormat)
 :
 	_type(type),
 	_name(name),
 	_addr(addr),
-	_zeroConf(zeroConf)
+	_zeroConf(zeroConf),
+	_audioCodecs(audioCodecs),
+	_audioFormat(audioFormat)
 {
 }
 
@@ -25,7 +25,9 @@
 #include <cassert>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <iostream>
+#include <algorithm>
 #include <Poco/Format.h>
 #include <Poco/Event.h>
 #include <Poco/Net/SocketAddress.h>
@@ -38,15 +40,39 @@ using Poco::Timespan;
 using Poco::Timestamp;
 using Poco::Net::StreamSocket;
 
+// seconds allowed for each device to be resolved, connected and negotiated
+static const long OPEN_TIMEOUT_SEC = 15;
+
+// maximum time to wait for devices to open before checking again
+static const long OPEN_WAIT_MSEC = 100;
+
 namespace
 {
 
+	// time left until deadline, which must not have passed
+	Timespan timeLeft(const Timestamp &deadline)
+	{
+		const Timestamp::TimeDiff left = deadline - Timestamp();
+		if (left <= 0)
+		{
+			throw std::runtime_error("Timeout opening device");
+		}
+		return Timespan(left);
+	}
+
+	// reported for remote speakers whose socket was shut down at the deadline
+	std::runtime_error negotiationTimeout(const DeviceInfo &device)
+	{
+		return std::runtime_error(Poco::format(
+			"Remote speakers \"%s\" did not answer in time.", device.name()));
+	}
+
 	class DeviceConnector : public ServiceDiscovery::ResolveListener, public ServiceDiscovery::QueryListener
 	{
 	public:
 		DeviceConnector(const DeviceInfo &device) : _device(device), _port(0), _resolved(false), _sdRef(NULL) {}
 
-		void connect(Poco::Net::StreamSocket &socket)
+		void connect(Poco::Net::StreamSocket &socket, const Timestamp &deadline)
 		{
 			if (_device.isZeroConf())
 			{
@@ -55,8 +81,8 @@ namespace
 
 				try
 				{
-					if (!_event.tryWait(5000))
-					{ // 5 seconds timeout
+					if (!_event.tryWait(static_cast<long>((std::min)(Timespan::TimeDiff(5000), timeLeft(deadline).totalMilliseconds()))))
+					{ // 5 seconds timeout, or less if deadline is closer
 						if (_sdRef)
 						{
 							ServiceDiscovery::stop(_sdRef);
@@ -85,12 +111,12 @@ namespace
 				{
 					throw std::runtime_error("Failed to resolve device address");
 				}
-				socket.connect(_resolvedAddress);
+				socket.connect(_resolvedAddress, timeLeft(deadline));
 			}
 			else
 			{
 				std::string hostAndPort = _device.addr().first + ":" + _device.addr().second;
-				socket.connect(Poco::Net::SocketAddress(hostAndPort));
+				socket.connect(Poco::Net::SocketAddress(hostAndPort), timeLeft(deadline));
 			}
 		}
 
@@ -128,12 +154,30 @@ namespace
 // shorthand for accessing the implementation type of device output sink
 #define RAOP_ENGINE (*(*this).outputSinkForDevices().cast<RAOPEngine>())
 
+const int DeviceManager::OPEN_THREAD_COUNT;
+
 DeviceManager::DeviceManager(Player &player, OutputObserver &outputObserver)
 	: _volume(FLT_MIN),
 	  _player(player),
 	  _outputObserver(outputObserver),
-	  _deviceObserver(*this, &DeviceManager::onDeviceChanged)
+	  _deviceObserver(*this, &DeviceManager::onDeviceChanged),
+	  _openGeneration(0),
+	  _sessionOpenCount(0),
+	  _stopOpening(false),
+	  _openRunnable(*this, &DeviceManager::runOpenQueue),
+	  _stopWatching(false),
+	  _openWatchRunnable(*this, &DeviceManager::runOpenWatch)
 {
+	// devices are opened concurrently, each by one of a few pool threads
+	for (int i = 0; i < OPEN_THREAD_COUNT; ++i)
+	{
+		_openThreads[i].setName("DeviceManager::runOpenQueue");
+		_openThreads[i].start(_openRunnable);
+	}
+
+	_openWatchThread.setName("DeviceManager::runOpenWatch");
+	_openWatchThread.start(_openWatchRunnable);
+
 	Options::addObserver(_deviceObserver);
 	DeviceDiscovery::browseDevices(*this);
 }
@@ -142,6 +186,26 @@ DeviceManager::~DeviceManager()
 {
 	DeviceDiscovery::stopBrowsing(*this);
 	Options::removeObserver(_deviceObserver);
+
+	try
+	{
+		{
+			ScopedLock lock(_mutex);
+			_openQueue.clear();
+		}
+
+		_stopOpening = true;
+		_openQueueEvent.set();
+		for (int i = 0; i < OPEN_THREAD_COUNT; ++i)
+		{
+			_openThreads[i].join();
+		}
+
+		// deadlines are enforced until the last open is done
+		_stopWatching = true;
+		_openWatchThread.join();
+	}
+	CATCH_ALL
 }
 
 void DeviceManager::openDevices()
@@ -151,6 +215,9 @@ void DeviceManager::openDevices()
 	// hold reference to active options
 	const Options::SharedPtr options = Options::getOptions();
 
+	// devices asked for here, which playback waits on
+	std::set<std::string> waiting;
+
 	for (DeviceInfoSet::const_iterator it = options->devices().begin();
 		 it != options->devices().end(); ++it)
 	{
@@ -158,7 +225,8 @@ void DeviceManager::openDevices()
 
 		// License check removed - all devices automatically activated
 		anyDeviceActivated = true;
-		openDevice(deviceInfo);
+		queueDevice(deviceInfo);
+		waiting.insert(deviceInfo.name());
 	}
 
 	DeviceInfoSet discovered;
@@ -172,7 +240,42 @@ void DeviceManager::openDevices()
 	{
 		// License check removed - all devices automatically activated
 		anyDeviceActivated = true;
-		openDevice(*it);
+		queueDevice(*it);
+		waiting.insert(it->name());
+	}
+
+	// start playback as soon as any device is ready rather than when all are;
+	// the others join the stream in sync as they open, as do any still being
+	// opened once a device's open timeout has passed, since it covers just
+	// one device and those queued behind the pool threads start theirs later
+	Timestamp deadline;
+	deadline += OPEN_TIMEOUT_SEC * Timespan::SECONDS;
+	for (;;)
+	{
+		{
+			ScopedLock lock(_mutex);
+
+			if (anyDeviceOpen(true))
+			{
+				break;
+			}
+
+			// devices queued by others, such as on activation, are not waited on
+			for (std::set<std::string>::iterator it = waiting.begin(); it != waiting.end();)
+			{
+				if (_queuedDevices.count(*it) == 0)
+					waiting.erase(it++);
+				else
+					++it;
+			}
+
+			if (waiting.empty() || deadline <= Timestamp())
+			{
+				break;
+			}
+		}
+
+		_openDoneEvent.tryWait(OPEN_WAIT_MSEC);
 	}
 
 	if (!anyDeviceActivated)
@@ -194,11 +297,23 @@ void DeviceManager::closeDevices()
 {
 	ScopedLock lock(_mutex);
 
+	// cancel devices not yet opened; those being opened are closed by their
+	// pool threads once they are, and queued again if asked for meanwhile
+	++_openGeneration;
+	for (std::deque<DeviceInfo>::const_iterator it = _openQueue.begin(); it != _openQueue.end(); ++it)
+	{
+		_queuedDevices.erase(it->name());
+	}
+	_openQueue.clear();
+
 	for (DeviceMap::const_iterator it = _devices.begin(); it != _devices.end(); ++it)
 	{
 		DeviceMap::mapped_type device = it->second;
 
-		device->close();
+		if (_openingDevices.count(it->first) == 0)
+		{
+			device->close();
+		}
 	}
 }
 
@@ -206,11 +321,14 @@ bool DeviceManager::isAnyDeviceOpen(const bool ping) const
 {
 	ScopedLock lock(_mutex);
 
+	return anyDeviceOpen(ping);
+}
+
+bool DeviceManager::anyDeviceOpen(const bool ping) const
+{
 	for (DeviceMap::const_iterator it = _devices.begin(); it != _devices.end(); ++it)
 	{
-		const DeviceMap::mapped_type device = it->second;
-
-		if (device->isOpen(ping))
+		if (isDeviceOpen(*it, ping))
 		{
 			return true;
 		}
@@ -219,6 +337,12 @@ bool DeviceManager::isAnyDeviceOpen(const bool ping) const
 	return false;
 }
 
+bool DeviceManager::isDeviceOpen(const DeviceMap::value_type &entry, const bool ping) const
+{
+	// device being opened belongs to its pool thread until it is
+	return (_openingDevices.count(entry.first) == 0 && entry.second->isOpen(ping));
+}
+
 void DeviceManager::setVolume(const float level)
 {
 	ScopedLock lock(_mutex);
@@ -230,7 +354,7 @@ void DeviceManager::setVolume(const float level)
 	{
 		DeviceMap::mapped_type device = it->second;
 
-		if (device->isOpen())
+		if (isDeviceOpen(*it))
 		{
 			device->setVolume(level, delta);
 		}
@@ -254,7 +378,7 @@ void DeviceManager::setOffset(const time_t offset)
 	{
 		DeviceMap::mapped_type device = it->second;
 
-		if (device->isOpen())
+		if (isDeviceOpen(*it))
 		{
 			device->updateProgress(_outputInterval);
 		}
@@ -274,7 +398,7 @@ void DeviceManager::setMetadata(const OutputMetadata &metadata)
 	{
 		DeviceMap::mapped_type device = it->second;
 
-		if (device->isOpen())
+		if (isDeviceOpen(*it))
 		{
 			device->updateMetadata(_outputMetadata);
 		}
@@ -291,7 +415,9 @@ void DeviceManager::clearMetadata()
 
 const OutputFormat &DeviceManager::outputFormat() const
 {
-	return RAOPEngine::outputFormat();
+	// format of current session, as negotiated when its first device opened
+	return (_deviceOutputSink.isNull() ? RAOPEngine::defaultOutputFormat()
+									   : _deviceOutputSink.cast<RAOPEngine>()->outputFormat());
 }
 
 OutputSink::SharedPtr DeviceManager::outputSinkForDevices()
@@ -334,7 +460,7 @@ void DeviceManager::onDeviceFound(const DeviceInfo &device)
 
 	if (_deviceOutputSink.referenceCount() > 1)
 	{
-		openDevice(device);
+		queueDevice(device);
 	}
 }
 
@@ -395,18 +521,169 @@ void DeviceManager::destroyDevice(const DeviceInfo &deviceInfo)
 	_devices.erase(deviceInfo.name());
 }
 
-void DeviceManager::openDevice(const DeviceInfo &deviceInfo)
+void DeviceManager::queueDevice(const DeviceInfo &deviceInfo)
 {
-	try
 	{
 		ScopedLock lock(_mutex);
 
-		if (_devices.count(deviceInfo.name()) == 0)
+		// check if device is already queued or being opened; one still being
+		// opened for playback since stopped is queued again by its pool thread
+		const std::pair<std::map<std::string, unsigned int>::iterator, bool> queued =
+			_queuedDevices.insert(std::make_pair(deviceInfo.name(), _openGeneration));
+		if (!queued.second)
+		{
+			queued.first->second = _openGeneration;
+			return;
+		}
+
+		_openQueue.push_back(deviceInfo);
+	}
+
+	_openQueueEvent.set();
+}
+
+void DeviceManager::runOpenQueue()
+{
+	while (!_stopOpening)
+	{
+		try
+		{
+			ScopedLockWithUnlock lock(_mutex);
+
+			if (_openQueue.empty())
+			{
+				lock.unlock();
+
+				_openQueueEvent.tryWait(OPEN_WAIT_MSEC);
+				continue;
+			}
+
+			const DeviceInfo deviceInfo(_openQueue.front());
+			_openQueue.pop_front();
+			_openingDevices.insert(deviceInfo.name());
+			const unsigned int openGeneration = _openGeneration;
+
+			// wake another pool thread for the next device
+			if (!_openQueue.empty())
+			{
+				_openQueueEvent.set();
+			}
+
+			lock.unlock();
+
+			openDevice(deviceInfo, openGeneration);
+
+			{
+				ScopedLock doneLock(_mutex);
+
+				_openingDevices.erase(deviceInfo.name());
+
+				// device was asked for again after its playback was stopped, and
+				// was closed (or not opened) for that, so open it once more
+				const std::map<std::string, unsigned int>::iterator queued =
+					_queuedDevices.find(deviceInfo.name());
+				if (openGeneration != _openGeneration && queued->second == _openGeneration)
+				{
+					_openQueue.push_back(deviceInfo);
+					_openQueueEvent.set();
+				}
+				else
+				{
+					_queuedDevices.erase(queued);
+				}
+			}
+
+			_openDoneEvent.set();
+		}
+		CATCH_ALL
+	}
+}
+
+void DeviceManager::watchOpenDeadline(const std::string &name,
+	const StreamSocket &socket, const Timestamp &deadline)
+{
+	ScopedLock lock(_mutex);
+
+	const OpenDeadline watch = { deadline, socket, false };
+	_openDeadlines.erase(name);
+	_openDeadlines.insert(std::make_pair(name, watch));
+}
+
+bool DeviceManager::unwatchOpenDeadline(const std::string &name)
+{
+	ScopedLock lock(_mutex);
+
+	const std::map<std::string, OpenDeadline>::iterator pos = _openDeadlines.find(name);
+	if (pos == _openDeadlines.end())
+	{
+		return false;
+	}
+
+	const bool expired = pos->second.expired;
+	_openDeadlines.erase(pos);
+
+	return expired;
+}
+
+void DeviceManager::runOpenWatch()
+{
+	while (!_stopWatching)
+	{
+		{
+			ScopedLock lock(_mutex);
+
+			const Timestamp now;
+			for (std::map<std::string, OpenDeadline>::iterator it = _openDeadlines.begin();
+				 it != _openDeadlines.end(); ++it)
+			{
+				if (!it->second.expired && it->second.deadline <= now)
+				{
+					// fails the request the pool thread is waiting on, whether
+					// sending it or receiving its response
+					it->second.expired = true;
+					try
+					{
+						it->second.socket.shutdown();
+					}
+					CATCH_ALL
+				}
+			}
+		}
+
+		Poco::Thread::sleep(OPEN_WAIT_MSEC);
+	}
+}
+
+void DeviceManager::openDevice(const DeviceInfo &deviceInfo, const unsigned int openGeneration)
+{
+	// device is only used by this thread until it is open, so network round
+	// trips are made without holding lock and other devices open meanwhile
+	Timestamp deadline;
+	deadline += OPEN_TIMEOUT_SEC * Timespan::SECONDS;
+
+	try
+	{
+		Device::SharedPtr device;
+		bool isNewDevice = false;
 		{
-			Device::SharedPtr device = createDevice(deviceInfo);
+			ScopedLock lock(_mutex);
 
-			_devices[deviceInfo.name()] = device;
+			const DeviceMap::const_iterator pos = _devices.find(deviceInfo.name());
+			if (pos == _devices.end())
+			{
+				device = createDevice(deviceInfo);
+				isNewDevice = true;
+
+				_devices[deviceInfo.name()] = device;
+			}
+			else
+			{
+				device = pos->second;
+			}
+		}
 
+		if (isNewDevice)
+		{
 			// run dialog box that will asynchronously resolve service name to
 			// host and port, resolve host to IP address and connect to address
 			// and port
@@ -414,7 +691,7 @@ void DeviceManager::openDevice(const DeviceInfo &deviceInfo)
 			try
 			{
 				DeviceConnector connector(deviceInfo);
-				connector.connect(socket);
+				connector.connect(socket, deadline);
 			}
 			catch (const std::exception &e)
 			{
@@ -427,36 +704,59 @@ void DeviceManager::openDevice(const DeviceInfo &deviceInfo)
 			Debugger::printf("Connected to remote speakers \"%s\" at %s.",
 							 deviceInfo.name().c_str(), socket.peerAddress().toString().c_str());
 
-			int returnCode = device->test(socket, true);
+			// socket is shut down if remote speakers are still being tested at
+			// the deadline
+			watchOpenDeadline(deviceInfo.name(), socket, deadline);
 
-			// check if remote speakers require a password
-			while (returnCode == 401)
+			int returnCode;
+			try
 			{
-				Options::SharedPtr options = Options::getOptions();
+				returnCode = device->test(socket, true);
 
-				// check for password in options
-				if (options->getPassword(deviceInfo.name()).empty())
+				// check if remote speakers require a password
+				while (returnCode == 401)
 				{
-					// prompt user for password
-					std::cerr << "Password required for " << deviceInfo.name() << " but dialog not supported." << std::endl;
-					throw std::invalid_argument("Password required but not provided.");
-				}
+					Options::SharedPtr options = Options::getOptions();
+
+					// check for password in options
+					if (options->getPassword(deviceInfo.name()).empty())
+					{
+						// prompt user for password
+						std::cerr << "Password required for " << deviceInfo.name() << " but dialog not supported." << std::endl;
+						throw std::invalid_argument("Password required but not provided.");
+					}
+
+					device->setPassword(options->getPassword(deviceInfo.name()));
 
-				device->setPassword(options->getPassword(deviceInfo.name()));
+					returnCode = device->test(socket, false);
 
-				returnCode = device->test(socket, false);
+					// check if password was not accepted
+					if (returnCode == 401)
+					{
+						options->clearPassword(deviceInfo.name());
+					}
 
-				// check if password was not accepted
-				if (returnCode == 401)
+					// repeat until password is accepted or user cancels
+				}
+			}
+			catch (...)
+			{
+				if (unwatchOpenDeadline(deviceInfo.name()))
 				{
-					options->clearPassword(deviceInfo.name());
+					throw negotiationTimeout(deviceInfo);
 				}
-
-				// repeat until password is accepted or user cancels
+				throw;
 			}
 
+			const bool timedOut = unwatchOpenDeadline(deviceInfo.name());
+
 			device->close();
 
+			if (timedOut)
+			{
+				throw negotiationTimeout(deviceInfo);
+			}
+
 			// check for initiation error
 			if (returnCode)
 			{
@@ -470,98 +770,168 @@ void DeviceManager::openDevice(const DeviceInfo &deviceInfo)
 			}
 		}
 
-		DeviceMap::mapped_type device = _devices[deviceInfo.name()];
-
 		if (!device->isOpen())
 		{
-			if (!isAnyDeviceOpen())
 			{
-				// before opening the first device, init shared session state
-				RAOP_ENGINE.reinit(_outputInterval);
-			}
+				ScopedLock lock(_mutex);
 
-			// run dialog box that will asynchronously resolve service name to
-			// host and port, resolve host to IP address and connect to address
-			// and port
-			StreamSocket socket;
-			try
-			{
-				DeviceConnector connector(deviceInfo);
-				connector.connect(socket);
-			}
-			catch (const std::exception &e)
-			{
-				const std::string message(Poco::format(
-					"Unable to connect to remote speakers \"%s\": %s",
-					deviceInfo.name(), std::string(e.what())));
-				throw std::runtime_error(message);
-			}
+				// check if playback was stopped meanwhile
+				if (openGeneration != _openGeneration)
+				{
+					return;
+				}
 
-			AudioJackStatus audioJackStatus = AUDIO_JACK_CONNECTED;
+				const DeviceInfo &advertised = advertisedInfo(deviceInfo);
 
-			// negotiate session parameters with remote speakers
-			int returnCode = device->open(socket, audioJackStatus);
+				if (!anyDeviceOpen(true) && _sessionOpenCount == 0)
+				{
+					// before opening the first device, init shared session state
+					OutputFormat sessionFormat;
+					bool pcmPayload;
+					chooseSessionFormat(sessionFormat, pcmPayload);
 
-			// check if remote speakers require a password
-			while (returnCode == 401)
+					RAOP_ENGINE.reinit(_outputInterval, sessionFormat, pcmPayload);
+				}
+				else if (!(RAOP_ENGINE.outputFormat() == RAOPEngine::defaultOutputFormat()
+						   || RAOP_ENGINE.outputFormat() == advertised.audioFormat())
+					|| (RAOP_ENGINE.isPCMPayload() && !advertised.acceptsCodec(DeviceInfo::PCM)))
+				{
+					// every device accepts the default format, but not necessarily
+					// the format or the payload a session negotiated
+					const std::string message(Poco::format(
+						"Remote speakers \"%s\" do not accept audio as it is being streamed.\n"
+						"They can be added when playback is restarted.",
+						deviceInfo.name()));
+					std::cerr << message << std::endl;
+
+					throw std::runtime_error(message);
+				}
+
+				// session is not reinitialized while any device negotiates it
+				++_sessionOpenCount;
+			}
+
+			try
 			{
-				Options::SharedPtr options = Options::getOptions();
+				AudioJackStatus audioJackStatus = AUDIO_JACK_CONNECTED;
 
-				// check for password in options
-				if (options->getPassword(deviceInfo.name()).empty())
+				// run dialog box that will asynchronously resolve service name to
+				// host and port, resolve host to IP address and connect to address
+				// and port
+				StreamSocket socket;
+				try
 				{
-					// prompt user for password
-					std::cerr << "Password required for " << deviceInfo.name() << " but dialog not supported." << std::endl;
-					throw std::invalid_argument("Password required but not provided.");
+					DeviceConnector connector(deviceInfo);
+					connector.connect(socket, deadline);
+				}
+				catch (const std::exception &e)
+				{
+					const std::string message(Poco::format(
+						"Unable to connect to remote speakers \"%s\": %s",
+						deviceInfo.name(), std::string(e.what())));
+					throw std::runtime_error(message);
 				}
 
-				device->setPassword(options->getPassword(deviceInfo.name()));
-
-				// negotiate session parameters with remote speakers again
-				returnCode = device->open(socket, audioJackStatus);
+				// negotiate session parameters with remote speakers; socket is shut
+				// down if they are still negotiating at the deadline
+				watchOpenDeadline(deviceInfo.name(), socket, deadline);
+				int returnCode = device->open(socket, audioJackStatus);
 
-				// check if password was not accepted
-				if (returnCode == 401)
+				// check if remote speakers require a password
+				while (returnCode == 401)
 				{
-					options->clearPassword(deviceInfo.name());
+					Options::SharedPtr options = Options::getOptions();
+
+					// check for password in options
+					if (options->getPassword(deviceInfo.name()).empty())
+					{
+						// prompt user for password
+						std::cerr << "Password required for " << deviceInfo.name() << " but dialog not supported." << std::endl;
+						throw std::invalid_argument("Password required but not provided.");
+					}
+
+					device->setPassword(options->getPassword(deviceInfo.name()));
+
+					// negotiate session parameters with remote speakers again
+					returnCode = device->open(socket, audioJackStatus);
+
+					// check if password was not accepted
+					if (returnCode == 401)
+					{
+						options->clearPassword(deviceInfo.name());
+					}
+
+					// repeat until password is accepted or user cancels
 				}
 
-				// repeat until password is accepted or user cancels
-			}
+				// check for negotiation error
+				if (returnCode)
+				{
+					if (returnCode == 453)
+					{
+						const std::string message(Poco::format(
+							"Remote speakers \"%s\" are in use by another player.",
+							deviceInfo.name()));
+						std::cerr << message << std::endl;
 
-			// check for negotiation error
-			if (returnCode)
-			{
-				if (returnCode == 453)
+						throw std::runtime_error(message);
+					}
+					else
+					{
+						const std::string message(Poco::format(
+							"Unable to connect to remote speakers \"%s\".\n"
+							"Error code: %i",
+							deviceInfo.name(), returnCode));
+						std::cerr << message << std::endl;
+
+						throw std::runtime_error(message);
+					}
+				}
+				else if (audioJackStatus == AUDIO_JACK_DISCONNECTED && LOWORD(deviceInfo.type()) != DeviceInfo::AVR)
 				{
 					const std::string message(Poco::format(
-						"Remote speakers \"%s\" are in use by another player.",
+						"Audio jack on remote speakers \"%s\" is not connected.",
 						deviceInfo.name()));
 					std::cerr << message << std::endl;
+				}
 
-					throw std::runtime_error(message);
+				if (deviceInfo.type() == DeviceInfo::AVR)
+					device->getVolume();
+
+				if (unwatchOpenDeadline(deviceInfo.name()))
+				{
+					throw negotiationTimeout(deviceInfo);
 				}
-				else
+			}
+			catch (...)
+			{
+				const bool timedOut = unwatchOpenDeadline(deviceInfo.name());
 				{
-					const std::string message(Poco::format(
-						"Unable to connect to remote speakers \"%s\".\n"
-						"Error code: %i",
-						deviceInfo.name(), returnCode));
-					std::cerr << message << std::endl;
-
-					throw std::runtime_error(message);
+					ScopedLock lock(_mutex);
+					--_sessionOpenCount;
+				}
+				if (timedOut)
+				{
+					throw negotiationTimeout(deviceInfo);
 				}
+				throw;
 			}
-			else if (audioJackStatus == AUDIO_JACK_DISCONNECTED && LOWORD(deviceInfo.type()) != DeviceInfo::AVR)
+
+			ScopedLock lock(_mutex);
+
+			--_sessionOpenCount;
+
+			// check if device was removed or playback was stopped meanwhile
+			const DeviceMap::const_iterator pos = _devices.find(deviceInfo.name());
+			if (pos == _devices.end() || pos->second != device || openGeneration != _openGeneration)
 			{
-				const std::string message(Poco::format(
-					"Audio jack on remote speakers \"%s\" is not connected.",
-					deviceInfo.name()));
-				std::cerr << message << std::endl;
+				device->close();
+				return;
 			}
 
-			if (deviceInfo.type() == DeviceInfo::AVR)
-				device->getVolume();
+			// hand device over to other threads with current playback state
+			_openingDevices.erase(deviceInfo.name());
+
 			if (volumeSet())
 				device->setVolume(_volume, 0);
 
@@ -571,9 +941,14 @@ void DeviceManager::openDevice(const DeviceInfo &deviceInfo)
 				device->updateProgress(_outputInterval);
 			}
 		}
-		else if (_outputMetadata.length() > 0)
+		else
 		{
-			device->updateProgress(_outputInterval);
+			ScopedLock lock(_mutex);
+
+			if (_outputMetadata.length() > 0)
+			{
+				device->updateProgress(_outputInterval);
+			}
 		}
 
 		return; // bypass exception handling
@@ -585,6 +960,53 @@ void DeviceManager::openDevice(const DeviceInfo &deviceInfo)
 		new DeviceNotification(DeviceNotification::DEACTIVATE, deviceInfo));
 }
 
+const DeviceInfo &DeviceManager::advertisedInfo(const DeviceInfo &deviceInfo) const
+{
+	// selected devices are stored without codecs and format, so prefer discovered info
+	const DeviceInfoSet::const_iterator pos = _discoveredDevices.find(deviceInfo);
+
+	return (pos != _discoveredDevices.end() ? *pos : deviceInfo);
+}
+
+void DeviceManager::chooseSessionFormat(OutputFormat &format, bool &pcmPayload) const
+{
+	// session includes every device that is opened for playback
+	std::vector<const DeviceInfo*> session;
+	{
+		const Options::SharedPtr options = Options::getOptions();
+		for (DeviceInfoSet::const_iterator it = options->devices().begin();
+			 it != options->devices().end(); ++it)
+		{
+			session.push_back(&advertisedInfo(*it));
+		}
+	}
+	for (DeviceInfoSet::const_iterator it = _discoveredDevices.begin();
+		 it != _discoveredDevices.end(); ++it)
+	{
+		session.push_back(&*it);
+	}
+
+	// audio is streamed in the format that all devices advertise, so that it
+	// is converted only if player's format differs; groups that disagree fall
+	// back to the default format, which every device accepts, and audio goes
+	// uncompressed only if every device accepts that too; devices advertise
+	// uncompressed audio as L16 (cn=0), so it is never sent at other sizes
+	format = (session.empty() ? RAOPEngine::defaultOutputFormat() : session.front()->audioFormat());
+	pcmPayload = true;
+
+	for (std::vector<const DeviceInfo*>::const_iterator it = session.begin();
+		 it != session.end(); ++it)
+	{
+		if (!((**it).audioFormat() == format))
+		{
+			format = RAOPEngine::defaultOutputFormat();
+		}
+		pcmPayload = pcmPayload && (**it).acceptsCodec(DeviceInfo::PCM);
+	}
+
+	pcmPayload = pcmPayload && format.sampleSize() == 2;
+}
+
 void DeviceManager::onDeviceChanged(DeviceNotification *const notification)
 {
 	try
@@ -595,7 +1017,7 @@ void DeviceManager::onDeviceChanged(DeviceNotification *const notification)
 			// open device if open for playback to pick it up immediately
 			if (_deviceOutputSink.referenceCount() > 1)
 			{
-				openDevice(notification->deviceInfo());
+				queueDevice(notification->deviceInfo());
 			}
 			break;
 
@@ -31,9 +31,17 @@
 #include "Uncopyable.h"
 #include <map>
 #include <cfloat>
+#include <deque>
+#include <set>
 #include <string>
+#include <Poco/Event.h>
 #include <Poco/Mutex.h>
 #include <Poco/Observer.h>
+#include <Poco/RunnableAdapter.h>
+#include <Poco/ScopedLock.h>
+#include <Poco/Thread.h>
+#include <Poco/Timestamp.h>
+#include <Poco/Net/StreamSocket.h>
 
 
 class DeviceManager
@@ -45,6 +53,9 @@ public:
 	DeviceManager(Player&, OutputObserver&);
 	~DeviceManager();
 
+	// returns once any device is open, every device failed to open or the
+	// open timeout passed; the rest keep opening in the background and join
+	// playback when ready
 	void openDevices();
 	void closeDevices();
 	bool isAnyDeviceOpen(bool ping = true) const;
@@ -65,9 +76,20 @@ public:
 	void onDeviceLost(const DeviceInfo&);
 
 private:
+	typedef std::map<const std::string,Device::SharedPtr> DeviceMap;
+
 	Device::SharedPtr createDevice(const DeviceInfo&);
 	void destroyDevice(const DeviceInfo&);
-	void openDevice(const DeviceInfo&);
+	void queueDevice(const DeviceInfo&);
+	void runOpenQueue();
+	void openDevice(const DeviceInfo&, unsigned int openGeneration);
+	void watchOpenDeadline(const std::string& name, const Poco::Net::StreamSocket&, const Poco::Timestamp& deadline);
+	bool unwatchOpenDeadline(const std::string& name);
+	void runOpenWatch();
+	bool anyDeviceOpen(bool ping) const;
+	bool isDeviceOpen(const DeviceMap::value_type&, bool ping = true) const;
+	const DeviceInfo& advertisedInfo(const DeviceInfo&) const;
+	void chooseSessionFormat(OutputFormat&, bool& pcmPayload) const;
 	bool volumeSet() const;
 
 	void onDeviceChanged(DeviceNotification*);
@@ -75,7 +97,6 @@ private:
 private:
 	OutputSink::SharedPtr _deviceOutputSink;
 
-	typedef std::map<const std::string,Device::SharedPtr> DeviceMap;
 	DeviceMap _devices; // must be declared after device output sink
 	DeviceInfoSet _discoveredDevices;
 
@@ -91,8 +112,38 @@ private:
 	Player& _player;
 	float _volume;
 
+	/** devices waiting to be opened by pool threads, and those being opened,
+	    which only their pool thread may use until they are */
+	std::deque<DeviceInfo> _openQueue;
+	std::map<std::string, unsigned int> _queuedDevices; // queued or being opened, by generation last asked for
+	std::set<std::string> _openingDevices;
+	unsigned int _openGeneration; // advanced when pending opens are cancelled
+	unsigned int _sessionOpenCount; // devices negotiating with shared session
+	Poco::Event _openQueueEvent;
+	Poco::Event _openDoneEvent;
+
+	static const int OPEN_THREAD_COUNT = 6;
+	volatile bool _stopOpening;
+	Poco::Thread _openThreads[OPEN_THREAD_COUNT];
+	Poco::RunnableAdapter<DeviceManager> _openRunnable;
+
+	/** sockets of devices being negotiated with, shut down by the watch thread
+	    once their deadline passes, so that a request left unanswered fails the
+	    open in time; expired ones are kept until unwatched, for their thread */
+	struct OpenDeadline
+	{
+		Poco::Timestamp deadline;
+		Poco::Net::StreamSocket socket;
+		bool expired;
+	};
+	std::map<std::string, OpenDeadline> _openDeadlines;
+	volatile bool _stopWatching;
+	Poco::Thread _openWatchThread;
+	Poco::RunnableAdapter<DeviceManager> _openWatchRunnable;
+
 	mutable Poco::FastMutex _mutex;
 	typedef const Poco::FastMutex::ScopedLock ScopedLock;
+	typedef Poco::ScopedLockWithUnlock<Poco::FastMutex> ScopedLockWithUnlock;
 };
 
 
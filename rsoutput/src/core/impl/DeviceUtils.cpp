@@ -137,6 +137,14 @@ void DeviceUtils::toggle(const std::string &which)
 	opts->setVolumeControl(options->getVolumeControl());
 	opts->setPlayerControl(options->getPlayerControl());
 	opts->setResetOnPause(options->getResetOnPause());
+	opts->setBatchedSend(options->getBatchedSend());
+	opts->setMaxSendFailures(options->getMaxSendFailures());
+	opts->setEncoderEffort(options->getEncoderEffort());
+	opts->setResamplerQuality(options->getResamplerQuality());
+	opts->setDownmixLevel(Options::DOWNMIX_CENTER, options->getDownmixLevel(Options::DOWNMIX_CENTER));
+	opts->setDownmixLevel(Options::DOWNMIX_SURROUND, options->getDownmixLevel(Options::DOWNMIX_SURROUND));
+	opts->setDownmixLevel(Options::DOWNMIX_LFE, options->getDownmixLevel(Options::DOWNMIX_LFE));
+	opts->setOutputBufferFrames(options->getOutputBufferFrames());
 
 	// transfer passwords
 	for (DeviceInfoSet::const_iterator it = opts->devices().begin();
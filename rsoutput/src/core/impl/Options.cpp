@@ -62,9 +62,16 @@ using Poco::SingletonHolder;
 
 static Options::SharedPtr theOptions;
 
+// indexed by Options::DownmixChannel
+static const char *const DOWNMIX_LEVEL_KEYS[] = {"DownmixCenterLevel", "DownmixSurroundLevel", "DownmixLFELevel"};
+
 Options::Options()
-	: _volumeControl(true), _playerControl(true), _resetOnPause(true)
+	: _volumeControl(true), _playerControl(true), _resetOnPause(true), _batchedSend(true), _maxSendFailures(0), _encoderEffort(ENCODER_EFFORT_DEFAULT), _resamplerQuality(RESAMPLER_QUALITY_MEDIUM), _outputBufferFrames(8192)
 {
+	// -3 dB center and surround, no LFE per ITU-R BS.775
+	_downmixLevels[DOWNMIX_CENTER] = 0.7071f;
+	_downmixLevels[DOWNMIX_SURROUND] = 0.7071f;
+	_downmixLevels[DOWNMIX_LFE] = 0.0f;
 }
 
 Options::SharedPtr Options::getOptions()
@@ -189,6 +196,66 @@ void Options::setResetOnPause(const bool state)
 	_resetOnPause = state;
 }
 
+bool Options::getBatchedSend() const
+{
+	return _batchedSend;
+}
+
+void Options::setBatchedSend(const bool state)
+{
+	_batchedSend = state;
+}
+
+unsigned int Options::getMaxSendFailures() const
+{
+	return _maxSendFailures;
+}
+
+void Options::setMaxSendFailures(const unsigned int count)
+{
+	_maxSendFailures = count;
+}
+
+Options::EncoderEffort Options::getEncoderEffort() const
+{
+	return _encoderEffort;
+}
+
+void Options::setEncoderEffort(const EncoderEffort effort)
+{
+	_encoderEffort = effort;
+}
+
+Options::ResamplerQuality Options::getResamplerQuality() const
+{
+	return _resamplerQuality;
+}
+
+void Options::setResamplerQuality(const ResamplerQuality quality)
+{
+	_resamplerQuality = quality;
+}
+
+float Options::getDownmixLevel(const DownmixChannel channel) const
+{
+	return _downmixLevels[channel];
+}
+
+void Options::setDownmixLevel(const DownmixChannel channel, const float level)
+{
+	_downmixLevels[channel] = level;
+}
+
+unsigned int Options::getOutputBufferFrames() const
+{
+	return _outputBufferFrames;
+}
+
+void Options::setOutputBufferFrames(const unsigned int frames)
+{
+	_outputBufferFrames = frames;
+}
+
 const DeviceInfoSet &Options::devices() const
 {
 	return _devices;
@@ -261,7 +328,7 @@ static bool compare(const DeviceInfoSet &lhs, const DeviceInfoSet &rhs)
 bool operator==(const Options &lhs, const Options &rhs)
 {
 	// Removed _activatedDevices comparison - activation check disabled
-	if (lhs.getVolumeControl() != rhs.getVolumeControl() || lhs.getPlayerControl() != rhs.getPlayerControl() || lhs.getResetOnPause() != rhs.getResetOnPause() || lhs._devicePasswords.size() != rhs._devicePasswords.size() || !std::equal(lhs._devicePasswords.begin(), lhs._devicePasswords.end(), rhs._devicePasswords.begin()))
+	if (lhs.getVolumeControl() != rhs.getVolumeControl() || lhs.getPlayerControl() != rhs.getPlayerControl() || lhs.getResetOnPause() != rhs.getResetOnPause() || lhs.getBatchedSend() != rhs.getBatchedSend() || lhs.getMaxSendFailures() != rhs.getMaxSendFailures() || lhs.getEncoderEffort() != rhs.getEncoderEffort() || lhs.getResamplerQuality() != rhs.getResamplerQuality() || lhs.getDownmixLevel(Options::DOWNMIX_CENTER) != rhs.getDownmixLevel(Options::DOWNMIX_CENTER) || lhs.getDownmixLevel(Options::DOWNMIX_SURROUND) != rhs.getDownmixLevel(Options::DOWNMIX_SURROUND) || lhs.getDownmixLevel(Options::DOWNMIX_LFE) != rhs.getDownmixLevel(Options::DOWNMIX_LFE) || lhs.getOutputBufferFrames() != rhs.getOutputBufferFrames() || lhs._devicePasswords.size() != rhs._devicePasswords.size() || !std::equal(lhs._devicePasswords.begin(), lhs._devicePasswords.end(), rhs._devicePasswords.begin()))
 	{
 		return false;
 	}
@@ -300,6 +367,63 @@ void OptionsUtils::loadOptions(const std::string &iniFilePath)
 	Debugger::printf(
 		"Read 'ResetOnPause' value '%i'.", (int)options->getResetOnPause());
 
+	// read batched send flag
+	options->setBatchedSend(0 != GetPrivateProfileIntA(
+									 Plugin::name().c_str(), "BatchedSend", 1, iniFilePath.c_str()));
+	Debugger::printf(
+		"Read 'BatchedSend' value '%i'.", (int)options->getBatchedSend());
+
+	// read consecutive send failures before a device is dropped
+	options->setMaxSendFailures((unsigned int)GetPrivateProfileIntA(
+		Plugin::name().c_str(), "MaxSendFailures", 0, iniFilePath.c_str()));
+	Debugger::printf(
+		"Read 'MaxSendFailures' value '%u'.", options->getMaxSendFailures());
+
+	// read encoder effort, ignoring values out of range
+	const int encoderEffort = GetPrivateProfileIntA(
+		Plugin::name().c_str(), "EncoderEffort", Options::ENCODER_EFFORT_DEFAULT, iniFilePath.c_str());
+	if (encoderEffort >= Options::ENCODER_EFFORT_UNCOMPRESSED && encoderEffort <= Options::ENCODER_EFFORT_ADAPTIVE)
+	{
+		options->setEncoderEffort(static_cast<Options::EncoderEffort>(encoderEffort));
+	}
+	Debugger::printf(
+		"Read 'EncoderEffort' value '%i'.", (int)options->getEncoderEffort());
+
+	// read resampler quality, ignoring values out of range
+	const int resamplerQuality = GetPrivateProfileIntA(
+		Plugin::name().c_str(), "ResamplerQuality", Options::RESAMPLER_QUALITY_MEDIUM, iniFilePath.c_str());
+	if (resamplerQuality >= Options::RESAMPLER_QUALITY_FAST && resamplerQuality <= Options::RESAMPLER_QUALITY_BEST)
+	{
+		options->setResamplerQuality(static_cast<Options::ResamplerQuality>(resamplerQuality));
+	}
+	Debugger::printf(
+		"Read 'ResamplerQuality' value '%i'.", (int)options->getResamplerQuality());
+
+	// read downmix levels as percentages, ignoring values out of range
+	for (int channel = Options::DOWNMIX_CENTER; channel <= Options::DOWNMIX_LFE; ++channel)
+	{
+		const Options::DownmixChannel downmixChannel = static_cast<Options::DownmixChannel>(channel);
+
+		const int percent = GetPrivateProfileIntA(Plugin::name().c_str(), DOWNMIX_LEVEL_KEYS[channel],
+			static_cast<int>(options->getDownmixLevel(downmixChannel) * 100.0f + 0.5f), iniFilePath.c_str());
+		if (percent >= 0 && percent <= 100)
+		{
+			options->setDownmixLevel(downmixChannel, percent / 100.0f);
+		}
+		Debugger::printf(
+			"Read '%s' value '%i'.", DOWNMIX_LEVEL_KEYS[channel], percent);
+	}
+
+	// read output buffer capacity in frames, ignoring values out of range
+	const unsigned int outputBufferFrames = (unsigned int)GetPrivateProfileIntA(
+		Plugin::name().c_str(), "OutputBufferFrames", options->getOutputBufferFrames(), iniFilePath.c_str());
+	if (outputBufferFrames >= 1024 && outputBufferFrames <= 1048576)
+	{
+		options->setOutputBufferFrames(outputBufferFrames);
+	}
+	Debugger::printf(
+		"Read 'OutputBufferFrames' value '%u'.", options->getOutputBufferFrames());
+
 	int parameterValueLength;
 	char parameterValue[128];
 
@@ -438,6 +562,54 @@ void OptionsUtils::saveOptions(const std::string &iniFilePath)
 	Debugger::printf(
 		"Wrote 'ResetOnPause' value '%i'.", (int)options->getResetOnPause());
 
+	// write batched send flag
+	WritePrivateProfileStringA(Plugin::name().c_str(), "BatchedSend",
+							   Poco::format("%b", options->getBatchedSend()).c_str(),
+							   iniFilePath.c_str());
+	Debugger::printf(
+		"Wrote 'BatchedSend' value '%i'.", (int)options->getBatchedSend());
+
+	// write consecutive send failures before a device is dropped
+	WritePrivateProfileStringA(Plugin::name().c_str(), "MaxSendFailures",
+							   Poco::format("%u", options->getMaxSendFailures()).c_str(),
+							   iniFilePath.c_str());
+	Debugger::printf(
+		"Wrote 'MaxSendFailures' value '%u'.", options->getMaxSendFailures());
+
+	// write encoder effort
+	WritePrivateProfileStringA(Plugin::name().c_str(), "EncoderEffort",
+							   Poco::format("%i", (int)options->getEncoderEffort()).c_str(),
+							   iniFilePath.c_str());
+	Debugger::printf(
+		"Wrote 'EncoderEffort' value '%i'.", (int)options->getEncoderEffort());
+
+	// write resampler quality
+	WritePrivateProfileStringA(Plugin::name().c_str(), "ResamplerQuality",
+							   Poco::format("%i", (int)options->getResamplerQuality()).c_str(),
+							   iniFilePath.c_str());
+	Debugger::printf(
+		"Wrote 'ResamplerQuality' value '%i'.", (int)options->getResamplerQuality());
+
+	// write downmix levels as percentages
+	for (int channel = Options::DOWNMIX_CENTER; channel <= Options::DOWNMIX_LFE; ++channel)
+	{
+		const int percent = static_cast<int>(
+			options->getDownmixLevel(static_cast<Options::DownmixChannel>(channel)) * 100.0f + 0.5f);
+
+		WritePrivateProfileStringA(Plugin::name().c_str(), DOWNMIX_LEVEL_KEYS[channel],
+								   Poco::format("%i", percent).c_str(),
+								   iniFilePath.c_str());
+		Debugger::printf(
+			"Wrote '%s' value '%i'.", DOWNMIX_LEVEL_KEYS[channel], percent);
+	}
+
+	// write output buffer capacity in frames
+	WritePrivateProfileStringA(Plugin::name().c_str(), "OutputBufferFrames",
+							   Poco::format("%u", options->getOutputBufferFrames()).c_str(),
+							   iniFilePath.c_str());
+	Debugger::printf(
+		"Wrote 'OutputBufferFrames' value '%u'.", options->getOutputBufferFrames());
+
 	int index = 0;
 	for (DeviceInfoSet::const_iterator it = options->devices().begin();
 		 it != options->devices().end(); ++it)
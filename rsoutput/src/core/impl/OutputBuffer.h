@@ -20,17 +20,32 @@
 
 #include "OutputSink.h"
 #include "Platform.h"
+#include "RingBuffer.h"
 #include "Uncopyable.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
 
 
-class OutputBuffer
+/**
+ * Evens out the unpredictability of write lengths for the next output sink. The
+ * sink type is a template parameter so that a chain built for a known device
+ * sink calls it directly; with OutputSink, calls go through the virtual
+ * interface.
+ */
+template <class Sink>
+class BasicOutputBuffer final
 :
 	public OutputSink,
 	private Uncopyable
 {
 public:
-	OutputBuffer(OutputSink::SharedPtr);
-	~OutputBuffer();
+	typedef Poco::SharedPtr<Sink> SinkPtr;
+
+	// capacity in bytes, rounded up by ring buffer
+	BasicOutputBuffer(SinkPtr, size_t capacity);
+	~BasicOutputBuffer();
 
 	time_t latency(const OutputFormat&) const;
 	size_t buffered() const;
@@ -44,13 +59,130 @@ private:
 	void checkOutputSink() const;
 	void writeToOutputSink(bool flushBuffer = false);
 
-	buffer_t _buffer, _temp;
-	size_t _bufferAvailability;
-	size_t _bufferReadIndex;
-	size_t _bufferWriteIndex;
+	RingBuffer _buffer;
 
-	OutputSink::SharedPtr _outputSink;
+	SinkPtr _outputSink;
 };
 
 
+// instantiated for these sinks in OutputBuffer.cpp
+extern template class BasicOutputBuffer<OutputSink>;
+extern template class BasicOutputBuffer<class RAOPEngine>;
+
+
+//------------------------------------------------------------------------------
+
+
+template <class Sink>
+BasicOutputBuffer<Sink>::BasicOutputBuffer(SinkPtr outputSink, const size_t capacity)
+	: _buffer(capacity),
+	  _outputSink(outputSink)
+{
+}
+
+template <class Sink>
+BasicOutputBuffer<Sink>::~BasicOutputBuffer()
+{
+}
+
+template <class Sink>
+time_t BasicOutputBuffer<Sink>::latency(const OutputFormat &format) const
+{
+	return _outputSink->latency(format);
+}
+
+template <class Sink>
+size_t BasicOutputBuffer<Sink>::buffered() const
+{
+	checkOutputSink();
+
+	return _buffer.readable() + _outputSink->buffered();
+}
+
+template <class Sink>
+size_t BasicOutputBuffer<Sink>::canWrite() const
+{
+	checkOutputSink();
+
+	return _buffer.writable();
+}
+
+template <class Sink>
+void BasicOutputBuffer<Sink>::write(const byte_t *const buffer, const size_t length)
+{
+	if (buffer == NULL || length == 0 || length > _buffer.writable())
+	{
+		throw std::invalid_argument(
+			"buffer == NULL || length == 0 || length > _buffer.writable()");
+	}
+
+	// write data to buffer
+	_buffer.write(buffer, length);
+
+	writeToOutputSink();
+}
+
+template <class Sink>
+void BasicOutputBuffer<Sink>::flush()
+{
+	writeToOutputSink(true);
+}
+
+template <class Sink>
+void BasicOutputBuffer<Sink>::reset()
+{
+	_buffer.clear();
+	_outputSink->reset();
+}
+
+//------------------------------------------------------------------------------
+
+template <class Sink>
+void BasicOutputBuffer<Sink>::checkOutputSink() const
+{
+	const size_t canRead = _buffer.readable();
+
+	if (canRead > 0 && canRead >= _outputSink->canWrite())
+	{
+		// resume writing to output sink if data is available and sink is as well
+		const_cast<BasicOutputBuffer *>(this)->writeToOutputSink();
+	}
+}
+
+template <class Sink>
+void BasicOutputBuffer<Sink>::writeToOutputSink(const bool flushBuffer)
+{
+	unsigned sleeps = 0;
+repeat:
+	const size_t canRead = _buffer.readable();
+	const size_t canWrite = _outputSink->canWrite();
+
+	if (canRead > 0 && ((canWrite > 0 && canRead >= canWrite) || flushBuffer))
+	{
+		if (canWrite == 0)
+		{
+			if (sleeps++ > 11)
+				return;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			goto repeat;
+		}
+		sleeps = 0;
+
+		const size_t doWrite = (std::min)(canRead, canWrite);
+
+		// data to be written is always contiguous
+		_outputSink->write(_buffer.read(), doWrite);
+		_buffer.consume(doWrite);
+
+		goto repeat;
+	}
+
+	if (flushBuffer)
+	{
+		// pass on a single flush to output sink when buffer is drained
+		_outputSink->flush();
+	}
+}
+
+
 #endif // OutputBuffer_h
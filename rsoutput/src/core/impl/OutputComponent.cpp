@@ -24,6 +24,7 @@
 #include "OutputSink.h"
 #include "Platform.h"
 #include "RemoteControl.h"
+#include "raop/RAOPEngine.h"
 #include <cassert>
 #include <exception>
 #include <stdexcept>
@@ -96,8 +97,10 @@ OutputComponent::~OutputComponent()
 void OutputComponent::open(const OutputFormat& format, const OutputMetadata& metadata)
 {
 	Debugger::printf(
-		"Starting playback; sample rate = %i Hz, sample size = %i bits, channel count = %i.",
-		(int) format.sampleRate(), (int) format.sampleSize() * 8, (int) format.channelCount());
+		"Starting playback; sample rate = %i Hz, sample size = %i bits (%s), channel count = %i.",
+		(int) format.sampleRate(), (int) format.sampleSize() * 8,
+		(format.sampleEncoding() == SampleEncoding::FLOAT ? "float" : "integer"),
+		(int) format.channelCount());
 
 	close(); // in case
 
@@ -353,17 +356,62 @@ void OutputComponentImpl::checkDeviceVolume()
 }
 
 
-void OutputComponentImpl::createOutputChain()
+// wraps a device output sink of known type, so that calls between stages of the
+// chain are direct rather than virtual
+template <class Sink>
+static OutputSink::SharedPtr composeOutputChain(const Poco::SharedPtr<Sink>& deviceOutputSink,
+	const OutputFormat& inFormat, const OutputFormat& outFormat, double& formatRatio)
 {
+	typedef BasicOutputBuffer<Sink> Buffer;
+	typedef BasicOutputReformatter<Buffer> Reformatter;
+
+	unsigned int bufferFrames;
+	Options::ResamplerQuality resamplerQuality;
+	ChannelMixer::Levels mixLevels;
+	// read options then release pointer immediately
+	{
+		const Options::SharedPtr options = Options::getOptions();
+		bufferFrames = options->getOutputBufferFrames();
+		resamplerQuality = options->getResamplerQuality();
+		mixLevels.center = options->getDownmixLevel(Options::DOWNMIX_CENTER);
+		mixLevels.surround = options->getDownmixLevel(Options::DOWNMIX_SURROUND);
+		mixLevels.lfe = options->getDownmixLevel(Options::DOWNMIX_LFE);
+	}
+
 	// wrap device output sink to even out the unpredictability of write lengths
-	_outputSink = new OutputBuffer(_deviceManager.outputSinkForDevices());
+	const Poco::SharedPtr<Buffer> outputBuffer = new Buffer(deviceOutputSink,
+		bufferFrames * outFormat.sampleSize() * outFormat.channelCount());
 
-	if (!(_outputFormat == _deviceManager.outputFormat()))
+	if (inFormat == outFormat)
 	{
-		_outputSink = new OutputReformatter(
-			_outputFormat, _deviceManager.outputFormat(), _outputSink);
+		return outputBuffer;
+	}
+
+	const Poco::SharedPtr<Reformatter> outputReformatter = new Reformatter(
+		inFormat, outFormat, outputBuffer,
+		static_cast<PolyphaseResampler::Quality>(resamplerQuality), mixLevels);
 
-		_formatRatio = _outputSink.cast<OutputReformatter>()->reformatRatio();
+	formatRatio = outputReformatter->reformatRatio();
+
+	return outputReformatter;
+}
+
+
+void OutputComponentImpl::createOutputChain()
+{
+	const OutputSink::SharedPtr deviceOutputSink = _deviceManager.outputSinkForDevices();
+	const Poco::SharedPtr<RAOPEngine> raopEngine = deviceOutputSink.cast<RAOPEngine>();
+
+	if (!raopEngine.isNull())
+	{
+		_outputSink = composeOutputChain(raopEngine,
+			_outputFormat, _deviceManager.outputFormat(), _formatRatio);
+	}
+	else
+	{
+		// fall back on virtual calls between stages for any other device sink
+		_outputSink = composeOutputChain(deviceOutputSink,
+			_outputFormat, _deviceManager.outputFormat(), _formatRatio);
 	}
 }
 
@@ -50,7 +50,7 @@ ChannelCount::ChannelCount(const int value)
 :
 	_value(value)
 {
-	assert(value >= 1 && value <= 2);
+	assert(value >= 1 && value <= 8);
 }
 
 
@@ -60,13 +60,29 @@ ChannelCount::operator int() const
 }
 
 
+SampleEncoding::SampleEncoding(const Type value)
+:
+	_value(value)
+{
+	assert(value == INTEGER || value == FLOAT);
+}
+
+
+SampleEncoding::operator SampleEncoding::Type() const
+{
+	return _value;
+}
+
+
 OutputFormat::OutputFormat(const SampleRate sr, const SampleSize ss,
-	const ChannelCount cc)
+	const ChannelCount cc, const SampleEncoding se)
 :
 	_sampleRate(sr),
 	_sampleSize(ss),
-	_channelCount(cc)
+	_channelCount(cc),
+	_sampleEncoding(se)
 {
+	assert(se != SampleEncoding::FLOAT || ss == 4);
 }
 
 
@@ -88,9 +104,16 @@ const ChannelCount& OutputFormat::channelCount() const
 }
 
 
+const SampleEncoding& OutputFormat::sampleEncoding() const
+{
+	return _sampleEncoding;
+}
+
+
 bool OutputFormat::operator ==(const OutputFormat& rhs) const
 {
 	return _sampleRate == rhs._sampleRate
 		&& _sampleSize == rhs._sampleSize
-		&& _channelCount == rhs._channelCount;
+		&& _channelCount == rhs._channelCount
+		&& _sampleEncoding == rhs._sampleEncoding;
 }
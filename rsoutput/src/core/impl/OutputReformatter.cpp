@@ -16,63 +16,20 @@
 
 #include "OutputReformatter.h"
 #include "Platform.h"
+#include "SampleConversion.h"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstring>
 #include <stdexcept>
 
 
-static void ccc_mono_to_stereo(const byte_t* const in, byte_t* const out,
-	const int sampleCount, const SampleSize& sampleSize)
-{
-	// work from back to front to support in-place conversion
-	for (int s = sampleCount - 1; s >= 0; --s)
-	{
-		// duplicate channel data byte by byte
-		for (int b = sampleSize - 1; b >= 0; --b)
-		{
-			out[(s * sampleSize * 2) + b] = in[(s * sampleSize) + b];
-			out[(s * sampleSize * 2) + sampleSize + b] = in[(s * sampleSize) + b];
-		}
-	}
-}
-
-
-static void src_any_to_float_array(const byte_t* const in, float* const out,
-	const int sampleCount, const SampleSize& sampleSize)
-{
-	const int signBit = 1 << ((sampleSize * 8) - 1);
-	const float scale = 1.0F * signBit;
-
-	for (int s = 0; s < sampleCount; ++s)
-	{
-		// load sample byte by byte
-		int sample = 0;
-		for (int b = sampleSize - 1; b >= 0; --b)
-		{
-			sample = (sample << 8) | in[(s * sampleSize) + b];
-		}
-
-		// extend sign bit if sample is negative
-		if (sampleSize < sizeof(int) && sample & signBit)
-		{
-			for (int b = sampleSize; b < sizeof(int); ++b)
-			{
-				sample |= 0xFF << (b * 8);
-			}
-		}
-
-		// scale sample into range [-1.0,1.0]
-		out[s] = sample / scale;
-	}
-}
-
+const size_t SampleReformatter::BLOCK_FRAMES;
 
-//------------------------------------------------------------------------------
 
-
-OutputReformatter::OutputReformatter(const OutputFormat& inFormat,
-	const OutputFormat& outFormat, OutputSink::SharedPtr outputSink)
+SampleReformatter::SampleReformatter(const OutputFormat& inFormat,
+	const OutputFormat& outFormat, const PolyphaseResampler::Quality resamplerQuality,
+	const ChannelMixer::Levels& mixLevels)
 :
 	_inFormat(inFormat),
 	_outFormat(outFormat),
@@ -85,26 +42,69 @@ OutputReformatter::OutputReformatter(const OutputFormat& inFormat,
 			/
 		static_cast<double>(_inFormat.sampleRate())),
 	_inputFrameSize(_inFormat.sampleSize() * _inFormat.channelCount()),
-	_intermediateFrameSize(_outFormat.sampleSize() * _inFormat.channelCount()),
 	_outputFrameSize(_outFormat.sampleSize() * _outFormat.channelCount()),
-	_outputSink(outputSink),
-	_srcState(NULL)
+	_mixChannelCount(
+		(_inFormat.channelCount() == 1 && _outFormat.channelCount() == 2)
+			? _inFormat.channelCount() : _outFormat.channelCount()),
+	_convertSamples(
+		_inFormat.sampleRate() != _outFormat.sampleRate()
+		|| _inFormat.sampleSize() != _outFormat.sampleSize()
+		|| _inFormat.sampleEncoding() != _outFormat.sampleEncoding()
+		|| _mixChannelCount != _inFormat.channelCount()),
+	_toFloat(SampleConversion::toFloat(SampleConversion::encoding(_inFormat))),
+	_fromFloat(SampleConversion::fromFloat(SampleConversion::encoding(_outFormat))),
+	_monoToStereo(SampleConversion::monoToStereo(_outFormat.sampleSize())),
+	_mixer(NULL),
+	_resampler(NULL),
+	_srcState(NULL),
+	_drained(true)
 {
-	if (_inFormat.sampleRate() != _outFormat.sampleRate())
+	if (_mixChannelCount != _inFormat.channelCount())
+	{
+		_mixer = new ChannelMixer(_inFormat.channelCount(), _outFormat.channelCount(), mixLevels);
+	}
+
+	if (PolyphaseResampler::supports(_inFormat.sampleRate(), _outFormat.sampleRate()))
+	{
+		_resampler = new PolyphaseResampler(_inFormat.sampleRate(),
+			_outFormat.sampleRate(), ChannelCount(_mixChannelCount), resamplerQuality);
+	}
+	else if (_inFormat.sampleRate() != _outFormat.sampleRate())
 	{
 		// initialize sample rate converter
 		int error = 0;
-		_srcState = src_new(SRC_SINC_MEDIUM_QUALITY, _inFormat.channelCount(), &error);
+		_srcState = src_new(SRC_SINC_MEDIUM_QUALITY, _mixChannelCount, &error);
 		if (_srcState == NULL)
 		{
 			throw std::runtime_error(src_strerror(error));
 		}
 	}
+
+	// allocate scratch space for one block up front, so writes do not allocate
+	size_t outputFrames = BLOCK_FRAMES;
+	if (_resampler != NULL)
+	{
+		outputFrames = _resampler->maxOutputFrames(BLOCK_FRAMES);
+	}
+	else if (_srcState != NULL)
+	{
+		outputFrames = static_cast<size_t>(
+			std::ceil(static_cast<double>(BLOCK_FRAMES) * _resampleRatio)) + 1;
+	}
+
+	_inputBuffer.resize(BLOCK_FRAMES * _inFormat.channelCount());
+	if (_mixer != NULL)
+		_mixBuffer.resize(BLOCK_FRAMES * _mixChannelCount);
+	_intermediateBuffer.resize(outputFrames * _mixChannelCount);
+	_outputBuffer.resize(outputFrames * _outputFrameSize);
 }
 
 
-OutputReformatter::~OutputReformatter()
+SampleReformatter::~SampleReformatter()
 {
+	delete _mixer;
+	delete _resampler;
+
 	if (_srcState != NULL)
 	{
 		src_delete(_srcState);
@@ -112,112 +112,90 @@ OutputReformatter::~OutputReformatter()
 }
 
 
-time_t OutputReformatter::latency(const OutputFormat& format) const
+size_t SampleReformatter::reformat(const byte_t* const input,
+	const size_t inputFrameCount, const byte_t*& output)
 {
-	if (!(format == _inFormat))
+	if (inputFrameCount > 0)
 	{
-		throw std::logic_error("format != _inFormat");
+		_drained = false;
 	}
 
-	const time_t latency = static_cast<time_t>(
-		static_cast<double>(_outputSink->latency(_outFormat)) * _resampleRatio);
-	// TODO: Add in some latency for reformatter?
-
-	return latency;
+	return reformatBlock(input, inputFrameCount, false, output);
 }
 
 
-size_t OutputReformatter::buffered() const
+size_t SampleReformatter::drain(const byte_t*& output)
 {
-	const size_t buffered = static_cast<size_t>(
-		static_cast<double>(_outputSink->buffered()) * _reformatRatio);
-
-	return buffered;
-}
-
+	if (_drained)
+	{
+		return 0;
+	}
 
-size_t OutputReformatter::canWrite() const
-{
-	size_t canWrite = static_cast<size_t>(
-		static_cast<double>(_outputSink->canWrite()) / _reformatRatio);
-	// adjust value to an integral number of samples per channel
-	canWrite -= (canWrite % _inputFrameSize);
-	assert(canWrite % _inputFrameSize == 0);
+	// flush resampler with an empty block; the polyphase resampler flushes all
+	// at once and starts over, while libsamplerate may take several calls
+	const size_t outputFrameCount = reformatBlock(NULL, 0, true, output);
+	if (_resampler != NULL || outputFrameCount == 0)
+	{
+		_drained = true;
+	}
 
-	return canWrite;
+	return outputFrameCount;
 }
 
 
-void OutputReformatter::write(const byte_t* const buffer, const size_t length)
+size_t SampleReformatter::reformatBlock(const byte_t* const buffer,
+	const size_t inputFrameCount, const bool endOfInput, const byte_t*& output)
 {
-	if (length > canWrite() || length % _inFormat.sampleSize() != 0)
-	{
-		throw std::invalid_argument(
-			"length > canWrite() || length % _inFormat.sampleSize() != 0");
-	}
-
-	// calculate maximum possible number of reformatted output bytes
-	size_t maxOutputLength = static_cast<size_t>(
-		std::ceil(static_cast<double>(length) * _reformatRatio));
-	// adjust value to an integral number of samples per channel
-	size_t remainder = maxOutputLength % _outputFrameSize;
-	if (remainder > 0)
-		maxOutputLength += (_outputFrameSize - remainder);
-	assert(maxOutputLength % _outputFrameSize == 0);
-
-	// resize buffer if necessary to accommodate reformatted output
-	if (_outputBuffer.size() < maxOutputLength)
-		_outputBuffer.resize(maxOutputLength);
+	assert(inputFrameCount <= BLOCK_FRAMES);
 
-	const unsigned int inputSampleCount = (length / _inFormat.sampleSize());
-	unsigned int outputSampleCount = inputSampleCount;
+	const byte_t* sampleBuffer = buffer;
+	size_t outputFrameCount = inputFrameCount;
 
-	if (_inFormat.sampleRate() != _outFormat.sampleRate()
-		|| _inFormat.sampleSize() != _outFormat.sampleSize())
+	if (_convertSamples)
 	{
-		// resize buffer if necessary to accommodate input samples
-		if (_inputBuffer.size() < inputSampleCount)
-			_inputBuffer.resize(inputSampleCount);
-
 		// convert samples to floating-point format
-		src_any_to_float_array(
-			buffer, &_inputBuffer[0], inputSampleCount, _inFormat.sampleSize());
+		_toFloat(buffer, &_inputBuffer[0], inputFrameCount * _inFormat.channelCount());
+
+		const float* floatBuffer = &_inputBuffer[0];
 
-		const float* sampleBuffer;
+		if (_mixer != NULL)
+		{
+			// mix down (or up) to output channels before resampling, which then
+			// has fewer channels to filter; kept apart from conversion, since the
+			// converted block is still in L1 cache and mixing while converting
+			// would give up the vectorized conversion, which measured slower
+			_mixer->mix(floatBuffer, &_mixBuffer[0], inputFrameCount);
+
+			floatBuffer = &_mixBuffer[0];
+		}
 
-		if (_inFormat.sampleRate() != _outFormat.sampleRate())
+		if (_resampler != NULL)
 		{
-			// calculate maximum possible number of generated samples
-			outputSampleCount = static_cast<unsigned int>(
-				std::ceil(static_cast<double>(outputSampleCount) * _resampleRatio));
-			// adjust value to an integral number of samples per channel
-			remainder = outputSampleCount % _intermediateFrameSize;
-			if (remainder > 0)
-				outputSampleCount += (_intermediateFrameSize - remainder);
-			assert(outputSampleCount % _intermediateFrameSize == 0);
-
-			// resize buffer if necessary to accommodate output samples
-			if (_intermediateBuffer.size() < outputSampleCount)
-				_intermediateBuffer.resize(outputSampleCount);
+			// resample input data at output sample rate; end of input flushes
+			// the samples held back by the filter
+			outputFrameCount = _resampler->process(floatBuffer, inputFrameCount,
+				&_intermediateBuffer[0], endOfInput);
 
+			floatBuffer = &_intermediateBuffer[0];
+		}
+		else if (_srcState != NULL)
+		{
 			// prepare for sample rate conversion
 			SRC_DATA srcData;
 			std::memset(&srcData, 0, sizeof(SRC_DATA));
-			srcData.data_in = &_inputBuffer[0];
+			srcData.data_in = floatBuffer;
 			srcData.data_out = &_intermediateBuffer[0];
-			srcData.input_frames = inputSampleCount / _inFormat.channelCount();
-			srcData.output_frames = outputSampleCount / _inFormat.channelCount();
+			srcData.input_frames = inputFrameCount;
+			srcData.output_frames = _intermediateBuffer.size() / _mixChannelCount;
 			srcData.src_ratio = _resampleRatio;
 
-			if (length == 0)
+			if (endOfInput)
 			{
 				// indicate there is no more input so sample rate converter will
 				// not maintain any carryover state after next call
 				srcData.end_of_input = 1;
 			}
 
-			assert(_srcState != NULL);
-
 			// resample input data at output sample rate
 			const int returnCode = src_process(_srcState, &srcData);
 			if (returnCode != 0)
@@ -227,87 +205,55 @@ void OutputReformatter::write(const byte_t* const buffer, const size_t length)
 
 			assert(srcData.input_frames_used == srcData.input_frames);
 
-			outputSampleCount = srcData.output_frames_gen * _inFormat.channelCount();
-
-			// check for buffer overflow
-			assert(_intermediateBuffer.size() >= outputSampleCount);
+			outputFrameCount = srcData.output_frames_gen;
 
-			sampleBuffer = &_intermediateBuffer[0];
-		}
-		else
-		{
-			sampleBuffer = &_inputBuffer[0];
+			floatBuffer = &_intermediateBuffer[0];
 		}
 
 		// check for buffer overflow
-		assert(_outputBuffer.size() >= outputSampleCount * _outFormat.sampleSize());
+		assert(_outputBuffer.size() >=
+			outputFrameCount * _mixChannelCount * _outFormat.sampleSize());
 
-		// use of src_float_to_short_array() assumes out sample size of 2
-		assert(_outFormat.sampleSize() == 2);
+		// convert samples to output format
+		_fromFloat(floatBuffer, &_outputBuffer[0], outputFrameCount * _mixChannelCount);
 
-		// convert samples to integer format
-		src_float_to_short_array(
-			sampleBuffer, reinterpret_cast<short*>(&_outputBuffer[0]), outputSampleCount);
+		sampleBuffer = &_outputBuffer[0];
 	}
 
-	// write may have been called with no input to flush sample rate converter;
+	// block may have been written with no input to flush sample rate converter;
 	// check if nothing remains to be written
-	if (outputSampleCount < 1)
+	if (outputFrameCount < 1)
 	{
-		return;
+		return 0;
 	}
 
-	if (_inFormat.channelCount() != _outFormat.channelCount())
+	if (_mixChannelCount != _outFormat.channelCount())
 	{
-		const byte_t* sampleBuffer;
-
-		if (_inFormat.sampleRate() != _outFormat.sampleRate()
-			|| _inFormat.sampleSize() != _outFormat.sampleSize())
-		{
-			// if sample rate and/or size conversion was done, output buffer
-			// contains the sample data
-			sampleBuffer = &_outputBuffer[0];
-		}
-		else
-		{
-			// otherwise use input buffer sample data
-			sampleBuffer = buffer;
-		}
-
 		// check for buffer overflow
-		assert(_outputBuffer.size() >=
-			outputSampleCount * _outFormat.sampleSize() * _outFormat.channelCount());
+		assert(_outputBuffer.size() >= outputFrameCount * _outputFrameSize);
 
-		// use of ccc_mono_to_stereo() assumes in channel count of 1 and out channel count of 2
-		assert(_inFormat.channelCount() == 1 && _outFormat.channelCount() == 2);
+		// use of _monoToStereo assumes mix channel count of 1 and out channel count of 2
+		assert(_mixChannelCount == 1 && _outFormat.channelCount() == 2);
 
-		ccc_mono_to_stereo(
-			sampleBuffer, &_outputBuffer[0], outputSampleCount, _outFormat.sampleSize());
+		// converts in place if sample conversion was done
+		_monoToStereo(sampleBuffer, &_outputBuffer[0], outputFrameCount);
 
-		assert(outputSampleCount % _inFormat.channelCount() == 0);
-		outputSampleCount /= _inFormat.channelCount();
-		outputSampleCount *= _outFormat.channelCount();
+		sampleBuffer = &_outputBuffer[0];
 	}
 
-	_outputSink->write(&_outputBuffer[0], outputSampleCount * _outFormat.sampleSize());
+	output = sampleBuffer;
+
+	return outputFrameCount;
 }
 
 
-void OutputReformatter::flush()
+void SampleReformatter::reset()
 {
-	if (_srcState != NULL)
+	if (_resampler != NULL)
 	{
-		// flush sample rate converter with an empty write
-		write(NULL, 0);
+		_resampler->reset();
 	}
-
-	_outputSink->flush();
-}
-
-
-void OutputReformatter::reset()
-{
-	if (_srcState != NULL)
+	else if (_srcState != NULL)
 	{
 		// reset state of sample rate converter
 		int returnCode = src_reset(_srcState);
@@ -317,5 +263,5 @@ void OutputReformatter::reset()
 		}
 	}
 
-	_outputSink->reset();
+	_drained = true;
 }
@@ -18,36 +18,55 @@
 #define OutputReformatter_h
 
 
+#include "ChannelMixer.h"
 #include "OutputFormat.h"
 #include "OutputSink.h"
+#include "PolyphaseResampler.h"
 #include "Platform.h"
+#include "SampleConversion.h"
 #include "Uncopyable.h"
+#include <algorithm>
+#include <stdexcept>
 #include <vector>
 #include <samplerate.h>
 
 
-class OutputReformatter
-:
-	public OutputSink,
-	private Uncopyable
+/**
+ * Converts blocks of samples from one output format to another.
+ */
+class SampleReformatter : private Uncopyable
 {
 public:
-	OutputReformatter(const OutputFormat& incoming, const OutputFormat& outgoing,
-		OutputSink::SharedPtr);
-	~OutputReformatter();
+	// input frames converted at a time; a block of 8-channel float samples
+	// fills a 32 KB L1 data cache
+	static const size_t BLOCK_FRAMES = 1024;
+
+	SampleReformatter(const OutputFormat& incoming, const OutputFormat& outgoing,
+		PolyphaseResampler::Quality = PolyphaseResampler::MEDIUM,
+		const ChannelMixer::Levels& = ChannelMixer::Levels());
+	~SampleReformatter();
+
+	const OutputFormat& inputFormat() const;
+	const OutputFormat& outputFormat() const;
 
 	double reformatRatio() const;
 	double resampleRatio() const;
 
-	time_t latency(const OutputFormat&) const;
-	size_t buffered() const;
-	size_t canWrite() const;
+	size_t inputFrameSize() const;
+	size_t outputFrameSize() const;
 
-	void write(const byte_t*, size_t);
-	void flush();
+	// converts up to BLOCK_FRAMES frames; returns number of frames at output,
+	// which stays valid until the next call
+	size_t reformat(const byte_t* input, size_t frameCount, const byte_t*& output);
+	// returns frames held back by the sample rate converter, over as many calls
+	// as it takes; returns zero once drained
+	size_t drain(const byte_t*& output);
 	void reset();
 
 private:
+	size_t reformatBlock(const byte_t*, size_t frameCount, bool endOfInput,
+		const byte_t*& output);
+
 	const OutputFormat _inFormat;
 	const OutputFormat _outFormat;
 
@@ -55,29 +74,215 @@ private:
 	const double _resampleRatio;
 
 	const size_t _inputFrameSize;
-	const size_t _intermediateFrameSize;
 	const size_t _outputFrameSize;
 
+	// channels carried through resampling; downmixing is done before it and
+	// duplicating mono into stereo after it
+	const int _mixChannelCount;
+	// whether samples pass through floating-point format
+	const bool _convertSamples;
+
+	// scratch space for one block, sized at construction
 	std::vector<float> _inputBuffer;
+	std::vector<float> _mixBuffer;
 	std::vector<float> _intermediateBuffer;
 	std::vector<byte_t> _outputBuffer;
 
-	OutputSink::SharedPtr _outputSink;
+	// chosen once for the CPU and the formats
+	const SampleConversion::ToFloat _toFloat;
+	const SampleConversion::FromFloat _fromFloat;
+	const SampleConversion::MonoToStereo _monoToStereo;
 
-	SRC_STATE* _srcState;
+	ChannelMixer* _mixer; // for channel changes other than mono to stereo
+	PolyphaseResampler* _resampler; // for common fixed ratios
+	SRC_STATE* _srcState; // for everything else
+	bool _drained; // whether resampler holds back no input since last drain
 };
 
 
-inline double OutputReformatter::reformatRatio() const
+/**
+ * Output sink that reformats samples for the next output sink. As with
+ * BasicOutputBuffer, the sink type is a template parameter so that a chain
+ * built for a known device sink calls it directly.
+ */
+template <class Sink>
+class BasicOutputReformatter final
+:
+	public OutputSink,
+	private Uncopyable
+{
+public:
+	typedef Poco::SharedPtr<Sink> SinkPtr;
+
+	BasicOutputReformatter(const OutputFormat& incoming, const OutputFormat& outgoing,
+		SinkPtr, PolyphaseResampler::Quality = PolyphaseResampler::MEDIUM,
+		const ChannelMixer::Levels& = ChannelMixer::Levels());
+
+	double reformatRatio() const;
+
+	time_t latency(const OutputFormat&) const;
+	size_t buffered() const;
+	size_t canWrite() const;
+
+	void write(const byte_t*, size_t);
+	void flush();
+	void reset();
+
+private:
+	SampleReformatter _reformatter;
+	SinkPtr _outputSink;
+};
+
+
+//------------------------------------------------------------------------------
+
+
+inline const OutputFormat& SampleReformatter::inputFormat() const
+{
+	return _inFormat;
+}
+
+
+inline const OutputFormat& SampleReformatter::outputFormat() const
+{
+	return _outFormat;
+}
+
+
+inline double SampleReformatter::reformatRatio() const
 {
 	return _reformatRatio;
 }
 
 
-inline double OutputReformatter::resampleRatio() const
+inline double SampleReformatter::resampleRatio() const
 {
 	return _resampleRatio;
 }
 
 
+inline size_t SampleReformatter::inputFrameSize() const
+{
+	return _inputFrameSize;
+}
+
+
+inline size_t SampleReformatter::outputFrameSize() const
+{
+	return _outputFrameSize;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+template <class Sink>
+BasicOutputReformatter<Sink>::BasicOutputReformatter(const OutputFormat& incoming,
+	const OutputFormat& outgoing, SinkPtr outputSink,
+	const PolyphaseResampler::Quality resamplerQuality,
+	const ChannelMixer::Levels& mixLevels)
+:
+	_reformatter(incoming, outgoing, resamplerQuality, mixLevels),
+	_outputSink(outputSink)
+{
+}
+
+
+template <class Sink>
+inline double BasicOutputReformatter<Sink>::reformatRatio() const
+{
+	return _reformatter.reformatRatio();
+}
+
+
+template <class Sink>
+time_t BasicOutputReformatter<Sink>::latency(const OutputFormat& format) const
+{
+	if (!(format == _reformatter.inputFormat()))
+	{
+		throw std::logic_error("format != _inFormat");
+	}
+
+	const time_t latency = static_cast<time_t>(
+		static_cast<double>(_outputSink->latency(_reformatter.outputFormat()))
+			* _reformatter.resampleRatio());
+	// TODO: Add in some latency for reformatter?
+
+	return latency;
+}
+
+
+template <class Sink>
+inline size_t BasicOutputReformatter<Sink>::buffered() const
+{
+	const size_t buffered = static_cast<size_t>(
+		static_cast<double>(_outputSink->buffered()) * _reformatter.reformatRatio());
+
+	return buffered;
+}
+
+
+template <class Sink>
+inline size_t BasicOutputReformatter<Sink>::canWrite() const
+{
+	size_t canWrite = static_cast<size_t>(
+		static_cast<double>(_outputSink->canWrite()) / _reformatter.reformatRatio());
+	// adjust value to an integral number of samples per channel
+	canWrite -= (canWrite % _reformatter.inputFrameSize());
+
+	return canWrite;
+}
+
+
+template <class Sink>
+void BasicOutputReformatter<Sink>::write(const byte_t* const buffer, const size_t length)
+{
+	const size_t inputFrameSize = _reformatter.inputFrameSize();
+
+	if (length > canWrite() || length % inputFrameSize != 0)
+	{
+		throw std::invalid_argument(
+			"length > canWrite() || length % _inputFrameSize != 0");
+	}
+
+	const size_t inputFrameCount = (length / inputFrameSize);
+
+	// run every stage over one block before moving on to the next, so that the
+	// intermediate samples stay in cache
+	for (size_t f = 0; f < inputFrameCount; f += SampleReformatter::BLOCK_FRAMES)
+	{
+		const byte_t* output;
+		const size_t outputFrameCount = _reformatter.reformat(buffer + (f * inputFrameSize),
+			(std::min)(SampleReformatter::BLOCK_FRAMES, inputFrameCount - f), output);
+
+		if (outputFrameCount > 0)
+		{
+			_outputSink->write(output, outputFrameCount * _reformatter.outputFrameSize());
+		}
+	}
+}
+
+
+template <class Sink>
+void BasicOutputReformatter<Sink>::flush()
+{
+	const byte_t* output;
+	size_t outputFrameCount;
+	while ((outputFrameCount = _reformatter.drain(output)) > 0)
+	{
+		_outputSink->write(output, outputFrameCount * _reformatter.outputFrameSize());
+	}
+
+	_outputSink->flush();
+}
+
+
+template <class Sink>
+void BasicOutputReformatter<Sink>::reset()
+{
+	_reformatter.reset();
+	_outputSink->reset();
+}
+
+
 #endif // OutputReformatter_h
@@ -0,0 +1,234 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "PolyphaseResampler.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+
+// limits coefficient tables to 320 phases (up to 600 KB at best quality)
+static const unsigned int MAX_PHASES = 320;
+// limits input consumed per output frame to well under a filter's length
+static const unsigned int MAX_DECIMATION = 4;
+
+static const double PI = 3.14159265358979323846;
+
+
+struct FilterDesign
+{
+	size_t taps;  // per phase when not decimating
+	double beta;  // Kaiser window shape; trades stopband depth for transition width
+};
+
+static const FilterDesign DESIGNS[] =
+{
+	{  48,  7.0 }, // FAST
+	{  64,  8.5 }, // MEDIUM
+	{ 128, 10.5 }  // BEST
+};
+
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b != 0)
+	{
+		const unsigned int r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+
+// zeroth order modified Bessel function of the first kind
+static double bessel_i0(const double x)
+{
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 50 && term > sum * 1e-12; ++k)
+	{
+		const double h = x / (2.0 * k);
+		term *= h * h;
+		sum += term;
+	}
+	return sum;
+}
+
+
+// stretches the filter when decimating so its transition band stays as narrow
+// relative to the output rate; rounded for the vectorized dot product
+static size_t design_taps(const unsigned int up, const unsigned int down,
+	const FilterDesign& design)
+{
+	const size_t taps = (design.taps * std::max(up, down) + up - 1) / up;
+	return (taps + 7) & ~static_cast<size_t>(7);
+}
+
+
+// Kaiser-windowed sinc lowpass at the rate up * inRate, split into up phases
+// whose coefficients are ordered to line up with the oldest sample first; the
+// cutoff is at the lower Nyquist rate so that the only aliasing folds into the
+// transition band above the passband
+//
+// designed when a stream is opened (1-4 ms) rather than generated at compile
+// time: tables for just 48000 and 96000 Hz to 44100 Hz at each quality would
+// add over 450 KB, and any other supported ratio would still be designed here
+static void design_filter(std::vector<float>& coefs, const unsigned int up,
+	const unsigned int down, const size_t taps, const double beta)
+{
+	const size_t length = taps * up;
+	const double center = (length - 1) / 2.0;
+	const double cutoff = 0.5 / std::max(up, down); // cycles per sample
+
+	std::vector<double> prototype(length);
+	double sum = 0.0;
+	for (size_t m = 0; m < length; ++m)
+	{
+		const double t = m - center;
+		const double x = 2.0 * cutoff * t;
+		const double sinc = (x == 0.0) ? 1.0 : std::sin(PI * x) / (PI * x);
+		const double r = t / center;
+		const double window = bessel_i0(beta * std::sqrt(std::max(0.0, 1.0 - r * r)))
+			/ bessel_i0(beta);
+
+		prototype[m] = sinc * window;
+		sum += prototype[m];
+	}
+
+	// unity gain at DC once zero-stuffed to the higher rate
+	const double gain = up / sum;
+
+	coefs.resize(length);
+	for (unsigned int p = 0; p < up; ++p)
+	{
+		for (size_t j = 0; j < taps; ++j)
+		{
+			coefs[(p * taps) + j] = static_cast<float>(
+				prototype[p + ((taps - 1 - j) * up)] * gain);
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------------
+
+
+bool PolyphaseResampler::supports(const SampleRate& inRate, const SampleRate& outRate)
+{
+	if (inRate <= 0 || outRate <= 0 || inRate == outRate)
+	{
+		return false;
+	}
+
+	const unsigned int in = static_cast<unsigned int>(inRate);
+	const unsigned int out = static_cast<unsigned int>(outRate);
+	return (out / gcd(in, out) <= MAX_PHASES && in <= out * MAX_DECIMATION);
+}
+
+
+PolyphaseResampler::PolyphaseResampler(const SampleRate& inRate,
+	const SampleRate& outRate, const ChannelCount& channelCount, const Quality quality)
+:
+	_up(outRate / gcd(inRate, outRate)),
+	_down(inRate / gcd(inRate, outRate)),
+	_taps(design_taps(_up, _down, DESIGNS[quality])),
+	_channelCount(channelCount),
+	_dotProduct(SampleConversion::dotProduct()),
+	_history(channelCount),
+	_phase(0)
+{
+	if (!supports(inRate, outRate))
+	{
+		throw std::invalid_argument("ratio not supported");
+	}
+
+	design_filter(_coefs, _up, _down, _taps, DESIGNS[quality].beta);
+
+	reset();
+}
+
+
+size_t PolyphaseResampler::maxOutputFrames(const size_t inputFrames) const
+{
+	// frames held back plus those flushed at end of input can each yield at
+	// most one more output frame per input frame consumed
+	const size_t available = inputFrames + _history[0].size() + (_taps / 2);
+	return (available * _up) / _down + 1;
+}
+
+
+size_t PolyphaseResampler::process(const float* const input,
+	const size_t inputFrames, float* const output, const bool endOfInput)
+{
+	size_t outputFrames = 0;
+	unsigned int phase = _phase;
+
+	for (int c = 0; c < _channelCount; ++c)
+	{
+		std::vector<float>& history = _history[c];
+
+		// append this channel's input, plus silence at end of input to center
+		// the filter on the last input sample
+		const size_t held = history.size();
+		history.resize(held + inputFrames + (endOfInput ? _taps / 2 : 0), 0.0F);
+		for (size_t f = 0; f < inputFrames; ++f)
+		{
+			history[held + f] = input[(f * _channelCount) + c];
+		}
+
+		// every channel starts from the same state and advances in lock step
+		size_t start = 0, n = 0;
+		phase = _phase;
+		while (start + _taps <= history.size())
+		{
+			output[(n * _channelCount) + c] =
+				_dotProduct(&_coefs[phase * _taps], &history[start], _taps);
+			++n;
+
+			phase += _down;
+			start += phase / _up;
+			phase %= _up;
+		}
+
+		// keep the samples still needed by the next output frame
+		assert(start <= history.size());
+		history.erase(history.begin(), history.begin() + start);
+
+		assert(c == 0 || n == outputFrames);
+		outputFrames = n;
+	}
+
+	_phase = phase;
+
+	if (endOfInput)
+	{
+		reset();
+	}
+
+	return outputFrames;
+}
+
+
+void PolyphaseResampler::reset()
+{
+	for (int c = 0; c < _channelCount; ++c)
+	{
+		// prime with silence so the first input sample meets the newest tap
+		_history[c].assign(_taps - 1, 0.0F);
+	}
+	_phase = 0;
+}
@@ -0,0 +1,79 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PolyphaseResampler_h
+#define PolyphaseResampler_h
+
+
+#include "OutputFormat.h"
+#include "SampleConversion.h"
+#include "Uncopyable.h"
+#include <vector>
+
+
+/**
+ * Converts interleaved floating-point samples between two sample rates whose
+ * ratio reduces to up/down with a small number of filter phases, such as
+ * 48000->44100 (147/160) and 96000->44100 (147/320). Each output sample is a
+ * single dot product of one phase of a windowed-sinc lowpass filter with the
+ * most recent input samples of its channel.
+ */
+class PolyphaseResampler : private Uncopyable
+{
+public:
+	enum Quality
+	{
+		FAST   = 0, //  48 taps per phase (more when decimating), ~70 dB stopband
+		MEDIUM = 1, //  64 taps per phase, ~85 dB stopband
+		BEST   = 2  // 128 taps per phase, ~105 dB stopband
+	};
+
+	static bool supports(const SampleRate& inRate, const SampleRate& outRate);
+
+	PolyphaseResampler(const SampleRate& inRate, const SampleRate& outRate,
+		const ChannelCount&, Quality = MEDIUM);
+
+	size_t taps() const;
+	// upper bound on frames generated by a call to process
+	size_t maxOutputFrames(size_t inputFrames) const;
+
+	// returns number of frames written to output; at end of input, flushes
+	// samples held back by the filter and starts over
+	size_t process(const float* input, size_t inputFrames, float* output,
+		bool endOfInput = false);
+	void reset();
+
+private:
+	const unsigned int _up;
+	const unsigned int _down;
+	const size_t _taps;
+	const ChannelCount _channelCount;
+
+	std::vector<float> _coefs; // _up phases of _taps coefficients, oldest sample first
+	const SampleConversion::DotProduct _dotProduct;
+
+	std::vector< std::vector<float> > _history; // per channel
+	unsigned int _phase;
+};
+
+
+inline size_t PolyphaseResampler::taps() const
+{
+	return _taps;
+}
+
+
+#endif // PolyphaseResampler_h
@@ -0,0 +1,218 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "RingBuffer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+
+// granularity of addresses at which storage can be mapped
+static size_t mappingGranularity()
+{
+#if defined(__linux__)
+	return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#elif defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+#else
+	return 4096;
+#endif
+}
+
+
+RingBuffer::RingBuffer(const size_t capacity)
+:
+	_capacity(0),
+	_storage(NULL),
+	_writeCount(0),
+	_readCount(0)
+{
+	if (capacity == 0)
+	{
+		throw std::invalid_argument("capacity == 0");
+	}
+
+	const size_t granularity = mappingGranularity();
+	_capacity = ((capacity + granularity - 1) / granularity) * granularity;
+
+	if (!mapTwice())
+	{
+		_mirror.resize(2 * _capacity);
+		_storage = &_mirror[0];
+	}
+}
+
+
+RingBuffer::~RingBuffer()
+{
+	if (isDoubleMapped())
+	{
+		unmap();
+	}
+}
+
+
+size_t RingBuffer::write(const byte_t* const buffer, size_t length)
+{
+	length = (std::min)(length, writable());
+	if (length == 0)
+	{
+		return 0;
+	}
+
+	const uint64_t writeCount = _writeCount.load(std::memory_order_relaxed);
+	const size_t offset = static_cast<size_t>(writeCount % _capacity);
+
+	// second mapping takes any bytes past the end of the first
+	std::memcpy(_storage + offset, buffer, length);
+
+	if (!isDoubleMapped())
+	{
+		// keep both halves of the mirror identical
+		const size_t part1 = (std::min)(length, _capacity - offset);
+		std::memcpy(_storage + _capacity + offset, buffer, part1);
+		std::memcpy(_storage, buffer + part1, length - part1);
+	}
+
+	// publish bytes to consumer
+	_writeCount.store(writeCount + length, std::memory_order_release);
+
+	return length;
+}
+
+
+void RingBuffer::consume(const size_t length)
+{
+	assert(length <= readable());
+
+	// hand space back to producer once consumer is done with it
+	_readCount.store(_readCount.load(std::memory_order_relaxed) + length,
+		std::memory_order_release);
+}
+
+
+void RingBuffer::clear()
+{
+	_readCount.store(_writeCount.load(std::memory_order_acquire),
+		std::memory_order_release);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+bool RingBuffer::mapTwice()
+{
+#if defined(__linux__)
+	const int fd = static_cast<int>(syscall(SYS_memfd_create, "rsoutput-ring", 0));
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	void* base = MAP_FAILED;
+	if (ftruncate(fd, _capacity) == 0)
+	{
+		// reserve address space for both mappings, then map over it
+		base = mmap(NULL, 2 * _capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+
+	if (base != MAP_FAILED)
+	{
+		byte_t* const storage = static_cast<byte_t*>(base);
+		if (mmap(storage, _capacity, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+			|| mmap(storage + _capacity, _capacity, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		{
+			munmap(base, 2 * _capacity);
+			base = MAP_FAILED;
+		}
+	}
+
+	// mappings keep the memory alive
+	close(fd);
+
+	if (base == MAP_FAILED)
+	{
+		return false;
+	}
+
+	_storage = static_cast<byte_t*>(base);
+	return true;
+#elif defined(_WIN32)
+	const HANDLE section = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+		PAGE_READWRITE, 0, static_cast<DWORD>(_capacity), NULL);
+	if (section == NULL)
+	{
+		return false;
+	}
+
+	// another thread may take the address range between finding it free and
+	// mapping over it, so try a few times
+	for (int attempt = 0; attempt < 8 && _storage == NULL; ++attempt)
+	{
+		void* const base = VirtualAlloc(NULL, 2 * _capacity, MEM_RESERVE, PAGE_NOACCESS);
+		if (base == NULL)
+		{
+			break;
+		}
+		VirtualFree(base, 0, MEM_RELEASE);
+
+		byte_t* const storage = static_cast<byte_t*>(base);
+		void* const view1 = MapViewOfFileEx(section, FILE_MAP_ALL_ACCESS, 0, 0, _capacity, storage);
+		void* const view2 = (view1 == NULL ? NULL
+			: MapViewOfFileEx(section, FILE_MAP_ALL_ACCESS, 0, 0, _capacity, storage + _capacity));
+
+		if (view2 != NULL)
+		{
+			_storage = storage;
+		}
+		else if (view1 != NULL)
+		{
+			UnmapViewOfFile(view1);
+		}
+	}
+
+	// views keep the section alive
+	CloseHandle(section);
+
+	return (_storage != NULL);
+#else
+	return false;
+#endif
+}
+
+
+void RingBuffer::unmap()
+{
+#if defined(__linux__)
+	munmap(_storage, 2 * _capacity);
+#elif defined(_WIN32)
+	UnmapViewOfFile(_storage + _capacity);
+	UnmapViewOfFile(_storage);
+#endif
+}
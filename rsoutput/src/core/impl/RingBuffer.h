@@ -0,0 +1,107 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RingBuffer_h
+#define RingBuffer_h
+
+
+#include "Platform.h"
+#include "Uncopyable.h"
+#include <atomic>
+#include <vector>
+
+
+/**
+ * Single-producer, single-consumer byte queue. Its storage is mapped twice
+ * back to back (memfd on Linux, a paging file section on Windows), so the
+ * readable bytes always form one contiguous region. Where that mapping is not
+ * available, written bytes are mirrored into a second copy instead. The
+ * producer calls write, the consumer calls read and consume; either may ask
+ * how much is readable or writable without taking a lock.
+ */
+class RingBuffer
+:
+	private Uncopyable
+{
+public:
+	// capacity is rounded up to the granularity of the mapping
+	explicit RingBuffer(size_t capacity);
+	~RingBuffer();
+
+	size_t capacity() const;
+	bool isDoubleMapped() const;
+
+	size_t readable() const;
+	size_t writable() const;
+
+	// producer: copies up to length bytes in; returns number copied
+	size_t write(const byte_t*, size_t length);
+
+	// consumer: returns readable() contiguous bytes, valid until consumed
+	const byte_t* read() const;
+	void consume(size_t length);
+
+	// discards everything readable; neither side may be in progress
+	void clear();
+
+private:
+	bool mapTwice();
+	void unmap();
+
+	size_t _capacity;
+	byte_t* _storage;
+	std::vector<byte_t> _mirror; // storage when mapping twice is unavailable
+
+	// running totals of bytes written and read, wide enough never to wrap;
+	// each is advanced by only one side, which publishes it with release
+	// ordering for the other side to load with acquire ordering
+	std::atomic<uint64_t> _writeCount;
+	std::atomic<uint64_t> _readCount;
+};
+
+
+inline size_t RingBuffer::capacity() const
+{
+	return _capacity;
+}
+
+
+inline bool RingBuffer::isDoubleMapped() const
+{
+	return _mirror.empty();
+}
+
+
+inline size_t RingBuffer::readable() const
+{
+	return static_cast<size_t>(_writeCount.load(std::memory_order_acquire)
+		- _readCount.load(std::memory_order_acquire));
+}
+
+
+inline size_t RingBuffer::writable() const
+{
+	return _capacity - readable();
+}
+
+
+inline const byte_t* RingBuffer::read() const
+{
+	return _storage + static_cast<size_t>(_readCount.load(std::memory_order_relaxed) % _capacity);
+}
+
+
+#endif // RingBuffer_h
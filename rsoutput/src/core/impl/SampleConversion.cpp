@@ -0,0 +1,948 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "SampleConversion.h"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define SAMPLE_SIMD_X86 1
+	#define SAMPLE_TARGET(x) __attribute__((target(x)))
+	#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#define SAMPLE_SIMD_X86 1
+	#define SAMPLE_TARGET(x)
+	#include <intrin.h>
+	#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define SAMPLE_SIMD_NEON 1
+	#include <arm_neon.h>
+#endif
+
+
+// full-scale magnitude of each integer encoding
+static const float INT8_SCALE  = 128.0F;
+static const float INT16_SCALE = 32768.0F;
+static const float INT24_SCALE = 8388608.0F;
+static const float INT32_SCALE = 2147483648.0F;
+
+// largest float that does not exceed the maximum of each integer encoding;
+// INT32_MAX itself is not representable and would round up out of range
+static const float INT8_MAX_F  = 127.0F;
+static const float INT16_MAX_F = 32767.0F;
+static const float INT24_MAX_F = 8388607.0F;
+static const float INT32_MAX_F = 2147483520.0F;
+
+
+// clamps the same way as the vector max/min instructions, so NaN saturates low
+static inline float clamp(float value, const float lo, const float hi)
+{
+	value = (value > lo) ? value : lo;
+	value = (value < hi) ? value : hi;
+	return value;
+}
+
+
+static inline int32_t quantize(const float in, const float scale, const float max)
+{
+	return static_cast<int32_t>(lrintf(clamp(in * scale, -scale, max)));
+}
+
+
+//------------------------------------------------------------------------------
+// scalar reference kernels
+
+
+static void scalar_int8_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	for (size_t s = 0; s < n; ++s)
+		out[s] = static_cast<int8_t>(in[s]) * (1.0F / INT8_SCALE);
+}
+
+
+static void scalar_int16_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	for (size_t s = 0; s < n; ++s)
+	{
+		const int16_t sample = static_cast<int16_t>(in[(s * 2)] | (in[(s * 2) + 1] << 8));
+		out[s] = sample * (1.0F / INT16_SCALE);
+	}
+}
+
+
+static void scalar_int24_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	for (size_t s = 0; s < n; ++s)
+	{
+		// assemble in the high bytes so the arithmetic shift extends the sign
+		const int32_t sample = static_cast<int32_t>(
+			(static_cast<uint32_t>(in[(s * 3)]) << 8) |
+			(static_cast<uint32_t>(in[(s * 3) + 1]) << 16) |
+			(static_cast<uint32_t>(in[(s * 3) + 2]) << 24)) >> 8;
+		out[s] = sample * (1.0F / INT24_SCALE);
+	}
+}
+
+
+static void scalar_int32_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	for (size_t s = 0; s < n; ++s)
+	{
+		const int32_t sample = static_cast<int32_t>(
+			static_cast<uint32_t>(in[(s * 4)]) |
+			(static_cast<uint32_t>(in[(s * 4) + 1]) << 8) |
+			(static_cast<uint32_t>(in[(s * 4) + 2]) << 16) |
+			(static_cast<uint32_t>(in[(s * 4) + 3]) << 24));
+		out[s] = static_cast<float>(sample) * (1.0F / INT32_SCALE);
+	}
+}
+
+
+static void scalar_float32_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	std::memcpy(out, in, n * sizeof(float));
+}
+
+
+static void scalar_float_to_int8(const float* const in, byte_t* const out, const size_t n)
+{
+	for (size_t s = 0; s < n; ++s)
+		out[s] = static_cast<byte_t>(quantize(in[s], INT8_SCALE, INT8_MAX_F));
+}
+
+
+static void scalar_float_to_int16(const float* const in, byte_t* const out, const size_t n)
+{
+	for (size_t s = 0; s < n; ++s)
+	{
+		const int32_t sample = quantize(in[s], INT16_SCALE, INT16_MAX_F);
+		out[(s * 2)] = static_cast<byte_t>(sample);
+		out[(s * 2) + 1] = static_cast<byte_t>(sample >> 8);
+	}
+}
+
+
+static void scalar_float_to_int24(const float* const in, byte_t* const out, const size_t n)
+{
+	for (size_t s = 0; s < n; ++s)
+	{
+		const int32_t sample = quantize(in[s], INT24_SCALE, INT24_MAX_F);
+		out[(s * 3)] = static_cast<byte_t>(sample);
+		out[(s * 3) + 1] = static_cast<byte_t>(sample >> 8);
+		out[(s * 3) + 2] = static_cast<byte_t>(sample >> 16);
+	}
+}
+
+
+static void scalar_float_to_int32(const float* const in, byte_t* const out, const size_t n)
+{
+	for (size_t s = 0; s < n; ++s)
+	{
+		const int32_t sample = quantize(in[s], INT32_SCALE, INT32_MAX_F);
+		out[(s * 4)] = static_cast<byte_t>(sample);
+		out[(s * 4) + 1] = static_cast<byte_t>(sample >> 8);
+		out[(s * 4) + 2] = static_cast<byte_t>(sample >> 16);
+		out[(s * 4) + 3] = static_cast<byte_t>(sample >> 24);
+	}
+}
+
+
+static void scalar_float_to_float32(const float* const in, byte_t* const out, const size_t n)
+{
+	std::memcpy(out, in, n * sizeof(float));
+}
+
+
+// works from back to front to support in-place conversion; returns with the
+// samples in [0,stop) still to be done
+template<size_t sampleSize>
+static inline void mono_to_stereo_tail(const byte_t* const in, byte_t* const out,
+	const size_t n, const size_t stop)
+{
+	for (size_t s = n; s > stop; --s)
+	{
+		byte_t sample[sampleSize];
+		std::memcpy(sample, in + ((s - 1) * sampleSize), sampleSize);
+		std::memcpy(out + ((s - 1) * sampleSize * 2), sample, sampleSize);
+		std::memcpy(out + ((s - 1) * sampleSize * 2) + sampleSize, sample, sampleSize);
+	}
+}
+
+
+template<size_t sampleSize>
+static void scalar_mono_to_stereo(const byte_t* const in, byte_t* const out, const size_t n)
+{
+	mono_to_stereo_tail<sampleSize>(in, out, n, 0);
+}
+
+
+static void scalar_mix(const float* const in, float* const out, const size_t frames,
+	const float* const columns, const int inChannels, const int outChannels)
+{
+	for (size_t f = 0; f < frames; ++f)
+	{
+		const float* const frame = in + (f * inChannels);
+		for (int o = 0; o < outChannels; ++o)
+		{
+			float sum = 0.0F;
+			for (int i = 0; i < inChannels; ++i)
+				sum += columns[(i * SampleConversion::MIX_STRIDE) + o] * frame[i];
+			out[(f * outChannels) + o] = sum;
+		}
+	}
+}
+
+
+static float scalar_dot_product(const float* const coefs, const float* const samples, const size_t n)
+{
+	// four partial sums, as the vector kernels keep, shorten the dependency chain
+	float sum[4] = { 0.0F, 0.0F, 0.0F, 0.0F };
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		sum[0] += coefs[i] * samples[i];
+		sum[1] += coefs[i + 1] * samples[i + 1];
+		sum[2] += coefs[i + 2] * samples[i + 2];
+		sum[3] += coefs[i + 3] * samples[i + 3];
+	}
+	for (; i < n; ++i)
+		sum[0] += coefs[i] * samples[i];
+
+	return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+
+//------------------------------------------------------------------------------
+// x86 kernels
+
+
+#if SAMPLE_SIMD_X86
+
+SAMPLE_TARGET("sse2")
+static void sse2_int16_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	const __m128 scale = _mm_set1_ps(1.0F / INT16_SCALE);
+	size_t s = 0;
+	for (; s + 8 <= n; s += 8)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + (s * 2)));
+		// place each sample in the high half of a dword, then shift down with sign
+		const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(out + s, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + s + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	scalar_int16_to_float(in + (s * 2), out + s, n - s);
+}
+
+
+SAMPLE_TARGET("sse2")
+static void sse2_int32_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	const __m128 scale = _mm_set1_ps(1.0F / INT32_SCALE);
+	size_t s = 0;
+	for (; s + 4 <= n; s += 4)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + (s * 4)));
+		_mm_storeu_ps(out + s, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+	scalar_int32_to_float(in + (s * 4), out + s, n - s);
+}
+
+
+SAMPLE_TARGET("sse2")
+static inline __m128i sse2_quantize(const float* const in, const __m128 scale, const __m128 lo, const __m128 hi)
+{
+	__m128 v = _mm_mul_ps(_mm_loadu_ps(in), scale);
+	v = _mm_min_ps(_mm_max_ps(v, lo), hi);
+	return _mm_cvtps_epi32(v); // rounds to nearest even under the default MXCSR
+}
+
+
+SAMPLE_TARGET("sse2")
+static void sse2_float_to_int16(const float* const in, byte_t* const out, const size_t n)
+{
+	const __m128 scale = _mm_set1_ps(INT16_SCALE);
+	const __m128 lo = _mm_set1_ps(-INT16_SCALE);
+	const __m128 hi = _mm_set1_ps(INT16_MAX_F);
+	size_t s = 0;
+	for (; s + 8 <= n; s += 8)
+	{
+		const __m128i a = sse2_quantize(in + s, scale, lo, hi);
+		const __m128i b = sse2_quantize(in + s + 4, scale, lo, hi);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + (s * 2)), _mm_packs_epi32(a, b));
+	}
+	scalar_float_to_int16(in + s, out + (s * 2), n - s);
+}
+
+
+SAMPLE_TARGET("sse2")
+static void sse2_float_to_int32(const float* const in, byte_t* const out, const size_t n)
+{
+	const __m128 scale = _mm_set1_ps(INT32_SCALE);
+	const __m128 lo = _mm_set1_ps(-INT32_SCALE);
+	const __m128 hi = _mm_set1_ps(INT32_MAX_F);
+	size_t s = 0;
+	for (; s + 4 <= n; s += 4)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + (s * 4)), sse2_quantize(in + s, scale, lo, hi));
+	}
+	scalar_float_to_int32(in + s, out + (s * 4), n - s);
+}
+
+
+// each block is read in full before its (higher addressed) output is written,
+// so blocks can be converted in place from back to front
+SAMPLE_TARGET("sse2")
+static void sse2_mono_to_stereo_8(const byte_t* const in, byte_t* const out, const size_t n)
+{
+	const size_t stop = n - (n % 16);
+	mono_to_stereo_tail<1>(in, out, n, stop);
+	for (size_t s = stop; s > 0; s -= 16)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + (s - 16)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + ((s - 16) * 2) + 16), _mm_unpackhi_epi8(v, v));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + ((s - 16) * 2)), _mm_unpacklo_epi8(v, v));
+	}
+}
+
+
+SAMPLE_TARGET("sse2")
+static void sse2_mono_to_stereo_16(const byte_t* const in, byte_t* const out, const size_t n)
+{
+	const size_t stop = n - (n % 8);
+	mono_to_stereo_tail<2>(in, out, n, stop);
+	for (size_t s = stop; s > 0; s -= 8)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + ((s - 8) * 2)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + ((s - 8) * 4) + 16), _mm_unpackhi_epi16(v, v));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + ((s - 8) * 4)), _mm_unpacklo_epi16(v, v));
+	}
+}
+
+
+SAMPLE_TARGET("sse2")
+static void sse2_mono_to_stereo_32(const byte_t* const in, byte_t* const out, const size_t n)
+{
+	const size_t stop = n - (n % 4);
+	mono_to_stereo_tail<4>(in, out, n, stop);
+	for (size_t s = stop; s > 0; s -= 4)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + ((s - 4) * 4)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + ((s - 4) * 8) + 16), _mm_unpackhi_epi32(v, v));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + ((s - 4) * 8)), _mm_unpacklo_epi32(v, v));
+	}
+}
+
+
+SAMPLE_TARGET("sse2")
+static float sse2_dot_product(const float* const coefs, const float* const samples, const size_t n)
+{
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(coefs + i), _mm_loadu_ps(samples + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(coefs + i + 4), _mm_loadu_ps(samples + i + 4)));
+	}
+	sum0 = _mm_add_ps(sum0, sum1);
+	sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+	sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+
+	float sum = _mm_cvtss_f32(sum0);
+	for (; i < n; ++i)
+		sum += coefs[i] * samples[i];
+	return sum;
+}
+
+
+// accumulates all output channels of a frame in one register by scaling each
+// input channel's column of coefficients
+SAMPLE_TARGET("sse2")
+static void sse2_mix(const float* const in, float* const out, const size_t frames,
+	const float* const columns, const int inChannels, const int outChannels)
+{
+	if (outChannels != 1 && outChannels != 2 && outChannels != 4)
+	{
+		scalar_mix(in, out, frames, columns, inChannels, outChannels);
+		return;
+	}
+
+	const size_t stride = SampleConversion::MIX_STRIDE;
+	size_t f = 0;
+
+	// four frames at a time keep four independent chains of additions going
+	for (; f + 4 <= frames; f += 4)
+	{
+		const float* const frame = in + (f * inChannels);
+		__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+		__m128 sum2 = _mm_setzero_ps(), sum3 = _mm_setzero_ps();
+		for (int i = 0; i < inChannels; ++i)
+		{
+			const __m128 column = _mm_loadu_ps(columns + (i * stride));
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_set1_ps(frame[i]), column));
+			sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_set1_ps(frame[inChannels + i]), column));
+			sum2 = _mm_add_ps(sum2, _mm_mul_ps(_mm_set1_ps(frame[(2 * inChannels) + i]), column));
+			sum3 = _mm_add_ps(sum3, _mm_mul_ps(_mm_set1_ps(frame[(3 * inChannels) + i]), column));
+		}
+
+		float* const p = out + (f * outChannels);
+		if (outChannels == 2)
+		{
+			_mm_storeu_ps(p, _mm_movelh_ps(sum0, sum1));
+			_mm_storeu_ps(p + 4, _mm_movelh_ps(sum2, sum3));
+		}
+		else if (outChannels == 4)
+		{
+			_mm_storeu_ps(p, sum0);
+			_mm_storeu_ps(p + 4, sum1);
+			_mm_storeu_ps(p + 8, sum2);
+			_mm_storeu_ps(p + 12, sum3);
+		}
+		else
+		{
+			_mm_store_ss(p, sum0);
+			_mm_store_ss(p + 1, sum1);
+			_mm_store_ss(p + 2, sum2);
+			_mm_store_ss(p + 3, sum3);
+		}
+	}
+
+	scalar_mix(in + (f * inChannels), out + (f * outChannels), frames - f,
+		columns, inChannels, outChannels);
+}
+
+
+SAMPLE_TARGET("avx2")
+static float avx2_dot_product(const float* const coefs, const float* const samples, const size_t n)
+{
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(coefs + i), _mm256_loadu_ps(samples + i)));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(coefs + i + 8), _mm256_loadu_ps(samples + i + 8)));
+	}
+	if (i + 8 <= n)
+	{
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(coefs + i), _mm256_loadu_ps(samples + i)));
+		i += 8;
+	}
+	sum0 = _mm256_add_ps(sum0, sum1);
+	__m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+	sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+	sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+
+	float sum = _mm_cvtss_f32(sum4);
+	for (; i < n; ++i)
+		sum += coefs[i] * samples[i];
+	return sum;
+}
+
+
+SAMPLE_TARGET("avx2")
+static void avx2_int16_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	const __m256 scale = _mm256_set1_ps(1.0F / INT16_SCALE);
+	size_t s = 0;
+	for (; s + 8 <= n; s += 8)
+	{
+		const __m256i v = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + (s * 2))));
+		_mm256_storeu_ps(out + s, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	scalar_int16_to_float(in + (s * 2), out + s, n - s);
+}
+
+
+SAMPLE_TARGET("avx2")
+static void avx2_int24_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	// move each 3-byte sample into the high bytes of a dword within each lane
+	const __m256i spread = _mm256_setr_epi8(
+		-128, 0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11,
+		-128, 0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11);
+	const __m256 scale = _mm256_set1_ps(1.0F / INT24_SCALE);
+	size_t s = 0;
+	// each iteration reads 28 bytes, so stay 10 samples (30 bytes) from the end
+	for (; s + 10 <= n; s += 8)
+	{
+		const byte_t* const p = in + (s * 3);
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1);
+		v = _mm256_srai_epi32(_mm256_shuffle_epi8(v, spread), 8);
+		_mm256_storeu_ps(out + s, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	scalar_int24_to_float(in + (s * 3), out + s, n - s);
+}
+
+
+SAMPLE_TARGET("avx2")
+static void avx2_int32_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	const __m256 scale = _mm256_set1_ps(1.0F / INT32_SCALE);
+	size_t s = 0;
+	for (; s + 8 <= n; s += 8)
+	{
+		const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + (s * 4)));
+		_mm256_storeu_ps(out + s, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	scalar_int32_to_float(in + (s * 4), out + s, n - s);
+}
+
+
+SAMPLE_TARGET("avx2")
+static inline __m256i avx2_quantize(const float* const in, const __m256 scale, const __m256 lo, const __m256 hi)
+{
+	__m256 v = _mm256_mul_ps(_mm256_loadu_ps(in), scale);
+	v = _mm256_min_ps(_mm256_max_ps(v, lo), hi);
+	return _mm256_cvtps_epi32(v);
+}
+
+
+SAMPLE_TARGET("avx2")
+static void avx2_float_to_int16(const float* const in, byte_t* const out, const size_t n)
+{
+	const __m256 scale = _mm256_set1_ps(INT16_SCALE);
+	const __m256 lo = _mm256_set1_ps(-INT16_SCALE);
+	const __m256 hi = _mm256_set1_ps(INT16_MAX_F);
+	size_t s = 0;
+	for (; s + 16 <= n; s += 16)
+	{
+		const __m256i a = avx2_quantize(in + s, scale, lo, hi);
+		const __m256i b = avx2_quantize(in + s + 8, scale, lo, hi);
+		// pack works within lanes, so put the quadwords back in sample order
+		const __m256i v = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (s * 2)), v);
+	}
+	scalar_float_to_int16(in + s, out + (s * 2), n - s);
+}
+
+
+SAMPLE_TARGET("avx2")
+static void avx2_float_to_int24(const float* const in, byte_t* const out, const size_t n)
+{
+	// gather the low 3 bytes of each dword into the low 12 bytes of each lane
+	const __m256i pack = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128);
+	const __m256 scale = _mm256_set1_ps(INT24_SCALE);
+	const __m256 lo = _mm256_set1_ps(-INT24_SCALE);
+	const __m256 hi = _mm256_set1_ps(INT24_MAX_F);
+	size_t s = 0;
+	// each iteration writes 28 bytes, the last 4 of which the next overwrites
+	for (; s + 10 <= n; s += 8)
+	{
+		const __m256i v = _mm256_shuffle_epi8(avx2_quantize(in + s, scale, lo, hi), pack);
+		byte_t* const p = out + (s * 3);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(v));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p + 12), _mm256_extracti128_si256(v, 1));
+	}
+	scalar_float_to_int24(in + s, out + (s * 3), n - s);
+}
+
+
+SAMPLE_TARGET("avx2")
+static void avx2_float_to_int32(const float* const in, byte_t* const out, const size_t n)
+{
+	const __m256 scale = _mm256_set1_ps(INT32_SCALE);
+	const __m256 lo = _mm256_set1_ps(-INT32_SCALE);
+	const __m256 hi = _mm256_set1_ps(INT32_MAX_F);
+	size_t s = 0;
+	for (; s + 8 <= n; s += 8)
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (s * 4)), avx2_quantize(in + s, scale, lo, hi));
+	}
+	scalar_float_to_int32(in + s, out + (s * 4), n - s);
+}
+
+#endif // SAMPLE_SIMD_X86
+
+
+//------------------------------------------------------------------------------
+// ARM kernels
+
+
+#if SAMPLE_SIMD_NEON
+
+static void neon_int16_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	const float32x4_t scale = vdupq_n_f32(1.0F / INT16_SCALE);
+	size_t s = 0;
+	for (; s + 8 <= n; s += 8)
+	{
+		const int16x8_t v = vld1q_s16(reinterpret_cast<const int16_t*>(in + (s * 2)));
+		vst1q_f32(out + s, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+		vst1q_f32(out + s + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+	}
+	scalar_int16_to_float(in + (s * 2), out + s, n - s);
+}
+
+
+static void neon_int32_to_float(const byte_t* const in, float* const out, const size_t n)
+{
+	const float32x4_t scale = vdupq_n_f32(1.0F / INT32_SCALE);
+	size_t s = 0;
+	for (; s + 4 <= n; s += 4)
+	{
+		const int32x4_t v = vld1q_s32(reinterpret_cast<const int32_t*>(in + (s * 4)));
+		vst1q_f32(out + s, vmulq_f32(vcvtq_f32_s32(v), scale));
+	}
+	scalar_int32_to_float(in + (s * 4), out + s, n - s);
+}
+
+
+static inline int32x4_t neon_quantize(const float* const in, const float32x4_t scale,
+	const float32x4_t lo, const float32x4_t hi)
+{
+	float32x4_t v = vmulq_f32(vld1q_f32(in), scale);
+	v = vminq_f32(vmaxq_f32(v, lo), hi);
+	return vcvtnq_s32_f32(v); // rounds to nearest even
+}
+
+
+static void neon_float_to_int16(const float* const in, byte_t* const out, const size_t n)
+{
+	const float32x4_t scale = vdupq_n_f32(INT16_SCALE);
+	const float32x4_t lo = vdupq_n_f32(-INT16_SCALE);
+	const float32x4_t hi = vdupq_n_f32(INT16_MAX_F);
+	size_t s = 0;
+	for (; s + 8 <= n; s += 8)
+	{
+		const int16x8_t v = vcombine_s16(
+			vqmovn_s32(neon_quantize(in + s, scale, lo, hi)),
+			vqmovn_s32(neon_quantize(in + s + 4, scale, lo, hi)));
+		vst1q_s16(reinterpret_cast<int16_t*>(out + (s * 2)), v);
+	}
+	scalar_float_to_int16(in + s, out + (s * 2), n - s);
+}
+
+
+static void neon_float_to_int32(const float* const in, byte_t* const out, const size_t n)
+{
+	const float32x4_t scale = vdupq_n_f32(INT32_SCALE);
+	const float32x4_t lo = vdupq_n_f32(-INT32_SCALE);
+	const float32x4_t hi = vdupq_n_f32(INT32_MAX_F);
+	size_t s = 0;
+	for (; s + 4 <= n; s += 4)
+	{
+		vst1q_s32(reinterpret_cast<int32_t*>(out + (s * 4)), neon_quantize(in + s, scale, lo, hi));
+	}
+	scalar_float_to_int32(in + s, out + (s * 4), n - s);
+}
+
+
+static void neon_mono_to_stereo_16(const byte_t* const in, byte_t* const out, const size_t n)
+{
+	const size_t stop = n - (n % 8);
+	mono_to_stereo_tail<2>(in, out, n, stop);
+	for (size_t s = stop; s > 0; s -= 8)
+	{
+		const int16x8_t v = vld1q_s16(reinterpret_cast<const int16_t*>(in + ((s - 8) * 2)));
+		const int16x8x2_t pair = { { v, v } };
+		vst2q_s16(reinterpret_cast<int16_t*>(out + ((s - 8) * 4)), pair);
+	}
+}
+
+
+static void neon_mono_to_stereo_32(const byte_t* const in, byte_t* const out, const size_t n)
+{
+	const size_t stop = n - (n % 4);
+	mono_to_stereo_tail<4>(in, out, n, stop);
+	for (size_t s = stop; s > 0; s -= 4)
+	{
+		const int32x4_t v = vld1q_s32(reinterpret_cast<const int32_t*>(in + ((s - 4) * 4)));
+		const int32x4x2_t pair = { { v, v } };
+		vst2q_s32(reinterpret_cast<int32_t*>(out + ((s - 4) * 8)), pair);
+	}
+}
+
+
+static void neon_mix(const float* const in, float* const out, const size_t frames,
+	const float* const columns, const int inChannels, const int outChannels)
+{
+	if (outChannels != 2 && outChannels != 4)
+	{
+		scalar_mix(in, out, frames, columns, inChannels, outChannels);
+		return;
+	}
+
+	for (size_t f = 0; f < frames; ++f)
+	{
+		const float* const frame = in + (f * inChannels);
+		float32x4_t sum = vmulq_n_f32(vld1q_f32(columns), frame[0]);
+		for (int i = 1; i < inChannels; ++i)
+		{
+			sum = vmlaq_n_f32(sum, vld1q_f32(columns + (i * SampleConversion::MIX_STRIDE)), frame[i]);
+		}
+
+		float* const p = out + (f * outChannels);
+		if (outChannels == 2)
+			vst1_f32(p, vget_low_f32(sum));
+		else
+			vst1q_f32(p, sum);
+	}
+}
+
+
+static float neon_dot_product(const float* const coefs, const float* const samples, const size_t n)
+{
+	float32x4_t sum0 = vdupq_n_f32(0.0F);
+	float32x4_t sum1 = vdupq_n_f32(0.0F);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		sum0 = vmlaq_f32(sum0, vld1q_f32(coefs + i), vld1q_f32(samples + i));
+		sum1 = vmlaq_f32(sum1, vld1q_f32(coefs + i + 4), vld1q_f32(samples + i + 4));
+	}
+
+	float sum = vaddvq_f32(vaddq_f32(sum0, sum1));
+	for (; i < n; ++i)
+		sum += coefs[i] * samples[i];
+	return sum;
+}
+
+#endif // SAMPLE_SIMD_NEON
+
+
+//------------------------------------------------------------------------------
+// dispatch tables; a null entry falls back to the next best implementation
+
+
+#if SAMPLE_SIMD_X86
+	#define SSE2_KERNEL(f) sse2_##f
+	#define AVX2_KERNEL(f) avx2_##f
+#else
+	#define SSE2_KERNEL(f) NULL
+	#define AVX2_KERNEL(f) NULL
+#endif
+#if SAMPLE_SIMD_NEON
+	#define NEON_KERNEL(f) neon_##f
+#else
+	#define NEON_KERNEL(f) NULL
+#endif
+
+
+static const SampleConversion::ToFloat TO_FLOAT
+	[SampleConversion::ENCODING_COUNT][SampleConversion::IMPLEMENTATION_COUNT] =
+{
+	{ scalar_int8_to_float, NULL, NULL, NULL },
+	{ scalar_int16_to_float, SSE2_KERNEL(int16_to_float), AVX2_KERNEL(int16_to_float), NEON_KERNEL(int16_to_float) },
+	{ scalar_int24_to_float, NULL, AVX2_KERNEL(int24_to_float), NULL },
+	{ scalar_int32_to_float, SSE2_KERNEL(int32_to_float), AVX2_KERNEL(int32_to_float), NEON_KERNEL(int32_to_float) },
+	{ scalar_float32_to_float, NULL, NULL, NULL }
+};
+
+
+static const SampleConversion::FromFloat FROM_FLOAT
+	[SampleConversion::ENCODING_COUNT][SampleConversion::IMPLEMENTATION_COUNT] =
+{
+	{ scalar_float_to_int8, NULL, NULL, NULL },
+	{ scalar_float_to_int16, SSE2_KERNEL(float_to_int16), AVX2_KERNEL(float_to_int16), NEON_KERNEL(float_to_int16) },
+	{ scalar_float_to_int24, NULL, AVX2_KERNEL(float_to_int24), NULL },
+	{ scalar_float_to_int32, SSE2_KERNEL(float_to_int32), AVX2_KERNEL(float_to_int32), NEON_KERNEL(float_to_int32) },
+	{ scalar_float_to_float32, NULL, NULL, NULL }
+};
+
+
+static const SampleConversion::MonoToStereo MONO_TO_STEREO
+	[4][SampleConversion::IMPLEMENTATION_COUNT] =
+{
+	{ scalar_mono_to_stereo<1>, SSE2_KERNEL(mono_to_stereo_8), NULL, NULL },
+	{ scalar_mono_to_stereo<2>, SSE2_KERNEL(mono_to_stereo_16), NULL, NEON_KERNEL(mono_to_stereo_16) },
+	{ scalar_mono_to_stereo<3>, NULL, NULL, NULL },
+	{ scalar_mono_to_stereo<4>, SSE2_KERNEL(mono_to_stereo_32), NULL, NEON_KERNEL(mono_to_stereo_32) }
+};
+
+
+static const SampleConversion::Mix MIX
+	[SampleConversion::IMPLEMENTATION_COUNT] =
+{
+	scalar_mix, SSE2_KERNEL(mix), NULL, NEON_KERNEL(mix)
+};
+
+
+static const SampleConversion::DotProduct DOT_PRODUCT
+	[SampleConversion::IMPLEMENTATION_COUNT] =
+{
+	scalar_dot_product, SSE2_KERNEL(dot_product), AVX2_KERNEL(dot_product), NEON_KERNEL(dot_product)
+};
+
+
+template<typename Kernel>
+static Kernel lookup(const Kernel (&kernels)[SampleConversion::IMPLEMENTATION_COUNT],
+	SampleConversion::Implementation impl)
+{
+	if (!SampleConversion::isSupported(impl))
+	{
+		throw std::invalid_argument("implementation not supported by this CPU");
+	}
+
+	while (kernels[impl] == NULL)
+	{
+		// AVX2 falls back to SSE2; everything else to scalar
+		impl = (impl == SampleConversion::AVX2)
+			? SampleConversion::SSE2 : SampleConversion::SCALAR;
+	}
+	return kernels[impl];
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SampleConversion::Implementation SampleConversion::bestImplementation()
+{
+	static volatile int best = -1; // detected once; racing callers store the same value
+
+	if (best < 0)
+	{
+		int found = SCALAR;
+		if (isSupported(NEON))
+			found = NEON;
+		else if (isSupported(AVX2))
+			found = AVX2;
+		else if (isSupported(SSE2))
+			found = SSE2;
+
+		best = found;
+	}
+
+	return static_cast<Implementation>(best);
+}
+
+
+bool SampleConversion::isSupported(const Implementation impl)
+{
+	switch (impl)
+	{
+	case SCALAR:
+		return true;
+#if SAMPLE_SIMD_X86 && defined(_MSC_VER)
+	case SSE2:
+	case AVX2:
+		{
+			int info[4];
+			__cpuid(info, 1);
+			if (impl == SSE2)
+				return (info[3] & (1 << 26)) != 0;
+			if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+				return false; // OS does not save YMM registers
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+		}
+#elif SAMPLE_SIMD_X86
+	case SSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2") != 0;
+	case AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#elif SAMPLE_SIMD_NEON
+	case NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+
+const char* SampleConversion::name(const Implementation impl)
+{
+	switch (impl)
+	{
+	case SCALAR: return "scalar";
+	case SSE2: return "SSE2";
+	case AVX2: return "AVX2";
+	case NEON: return "NEON";
+	default: return "unknown";
+	}
+}
+
+
+const char* SampleConversion::name(const Encoding encoding)
+{
+	switch (encoding)
+	{
+	case INT8: return "int8";
+	case INT16: return "int16";
+	case INT24: return "int24";
+	case INT32: return "int32";
+	case FLOAT32: return "float32";
+	default: return "unknown";
+	}
+}
+
+
+SampleConversion::Encoding SampleConversion::encoding(const OutputFormat& format)
+{
+	if (format.sampleEncoding() == SampleEncoding::FLOAT)
+	{
+		return FLOAT32;
+	}
+
+	return static_cast<Encoding>(INT8 + (format.sampleSize() - 1));
+}
+
+
+SampleConversion::ToFloat SampleConversion::toFloat(const Encoding encoding, const Implementation impl)
+{
+	if (encoding < 0 || encoding >= ENCODING_COUNT)
+	{
+		throw std::invalid_argument("encoding");
+	}
+
+	return lookup(TO_FLOAT[encoding], impl);
+}
+
+
+SampleConversion::FromFloat SampleConversion::fromFloat(const Encoding encoding, const Implementation impl)
+{
+	if (encoding < 0 || encoding >= ENCODING_COUNT)
+	{
+		throw std::invalid_argument("encoding");
+	}
+
+	return lookup(FROM_FLOAT[encoding], impl);
+}
+
+
+SampleConversion::MonoToStereo SampleConversion::monoToStereo(const int sampleSize, const Implementation impl)
+{
+	if (sampleSize < 1 || sampleSize > 4)
+	{
+		throw std::invalid_argument("sampleSize < 1 || sampleSize > 4");
+	}
+
+	return lookup(MONO_TO_STEREO[sampleSize - 1], impl);
+}
+
+
+SampleConversion::Mix SampleConversion::mix(const Implementation impl)
+{
+	return lookup(MIX, impl);
+}
+
+
+SampleConversion::DotProduct SampleConversion::dotProduct(const Implementation impl)
+{
+	return lookup(DOT_PRODUCT, impl);
+}
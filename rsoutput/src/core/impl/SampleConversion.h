@@ -0,0 +1,89 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SampleConversion_h
+#define SampleConversion_h
+
+
+#include "OutputFormat.h"
+#include "Platform.h"
+#include <cstddef>
+
+
+/**
+ * Kernels that convert packed little-endian samples to and from floating-point
+ * samples in the range [-1.0,1.0], that duplicate mono samples into stereo and
+ * that mix and filter floating-point samples. Each kernel has a scalar reference and may
+ * have vectorized versions; the best one the CPU supports is looked up once.
+ * Vectorized conversions produce results identical to the scalar reference.
+ */
+class SampleConversion
+{
+public:
+	enum Encoding {
+		INT8    = 0,
+		INT16   = 1,
+		INT24   = 2, // packed in three bytes
+		INT32   = 3,
+		FLOAT32 = 4,
+		ENCODING_COUNT
+	};
+
+	enum Implementation {
+		SCALAR = 0,
+		SSE2   = 1,
+		AVX2   = 2,
+		NEON   = 3,
+		IMPLEMENTATION_COUNT
+	};
+
+	typedef void (*ToFloat)(const byte_t* in, float* out, size_t sampleCount);
+
+	// saturates samples outside of [-1.0,1.0] and rounds to nearest (even)
+	typedef void (*FromFloat)(const float* in, byte_t* out, size_t sampleCount);
+
+	// converts in place when in == out
+	typedef void (*MonoToStereo)(const byte_t* in, byte_t* out, size_t sampleCount);
+
+	// out[frame][o] = sum of columns[i][o] * in[frame][i]; columns hold
+	// MIX_STRIDE coefficients per input channel, one per output channel
+	typedef void (*Mix)(const float* in, float* out, size_t frameCount,
+		const float* columns, int inChannelCount, int outChannelCount);
+	static const int MIX_STRIDE = 8;
+
+	// sums the products of count coefficients and samples
+	typedef float (*DotProduct)(const float* coefs, const float* samples, size_t count);
+
+	static Implementation bestImplementation();
+	static bool isSupported(Implementation);
+	static const char* name(Implementation);
+	static const char* name(Encoding);
+
+	static Encoding encoding(const OutputFormat&);
+
+	// fall back to the next best implementation that has the kernel
+	static ToFloat toFloat(Encoding, Implementation = bestImplementation());
+	static FromFloat fromFloat(Encoding, Implementation = bestImplementation());
+	static MonoToStereo monoToStereo(int sampleSize, Implementation = bestImplementation());
+	static Mix mix(Implementation = bestImplementation());
+	static DotProduct dotProduct(Implementation = bestImplementation());
+
+private:
+	SampleConversion();
+};
+
+
+#endif // SampleConversion_h
@@ -0,0 +1,122 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "AudioQueue.h"
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+
+AudioQueue::AudioQueue(const size_t blockMaxSize, const uint16_t blockCount)
+:
+	_blockMaxSize(blockMaxSize),
+	_blockCount(blockCount),
+	_blockSize(blockMaxSize),
+	_blockLengths(blockCount),
+	_buffer(blockMaxSize * blockCount),
+	_readCount(0),
+	_writeCount(0)
+{
+	assert(blockMaxSize > 0 && blockCount > 0);
+}
+
+
+AudioQueue::~AudioQueue()
+{
+}
+
+
+void AudioQueue::reset(const size_t blockSize)
+{
+	if (blockSize == 0 || blockSize > _blockMaxSize)
+	{
+		throw std::invalid_argument("blockSize == 0 || blockSize > _blockMaxSize");
+	}
+	_blockSize = blockSize;
+
+	_readCount.store(0, std::memory_order_relaxed);
+	_writeCount.store(0, std::memory_order_release);
+}
+
+
+bool AudioQueue::canWrite() const
+{
+	const size_t readCount = _readCount.load(std::memory_order_acquire);
+	const size_t writeCount = _writeCount.load(std::memory_order_relaxed);
+
+	return (writeCount - readCount < _blockCount);
+}
+
+
+bool AudioQueue::canRead() const
+{
+	const size_t readCount = _readCount.load(std::memory_order_relaxed);
+	const size_t writeCount = _writeCount.load(std::memory_order_acquire);
+
+	return (writeCount != readCount);
+}
+
+
+void AudioQueue::push(const byte_t* const block, const size_t length)
+{
+	if (block == NULL || length == 0 || length > _blockSize)
+	{
+		throw std::invalid_argument(
+			"block == NULL || length == 0 || length > _blockSize");
+	}
+	if (!canWrite())
+	{
+		throw std::logic_error("Can't write at this time");
+	}
+
+	const size_t writeCount = _writeCount.load(std::memory_order_relaxed);
+	const size_t index = (writeCount % _blockCount);
+	byte_t* const ptr = &_buffer[index * _blockMaxSize];
+
+	std::memcpy(ptr, block, length);
+	if (length < _blockSize)
+	{
+		std::memset(ptr + length, 0, _blockSize - length);
+	}
+	_blockLengths[index] = length;
+
+	// publish block to consumer
+	_writeCount.store(writeCount + 1, std::memory_order_release);
+}
+
+
+const byte_t* AudioQueue::front(size_t& length) const
+{
+	if (!canRead())
+	{
+		throw std::logic_error("Can't read at this time");
+	}
+
+	const size_t index = (_readCount.load(std::memory_order_relaxed) % _blockCount);
+
+	length = _blockLengths[index];
+	return &_buffer[index * _blockMaxSize];
+}
+
+
+void AudioQueue::pop()
+{
+	assert(canRead());
+
+	// release block to producer
+	_readCount.store(_readCount.load(std::memory_order_relaxed) + 1,
+		std::memory_order_release);
+}
@@ -0,0 +1,64 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef AudioQueue_h
+#define AudioQueue_h
+
+
+#include "Platform.h"
+#include "Uncopyable.h"
+#include <atomic>
+#include <vector>
+
+
+/**
+ * Fixed-capacity queue of PCM audio blocks that is safe for exactly one
+ * producer thread and one consumer thread to use without locking.
+ */
+class AudioQueue
+:
+	private Uncopyable
+{
+public:
+	AudioQueue(size_t blockMaxSize, uint16_t blockCount);
+	~AudioQueue();
+
+	// only while producer and consumer are idle; blocks are padded to blockSize
+	void reset(size_t blockSize);
+
+	bool canWrite() const;
+	bool canRead() const;
+
+	// producer: copies block and pads it with silence up to blockSize
+	void push(const byte_t*, size_t);
+
+	// consumer: returns oldest block and its original (unpadded) length
+	const byte_t* front(size_t& length) const;
+	void pop();
+
+private:
+	const size_t _blockMaxSize;
+	const size_t _blockCount;
+	size_t _blockSize;
+	std::vector<size_t> _blockLengths;
+	buffer_t _buffer;
+
+	std::atomic<size_t> _readCount;
+	std::atomic<size_t> _writeCount;
+};
+
+
+#endif // AudioQueue_h
@@ -0,0 +1,197 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "ControlScheduler.h"
+#include "Debugger.h"
+#include "RTSPClient.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+// each device is sent each kind of update at most this often
+static const long CONTROL_INTERVAL_MSEC = 100;
+
+// request still unanswered after this long no longer holds back the next one
+static const long CONTROL_TIMEOUT_MSEC = 10000;
+
+// maximum time to wait for updates before checking for shutdown
+static const long CONTROL_WAIT_MSEC = 100;
+
+static const char* const PARAMETER_NAMES[ControlScheduler::PARAMETER_COUNT] =
+{
+	"volume",
+	"progress"
+};
+
+
+ControlScheduler::Update::Update()
+:
+	pending(false),
+	// first update is not held back
+	lastSent(PacingTimer::now() - CONTROL_INTERVAL_MSEC * 1000)
+{
+}
+
+
+ControlScheduler::ControlScheduler()
+:
+	_stopping(false),
+	_thread("RAOPEngine.ControlScheduler::run"),
+	_runnable(*this, &ControlScheduler::run)
+{
+	_thread.start(_runnable);
+}
+
+
+ControlScheduler::~ControlScheduler()
+{
+	try
+	{
+		_stopping = true;
+		_event.set();
+		_thread.join();
+	}
+	CATCH_ALL
+}
+
+
+void ControlScheduler::update(RTSPClient& client, const Parameter parameter,
+	const std::string& value)
+{
+	assert(parameter >= 0 && parameter < PARAMETER_COUNT);
+	assert(!value.empty());
+
+	{
+		// never waits for a send, so may be called with other locks held
+		Poco::FastMutex::ScopedLock updateLock(_updateMutex);
+
+		// last writer wins; any earlier value not yet sent is dropped
+		Update& update = _clients[&client].updates[parameter];
+		update.value = value;
+		update.pending = true;
+	}
+
+	_event.set();
+}
+
+
+void ControlScheduler::removeClient(RTSPClient& client)
+{
+	ScopedLock lock(_mutex); // wait for any send in progress
+
+	Poco::FastMutex::ScopedLock updateLock(_updateMutex);
+	_clients.erase(&client);
+}
+
+
+void ControlScheduler::run()
+{
+	long waitMsec = CONTROL_WAIT_MSEC;
+
+	while (!_stopping)
+	{
+		try
+		{
+			_event.tryWait(waitMsec);
+
+			waitMsec = process();
+		}
+		CATCH_ALL
+	}
+}
+
+
+// sends each update that is due and returns time until next one will be
+long ControlScheduler::process()
+{
+	ScopedLock lock(_mutex);
+
+	const PacingTimer::Time now = PacingTimer::now();
+	PacingTimer::Time wait = CONTROL_WAIT_MSEC * 1000;
+
+	{
+		Poco::FastMutex::ScopedLock updateLock(_updateMutex);
+
+		for (ClientMap::iterator it = _clients.begin(); it != _clients.end(); ++it)
+		{
+			for (int p = 0; p < PARAMETER_COUNT; p += 1)
+			{
+				Update& update = it->second.updates[p];
+
+				if (update.inFlight.valid())
+				{
+					if (update.inFlight.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+					{
+						try
+						{
+							// client has logged status, so only failure is of interest
+							update.inFlight.get();
+						}
+						CATCH_ALL
+					}
+					else if (now - update.lastSent >= CONTROL_TIMEOUT_MSEC * 1000)
+					{
+						Debugger::printf("No response to %s update after %li ms.",
+							PARAMETER_NAMES[p], CONTROL_TIMEOUT_MSEC);
+						update.inFlight = std::future<int>();
+					}
+					else
+					{
+						// response sets event; check again in case it does not come
+						if (update.pending)
+							wait = (std::min)(wait, update.lastSent + CONTROL_TIMEOUT_MSEC * 1000 - now);
+						continue;
+					}
+				}
+
+				if (!update.pending)
+				{
+					continue;
+				}
+
+				const PacingTimer::Time due = update.lastSent + CONTROL_INTERVAL_MSEC * 1000;
+				if (now < due)
+				{
+					wait = (std::min)(wait, due - now);
+					continue;
+				}
+
+				update.pending = false;
+				update.lastSent = now;
+
+				Send send = { it->first, static_cast<Parameter>(p), update.value, &update };
+				_sends.push_back(send);
+			}
+		}
+	}
+
+	// send with only _mutex held, so updates are still taken meanwhile; entries
+	// are erased only under _mutex, so each update outlives its send
+	for (std::vector<Send>::iterator it = _sends.begin(); it != _sends.end(); ++it)
+	{
+		try
+		{
+			// in-flight status is read and written only on this thread
+			it->update->inFlight = it->client->postSetParameter(
+				PARAMETER_NAMES[it->parameter], it->value, &_event);
+		}
+		CATCH_ALL
+	}
+	_sends.clear();
+
+	// round up so that a due update is not found a little early
+	return static_cast<long>((wait + 999) / 1000);
+}
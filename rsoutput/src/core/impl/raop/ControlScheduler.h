@@ -0,0 +1,110 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ControlScheduler_h
+#define ControlScheduler_h
+
+
+#include "PacingTimer.h"
+#include "Platform.h"
+#include "Uncopyable.h"
+#include <future>
+#include <map>
+#include <string>
+#include <vector>
+#include <Poco/Event.h>
+#include <Poco/Mutex.h>
+#include <Poco/RunnableAdapter.h>
+#include <Poco/ScopedLock.h>
+#include <Poco/Thread.h>
+
+
+/**
+ * Sends volume and progress updates to devices on its own thread.  An update
+ * not yet sent is replaced by a newer one of the same kind, and each device
+ * has at most one request of each kind outstanding, sent no more often than
+ * every CONTROL_INTERVAL_MSEC; so a slider sweep reaches each device as a few
+ * requests ending with the last value rather than as a backlog of them.
+ */
+class ControlScheduler
+:
+	private Uncopyable
+{
+public:
+	enum Parameter
+	{
+		VOLUME   = 0,
+		PROGRESS = 1,
+		PARAMETER_COUNT
+	};
+
+	ControlScheduler();
+	~ControlScheduler();
+
+	// queues update and returns immediately
+	void update(class RTSPClient&, Parameter, const std::string& value);
+
+	// must be called before client is destroyed
+	void removeClient(class RTSPClient&);
+
+private:
+	struct Update
+	{
+		Update();
+
+		std::string value;
+		bool pending;               // value is waiting to be sent
+		std::future<int> inFlight;  // status of last value sent
+		PacingTimer::Time lastSent;
+	};
+
+	struct Client
+	{
+		Update updates[PARAMETER_COUNT];
+	};
+
+	/** update found due, to be sent once the map is unlocked */
+	struct Send
+	{
+		class RTSPClient* client;
+		Parameter parameter;
+		std::string value;
+		Update* update;
+	};
+
+	void run();
+	long process();
+
+	/** updates by client; erased only while _mutex is also held */
+	typedef std::map<class RTSPClient*, Client> ClientMap;
+	ClientMap _clients;
+	Poco::FastMutex _updateMutex;
+	std::vector<Send> _sends;
+
+	/** set by new updates and by responses to those sent */
+	Poco::Event _event;
+
+	volatile bool _stopping;
+	Poco::Thread _thread;
+	Poco::RunnableAdapter<ControlScheduler> _runnable;
+
+	/** held while sending, so clients are not removed mid-request */
+	Poco::FastMutex _mutex;
+	typedef Poco::FastMutex::ScopedLock ScopedLock;
+};
+
+
+#endif // ControlScheduler_h
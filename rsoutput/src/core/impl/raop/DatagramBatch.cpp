@@ -0,0 +1,301 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "DatagramBatch.h"
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <Poco/Exception.h>
+#include <Poco/Format.h>
+#if !defined(_WIN32)
+#include <sys/uio.h>
+#endif
+
+using Poco::Net::DatagramSocket;
+using Poco::Net::SocketAddress;
+
+
+bool DatagramBatch::isBatchingSupported()
+{
+#if defined(__linux__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+DatagramBatch::DatagramBatch(DatagramSocket& socket)
+:
+	_socket(socket),
+	_batching(false),
+	_datagramCount(0),
+	_syscallCount(0)
+{
+}
+
+
+DatagramBatch::~DatagramBatch()
+{
+}
+
+
+void DatagramBatch::setBatching(const bool batching)
+{
+	_batching = (batching && isBatchingSupported());
+}
+
+
+void DatagramBatch::clear()
+{
+	_datagrams.clear();
+}
+
+
+void DatagramBatch::add(const SocketAddress& address,
+	const void* const buffer, const size_t length)
+{
+	add(address, NULL, 0, buffer, length);
+}
+
+
+void DatagramBatch::add(const SocketAddress& address,
+	const void* const header, const size_t headerLength,
+	const void* const buffer, const size_t length)
+{
+	assert(buffer != NULL && length > 0);
+	assert((header != NULL) == (headerLength > 0));
+
+	Datagram datagram;
+	datagram.address = address;
+	datagram.header = header;
+	datagram.headerLength = headerLength;
+	datagram.buffer = buffer;
+	datagram.length = length;
+	datagram.errorCode = 0;
+
+	_datagrams.push_back(datagram);
+}
+
+
+size_t DatagramBatch::send()
+{
+	if (_datagrams.empty())
+	{
+		return 0;
+	}
+
+	return (_batching ? sendBatched() : sendEach());
+}
+
+
+const SocketAddress& DatagramBatch::address(const size_t index) const
+{
+	return _datagrams.at(index).address;
+}
+
+
+const std::string& DatagramBatch::error(const size_t index) const
+{
+	return _datagrams.at(index).error;
+}
+
+
+bool DatagramBatch::isDestinationError(const size_t index) const
+{
+	switch (_datagrams.at(index).errorCode)
+	{
+#if defined(_WIN32)
+	case WSAECONNREFUSED:
+	case WSAECONNRESET: // port unreachable, as reported for datagram sockets
+	case WSAEHOSTDOWN:
+	case WSAEHOSTUNREACH:
+	case WSAENETUNREACH:
+#else
+	case ECONNREFUSED:
+	case EHOSTDOWN:
+	case EHOSTUNREACH:
+	case ENETUNREACH:
+#endif
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+
+size_t DatagramBatch::sendEach()
+{
+	size_t sent = 0;
+
+	for (std::vector<Datagram>::iterator it = _datagrams.begin();
+		it != _datagrams.end(); ++it)
+	{
+		Datagram& datagram = *it;
+		datagram.errorCode = 0;
+
+		try
+		{
+			// sent directly rather than through socket so any error code is kept
+			_syscallCount += 1;
+			sendTo(datagram);
+
+			datagram.error.clear();
+			sent += 1;
+		}
+		catch (const Poco::Exception& ex)
+		{
+			datagram.error = ex.displayText();
+		}
+		catch (const std::exception& ex)
+		{
+			datagram.error = ex.what();
+		}
+	}
+
+	_datagramCount += sent;
+	return sent;
+}
+
+
+void DatagramBatch::sendTo(Datagram& datagram)
+{
+	const size_t totalLength = (datagram.headerLength + datagram.length);
+
+#if defined(_WIN32)
+	WSABUF buffers[2];
+	buffers[0].buf = (CHAR*)datagram.header;
+	buffers[0].len = (ULONG)datagram.headerLength;
+	buffers[1].buf = (CHAR*)datagram.buffer;
+	buffers[1].len = (ULONG)datagram.length;
+
+	DWORD sentLength = 0;
+	const int returnCode = WSASendTo(_socket.impl()->sockfd(), buffers, 2, &sentLength, 0,
+		datagram.address.addr(), (int)datagram.address.length(), NULL, NULL);
+
+	if (returnCode != 0 || static_cast<size_t>(sentLength) != totalLength)
+	{
+		datagram.errorCode = (returnCode != 0 ? WSAGetLastError() : 0);
+		throw std::runtime_error("WSASendTo failed");
+	}
+#else
+	struct iovec vectors[2];
+	vectors[0].iov_base = const_cast<void*>(datagram.header);
+	vectors[0].iov_len = datagram.headerLength;
+	vectors[1].iov_base = const_cast<void*>(datagram.buffer);
+	vectors[1].iov_len = datagram.length;
+
+	struct msghdr message;
+	std::memset(&message, 0, sizeof(message));
+	message.msg_name = const_cast<struct sockaddr*>(datagram.address.addr());
+	message.msg_namelen = datagram.address.length();
+	message.msg_iov = vectors;
+	message.msg_iovlen = 2;
+
+	const ssize_t returnCode = ::sendmsg(_socket.impl()->sockfd(), &message, 0);
+
+	if (returnCode < 0 || static_cast<size_t>(returnCode) != totalLength)
+	{
+		datagram.errorCode = (returnCode < 0 ? errno : 0);
+		throw std::runtime_error("sendmsg failed");
+	}
+#endif
+}
+
+
+size_t DatagramBatch::sendBatched()
+{
+#if defined(__linux__)
+	const size_t count = _datagrams.size();
+	_headers.resize(count);
+	_vectors.resize(2 * count);
+
+	for (size_t i = 0; i < count; i += 1)
+	{
+		Datagram& datagram = _datagrams[i];
+		datagram.error.clear();
+		datagram.errorCode = 0;
+
+		struct iovec* const vectors = &_vectors[2 * i];
+		size_t vectorCount = 0;
+		if (datagram.header != NULL)
+		{
+			vectors[vectorCount].iov_base = const_cast<void*>(datagram.header);
+			vectors[vectorCount].iov_len = datagram.headerLength;
+			vectorCount += 1;
+		}
+		vectors[vectorCount].iov_base = const_cast<void*>(datagram.buffer);
+		vectors[vectorCount].iov_len = datagram.length;
+		vectorCount += 1;
+
+		struct msghdr& header = _headers[i].msg_hdr;
+		std::memset(&header, 0, sizeof(header));
+		header.msg_name = const_cast<struct sockaddr*>(datagram.address.addr());
+		header.msg_namelen = datagram.address.length();
+		header.msg_iov = vectors;
+		header.msg_iovlen = vectorCount;
+		_headers[i].msg_len = 0;
+	}
+
+	const int fd = _socket.impl()->sockfd();
+	size_t sent = 0;
+	size_t next = 0;
+
+	while (next < count)
+	{
+		_syscallCount += 1;
+		const int result = ::sendmmsg(fd, &_headers[next],
+			static_cast<unsigned int>(count - next), MSG_DONTWAIT);
+
+		if (result > 0)
+		{
+			for (size_t i = next; i < next + result; i += 1)
+			{
+				if (_headers[i].msg_len == _datagrams[i].headerLength + _datagrams[i].length)
+				{
+					sent += 1;
+				}
+				else
+				{
+					_datagrams[i].error = "sendmmsg truncated datagram";
+				}
+			}
+			next += result;
+		}
+		else
+		{
+			const int error = (result < 0 ? errno : EIO);
+			if (error == EINTR)
+			{
+				continue;
+			}
+
+			// datagram at head of batch failed; skip it and send the rest
+			_datagrams[next].error = Poco::format(
+				"sendmmsg failed: %s", std::string(std::strerror(error)));
+			_datagrams[next].errorCode = error;
+			next += 1;
+		}
+	}
+
+	_datagramCount += sent;
+	return sent;
+#else
+	return sendEach();
+#endif
+}
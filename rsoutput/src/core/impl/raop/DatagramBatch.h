@@ -0,0 +1,104 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef DatagramBatch_h
+#define DatagramBatch_h
+
+
+#include "Platform.h"
+#include "Uncopyable.h"
+#include <string>
+#include <vector>
+#include <Poco/Net/DatagramSocket.h>
+#include <Poco/Net/SocketAddress.h>
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
+
+/**
+ * Collects datagrams bound for several destinations and sends them together;
+ * with batching enabled (Linux only) the whole batch is sent using sendmmsg,
+ * otherwise each datagram is sent with its own sendto call.
+ */
+class DatagramBatch
+:
+	private Uncopyable
+{
+public:
+	static bool isBatchingSupported();
+
+	explicit DatagramBatch(Poco::Net::DatagramSocket&);
+	~DatagramBatch();
+
+	bool isBatching() const { return _batching; }
+	void setBatching(bool);
+
+	void clear();
+	size_t size() const { return _datagrams.size(); }
+
+	// buffers must remain valid until send returns; optional header is sent
+	// in front of buffer as part of the same datagram without joining them
+	void add(const Poco::Net::SocketAddress&, const void* buffer, size_t length);
+	void add(const Poco::Net::SocketAddress&, const void* header, size_t headerLength,
+		const void* buffer, size_t length);
+
+	// returns number of datagrams sent successfully; failures are retained
+	size_t send();
+
+	const Poco::Net::SocketAddress& address(size_t index) const;
+	const std::string& error(size_t index) const; // empty if sent successfully
+
+	// whether datagram failed because of its destination (e.g. unreachable)
+	// rather than the sending socket (e.g. send buffer full)
+	bool isDestinationError(size_t index) const;
+
+	/** running totals for reporting send efficiency */
+	uint64_t datagramCount() const { return _datagramCount; }
+	uint64_t syscallCount() const { return _syscallCount; }
+	void resetCounts() { _datagramCount = _syscallCount = 0; }
+
+private:
+	size_t sendEach();
+	size_t sendBatched();
+
+	struct Datagram {
+		Poco::Net::SocketAddress address;
+		const void* header;
+		size_t headerLength;
+		const void* buffer;
+		size_t length;
+		std::string error;
+		int errorCode; // system error code, or 0 if unknown
+	};
+
+	void sendTo(Datagram&);
+
+	Poco::Net::DatagramSocket& _socket;
+	std::vector<Datagram> _datagrams;
+	bool _batching;
+
+#if defined(__linux__)
+	std::vector<struct mmsghdr> _headers;
+	std::vector<struct iovec> _vectors;
+#endif
+
+	uint64_t _datagramCount;
+	uint64_t _syscallCount;
+};
+
+
+#endif // DatagramBatch_h
@@ -0,0 +1,283 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "MetadataDispatcher.h"
+#include "Debugger.h"
+#include "RAOPDevice.h"
+#include "RTSPClient.h"
+#include <cassert>
+#include <cstring>
+#include <Poco/ByteOrder.h>
+
+using Poco::ByteOrder;
+
+// maximum time to wait for updates before checking for shutdown
+static const long METADATA_WAIT_MSEC = 100;
+
+// artwork larger than this is not sent, to avoid overwhelming a device
+static const size_t ARTWORK_MAX_SIZE = 262144; // 256 KB
+static const short ARTWORK_MAX_DIMENSION = 1000;
+
+
+static void dmapAppend(buffer_t &buf, const char *key, const void *val, const uint32_t len)
+{
+	assert(std::strlen(key) == 4);
+
+	buffer_t::size_type idx = buf.size();
+
+	// increase capacity of buffer to accommodate key, value length and value
+	buf.resize(idx + 8 + len);
+
+	std::memcpy(&buf[idx], key, 4);
+	idx += 4;
+
+	const uint32_t length = ByteOrder::toNetwork(len);
+	std::memcpy(&buf[idx], &length, 4);
+	idx += 4;
+
+	if (len > 0)
+	{
+		std::memcpy(&buf[idx], val, len);
+		idx += len;
+	}
+
+	assert(idx == buf.size());
+}
+
+template <typename integer_t>
+inline void dmapAppend(buffer_t &buf, const char *key, integer_t val)
+{
+	val = ByteOrder::toNetwork(val);
+	dmapAppend(buf, key, &val, sizeof(integer_t));
+}
+
+template <>
+inline void dmapAppend(buffer_t &buf, const char *key, const int8_t val)
+{
+	dmapAppend(buf, key, &val, 1);
+}
+
+template <>
+inline void dmapAppend(buffer_t &buf, const char *key, const uint8_t val)
+{
+	dmapAppend(buf, key, &val, 1);
+}
+
+
+// 64-bit FNV-1a
+static uint64_t hashAppend(uint64_t hash, const void *const data, const size_t length)
+{
+	const byte_t *const bytes = static_cast<const byte_t *>(data);
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+
+static bool sameMetadata(const OutputMetadata &lhs, const OutputMetadata &rhs)
+{
+	return lhs.length() == rhs.length()
+		&& lhs.playlistPos() == rhs.playlistPos()
+		&& lhs.title() == rhs.title()
+		&& lhs.album() == rhs.album()
+		&& lhs.artist() == rhs.artist()
+		&& lhs.artworkType() == rhs.artworkType()
+		&& lhs.artworkData() == rhs.artworkData();
+}
+
+//------------------------------------------------------------------------------
+
+MetadataDispatcher::MetadataDispatcher()
+	: _stopping(false),
+	  _thread("RAOPEngine.MetadataDispatcher::run"),
+	  _runnable(*this, &MetadataDispatcher::run)
+{
+	_payload.hash = 0;
+
+	_thread.start(_runnable);
+}
+
+MetadataDispatcher::~MetadataDispatcher()
+{
+	try
+	{
+		_stopping = true;
+		_updateEvent.set();
+		_thread.join();
+	}
+	CATCH_ALL
+}
+
+void MetadataDispatcher::update(RTSPClient &client, const byte_t metadataFlags,
+								const OutputMetadata &metadata, const uint32_t rtpTime)
+{
+	{
+		Poco::FastMutex::ScopedLock lock(_updateMutex);
+
+		// devices are updated one after another with the same metadata, which
+		// is copied only for the first
+		if (_metadata.get() == NULL || !sameMetadata(*_metadata, metadata))
+		{
+			_metadata.reset(new OutputMetadata(metadata));
+		}
+
+		// replaces (and so drops) any earlier update not yet sent
+		Update &update = _updates[&client];
+		update.metadata = _metadata;
+		update.metadataFlags = metadataFlags;
+		update.rtpTime = rtpTime;
+	}
+
+	_updateEvent.set();
+}
+
+void MetadataDispatcher::removeClient(RTSPClient &client)
+{
+	ScopedLock lock(_mutex); // wait for any send in progress
+
+	{
+		Poco::FastMutex::ScopedLock updateLock(_updateMutex);
+		_updates.erase(&client);
+	}
+
+	_sentHashes.erase(&client);
+}
+
+void MetadataDispatcher::run()
+{
+	while (!_stopping)
+	{
+		try
+		{
+			_updateEvent.tryWait(METADATA_WAIT_MSEC);
+
+			// send updates one at a time, so any queued meanwhile can still
+			// replace those not yet taken
+			for (;;)
+			{
+				ScopedLock lock(_mutex);
+
+				RTSPClient *client;
+				Update update;
+				{
+					Poco::FastMutex::ScopedLock updateLock(_updateMutex);
+					if (_updates.empty())
+						break;
+
+					client = _updates.begin()->first;
+					update = _updates.begin()->second;
+					_updates.erase(_updates.begin());
+				}
+
+				try
+				{
+					send(*client, update);
+				}
+				CATCH_ALL
+			}
+		}
+		CATCH_ALL
+	}
+}
+
+void MetadataDispatcher::send(RTSPClient &client, const Update &update)
+{
+	const Payload &payload = payloadFor(update.metadata);
+
+	uint64_t &sentHash = _sentHashes[&client];
+	if (sentHash == payload.hash)
+	{
+		return;
+	}
+
+	// requests are pipelined and bodies go out from the shared payload
+	// without being copied; responses are handled by the client
+	if (update.metadataFlags & RAOPDevice::MD_TEXT)
+	{
+		client.postSetParameter("application/x-dmap-tagged", payload.tags, update.rtpTime);
+	}
+
+	if (update.metadataFlags & RAOPDevice::MD_IMAGE)
+	{
+		client.postSetParameter(payload.imageType, payload.imageData, update.rtpTime);
+	}
+
+	sentHash = payload.hash;
+}
+
+const MetadataDispatcher::Payload &MetadataDispatcher::payloadFor(
+	const std::shared_ptr<const OutputMetadata> &metadata)
+{
+	// payload is built once for all devices sent the same metadata
+	if (metadata != _payloadSource)
+	{
+		_payloadSource = metadata;
+		buildPayload(*metadata, _payload);
+	}
+
+	return _payload;
+}
+
+void MetadataDispatcher::buildPayload(const OutputMetadata &metadata, Payload &payload)
+{
+	const std::string &title = metadata.title();
+	const std::string &album = metadata.album();
+	const std::string &artist = metadata.artist();
+
+	// append metadata strings to DMAP tag buffer
+	buffer_t tags;
+	dmapAppend(tags, "mikd", int8_t(2));
+	//	dmapAppend(tags, "miid", uint32_t(0));
+	dmapAppend(tags, "minm", title.data(), title.length());
+	dmapAppend(tags, "asal", album.data(), album.length());
+	dmapAppend(tags, "asar", artist.data(), artist.length());
+	dmapAppend(tags, "asdk", int8_t(metadata.length() > 0 ? 0 : 1));
+	dmapAppend(tags, "astn", metadata.playlistPos().first);
+	dmapAppend(tags, "astc", metadata.playlistPos().second);
+
+	// wrap tags in metadata list container
+	payload.tags.clear();
+	dmapAppend(payload.tags, "mlit", &tags[0], tags.size());
+
+	// check size characteristics to prevent transmitting a dangerous image
+	bool tooBig = (metadata.artworkData().size() > ARTWORK_MAX_SIZE);
+	if (!tooBig)
+	{
+		const shorts_t dims = metadata.artworkDims();
+		if (dims.first > ARTWORK_MAX_DIMENSION || dims.second > ARTWORK_MAX_DIMENSION)
+			tooBig = true;
+	}
+
+	if (!tooBig)
+	{
+		payload.imageData = metadata.artworkData();
+		payload.imageType = metadata.artworkType();
+	}
+	else
+	{
+		payload.imageData.clear();
+		payload.imageType = "image/none";
+	}
+
+	uint64_t hash = 14695981039346656037ULL;
+	hash = hashAppend(hash, payload.tags.data(), payload.tags.size());
+	hash = hashAppend(hash, payload.imageType.data(), payload.imageType.length());
+	hash = hashAppend(hash, payload.imageData.data(), payload.imageData.size());
+	payload.hash = hash;
+}
@@ -0,0 +1,100 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef MetadataDispatcher_h
+#define MetadataDispatcher_h
+
+
+#include "OutputMetadata.h"
+#include "Platform.h"
+#include "Uncopyable.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <Poco/Event.h>
+#include <Poco/Mutex.h>
+#include <Poco/RunnableAdapter.h>
+#include <Poco/ScopedLock.h>
+#include <Poco/Thread.h>
+
+
+/**
+ * Sends track metadata and artwork to devices on its own thread.  Each track's
+ * DMAP tags and artwork are built once, on this thread, and shared by every
+ * device; a track queued for a device is dropped if another replaces it before
+ * it is sent, and a device is not sent the same content (by hash) twice.
+ */
+class MetadataDispatcher
+:
+	private Uncopyable
+{
+public:
+	MetadataDispatcher();
+	~MetadataDispatcher();
+
+	// queues metadata of given kinds (RAOPDevice::MD_TEXT and MD_IMAGE) to be
+	// applied at RTP time, and returns immediately
+	void update(class RTSPClient&, byte_t metadataFlags, const OutputMetadata&,
+		uint32_t rtpTime);
+
+	// must be called before client is destroyed
+	void removeClient(class RTSPClient&);
+
+private:
+	struct Payload
+	{
+		buffer_t tags;          // DMAP metadata list container
+		buffer_t imageData;
+		std::string imageType;
+		uint64_t hash;          // of all the above
+	};
+
+	struct Update
+	{
+		std::shared_ptr<const OutputMetadata> metadata;
+		byte_t metadataFlags;
+		uint32_t rtpTime;
+	};
+
+	void run();
+	void send(class RTSPClient&, const Update&);
+	const Payload& payloadFor(const std::shared_ptr<const OutputMetadata>&);
+
+	static void buildPayload(const OutputMetadata&, Payload&);
+
+	/** updates not yet sent, at most one per client; shares last metadata */
+	typedef std::map<class RTSPClient*, Update> UpdateMap;
+	UpdateMap _updates;
+	std::shared_ptr<const OutputMetadata> _metadata;
+	Poco::FastMutex _updateMutex;
+	Poco::Event _updateEvent;
+
+	/** payload of most recent metadata sent, and what each client has been sent */
+	std::shared_ptr<const OutputMetadata> _payloadSource;
+	Payload _payload;
+	std::map<class RTSPClient*, uint64_t> _sentHashes;
+
+	volatile bool _stopping;
+	Poco::Thread _thread;
+	Poco::RunnableAdapter<MetadataDispatcher> _runnable;
+
+	/** held while sending, so clients are not removed mid-request */
+	Poco::FastMutex _mutex;
+	typedef Poco::FastMutex::ScopedLock ScopedLock;
+};
+
+
+#endif // MetadataDispatcher_h
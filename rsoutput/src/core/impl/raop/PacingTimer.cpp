@@ -0,0 +1,185 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "PacingTimer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <Poco/Format.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+
+static const int64_t MICROSECONDS_PER_SECOND = 1000000;
+
+
+PacingTimer::Time PacingTimer::now()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// split to avoid overflow of counter * 1000000
+	const int64_t seconds = counter.QuadPart / frequency.QuadPart;
+	const int64_t remainder = counter.QuadPart % frequency.QuadPart;
+	return (seconds * MICROSECONDS_PER_SECOND)
+		+ ((remainder * MICROSECONDS_PER_SECOND) / frequency.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (static_cast<int64_t>(ts.tv_sec) * MICROSECONDS_PER_SECOND)
+		+ (ts.tv_nsec / 1000);
+#endif
+}
+
+
+PacingTimer::PacingTimer()
+{
+#ifdef _WIN32
+	// high-resolution timers are available starting with Windows 10, 1803
+	_timer = CreateWaitableTimerExW(NULL, NULL,
+		CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (_timer == NULL)
+	{
+		_timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+	}
+	if (_timer == NULL)
+	{
+		throw std::runtime_error("CreateWaitableTimerEx failed");
+	}
+#endif
+}
+
+
+PacingTimer::~PacingTimer()
+{
+#ifdef _WIN32
+	CloseHandle(_timer);
+#endif
+}
+
+
+void PacingTimer::sleepUntil(const Time deadline)
+{
+#ifdef _WIN32
+	const Time remaining = deadline - now();
+	if (remaining <= 0)
+	{
+		return;
+	}
+
+	// waitable timers measure relative due time in negative 100ns intervals
+	LARGE_INTEGER dueTime;
+	dueTime.QuadPart = -(remaining * 10);
+
+	if (!SetWaitableTimer(_timer, &dueTime, 0, NULL, NULL, FALSE))
+	{
+		throw std::runtime_error("SetWaitableTimer failed");
+	}
+	WaitForSingleObject(_timer, INFINITE);
+#else
+	struct timespec ts;
+	ts.tv_sec = static_cast<time_t>(deadline / MICROSECONDS_PER_SECOND);
+	ts.tv_nsec = static_cast<long>((deadline % MICROSECONDS_PER_SECOND) * 1000);
+
+	int result;
+	do
+	{
+		result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+	while (result == EINTR);
+
+	if (result != 0)
+	{
+		throw std::runtime_error(Poco::format(
+			"clock_nanosleep failed: %s", std::string(std::strerror(result))));
+	}
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+const int64_t LatenessHistogram::BUCKET_LIMITS[BUCKET_COUNT - 1] = {
+	100, 250, 500, 1000, 2000, 5000, 10000
+};
+
+
+LatenessHistogram::LatenessHistogram()
+{
+	reset();
+}
+
+
+void LatenessHistogram::reset()
+{
+	std::fill(_buckets, _buckets + BUCKET_COUNT, 0);
+	_count = 0;
+	_total = 0;
+	_maximum = 0;
+}
+
+
+void LatenessHistogram::record(int64_t lateness)
+{
+	if (lateness < 0)
+	{
+		lateness = 0;
+	}
+
+	const int64_t* const limit = std::upper_bound(
+		BUCKET_LIMITS, BUCKET_LIMITS + (BUCKET_COUNT - 1), lateness);
+	_buckets[limit - BUCKET_LIMITS] += 1;
+
+	_count += 1;
+	_total += lateness;
+	_maximum = (std::max)(_maximum, lateness);
+}
+
+
+std::string LatenessHistogram::toString() const
+{
+	std::string string(Poco::format("%z packets, mean %.3f ms, max %.3f ms;",
+		_count, (_count > 0 ? _total / 1000.0 / _count : 0.0), _maximum / 1000.0));
+
+	for (size_t i = 0; i < BUCKET_COUNT; i += 1)
+	{
+		if (i < BUCKET_COUNT - 1)
+		{
+			string += Poco::format(" <%.2f ms: %z", BUCKET_LIMITS[i] / 1000.0, _buckets[i]);
+		}
+		else
+		{
+			string += Poco::format(" >=%.2f ms: %z", BUCKET_LIMITS[i - 1] / 1000.0, _buckets[i]);
+		}
+	}
+
+	return string;
+}
@@ -0,0 +1,76 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PacingTimer_h
+#define PacingTimer_h
+
+
+#include "Platform.h"
+#include "Uncopyable.h"
+
+
+/**
+ * Sleeps the calling thread until an absolute deadline on the monotonic clock,
+ * which is unaffected by adjustments (such as NTP steps) to the system clock.
+ */
+class PacingTimer
+:
+	private Uncopyable
+{
+public:
+	typedef int64_t Time; // microseconds since arbitrary monotonic epoch
+
+	static Time now();
+
+	PacingTimer();
+	~PacingTimer();
+
+	void sleepUntil(Time deadline);
+
+private:
+#ifdef _WIN32
+	HANDLE _timer;
+#endif
+};
+
+
+/**
+ * Distribution of how late packets were sent relative to their deadlines.
+ */
+class LatenessHistogram
+{
+public:
+	LatenessHistogram();
+
+	void reset();
+	void record(int64_t lateness /* in microseconds */);
+
+	size_t count() const { return _count; }
+
+	std::string toString() const;
+
+private:
+	static const size_t BUCKET_COUNT = 8;
+	static const int64_t BUCKET_LIMITS[BUCKET_COUNT - 1];
+
+	size_t _buckets[BUCKET_COUNT];
+	size_t _count;
+	int64_t _total;
+	int64_t _maximum;
+};
+
+
+#endif // PacingTimer_h
@@ -20,13 +20,27 @@
 #include <stdexcept>
 
 
+static size_t alignedSlotLength(const size_t packetMaxSize)
+{
+	const size_t length = (sizeof(PacketBuffer::Slot) + packetMaxSize);
+
+	return ((length + PacketBuffer::SLOT_ALIGNMENT - 1) / PacketBuffer::SLOT_ALIGNMENT)
+		* PacketBuffer::SLOT_ALIGNMENT;
+}
+
+
 PacketBuffer::PacketBuffer(const size_t packetMaxSize, const uint16_t headLength, const uint16_t tailLength)
 :
-	_slotLength(sizeof(Slot) + packetMaxSize),
+	_slotLength(alignedSlotLength(packetMaxSize)),
 	_headLength(headLength * _slotLength),
 	_tailLength(tailLength * _slotLength),
-	_buffer(_headLength + _tailLength)
+	_bufferLength(_headLength + _tailLength),
+	_buffer(_bufferLength + SLOT_ALIGNMENT - 1)
 {
+	const uintptr_t address = reinterpret_cast<uintptr_t>(&_buffer[0]);
+	_bufferStart = &_buffer[0]
+		+ ((SLOT_ALIGNMENT - (address % SLOT_ALIGNMENT)) % SLOT_ALIGNMENT);
+
 	reset();
 }
 
@@ -62,14 +76,17 @@ PacketBuffer::Slot& PacketBuffer::nextAvailable()
 		throw std::logic_error("Can't write at this time");
 	}
 
-	byte_t* const ptr = &_buffer[_bufferWriteIndex];
+	Slot& slot = *reinterpret_cast<Slot*>(_bufferStart + _bufferWriteIndex);
 
-	std::memset(ptr, 0, _slotLength);
+	// packet data is written by the caller, so it need not be cleared
+	slot.packetSize = slot.payloadSize = slot.originalSize = 0;
+	slot.frameCount = 0;
+	slot.isFilled = false;
 
 	_bufferAvailability -= _slotLength;
-	_bufferWriteIndex = (_bufferWriteIndex + _slotLength) % _buffer.size();
+	_bufferWriteIndex = (_bufferWriteIndex + _slotLength) % _bufferLength;
 
-	return *reinterpret_cast<Slot*>(ptr);
+	return slot;
 }
 
 
@@ -80,15 +97,21 @@ PacketBuffer::Slot& PacketBuffer::nextBuffered()
 		throw std::logic_error("Can't read at this time");
 	}
 
-	byte_t* const ptr = &_buffer[_bufferReadIndex];
+	byte_t* const ptr = _bufferStart + _bufferReadIndex;
 
 	_bufferAvailability += _slotLength;
-	_bufferReadIndex = (_bufferReadIndex + _slotLength) % _buffer.size();
+	_bufferReadIndex = (_bufferReadIndex + _slotLength) % _bufferLength;
 
 	return *reinterpret_cast<Slot*>(ptr);
 }
 
 
+PacketBuffer::Slot& PacketBuffer::prevBuffered(const uint16_t tailIndex)
+{
+	return const_cast<Slot&>(static_cast<const PacketBuffer*>(this)->prevBuffered(tailIndex));
+}
+
+
 const PacketBuffer::Slot& PacketBuffer::prevBuffered(const uint16_t tailIndex) const
 {
 	if (tailIndex < 1 || tailIndex > (_tailLength / _slotLength))
@@ -99,9 +122,18 @@ const PacketBuffer::Slot& PacketBuffer::prevBuffered(const uint16_t tailIndex) c
 	const size_t indexDiff = (tailIndex * _slotLength);
 	const size_t prevIndex = (indexDiff <= _bufferReadIndex
 		? _bufferReadIndex - indexDiff
-		: _buffer.size() - (indexDiff - _bufferReadIndex));
-	assert(prevIndex <= (_buffer.size() - _slotLength));
+		: _bufferLength - (indexDiff - _bufferReadIndex));
+	assert(prevIndex <= (_bufferLength - _slotLength));
 	assert(prevIndex % _slotLength == 0);
 
-	return *reinterpret_cast<const Slot*>(&_buffer[prevIndex]);
+	return *reinterpret_cast<const Slot*>(_bufferStart + prevIndex);
+}
+
+
+const PacketBuffer::Slot& PacketBuffer::packetAt(const uint64_t packetIndex) const
+{
+	const size_t slotCount = (_bufferLength / _slotLength);
+
+	return *reinterpret_cast<const Slot*>(
+		_bufferStart + ((packetIndex % slotCount) * _slotLength));
 }
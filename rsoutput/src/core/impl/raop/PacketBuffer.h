@@ -22,11 +22,17 @@
 #include "Uncopyable.h"
 
 
+/**
+ * Ring of packet slots, each aligned to a cache line: head slots hold packets
+ * waiting to be sent and tail slots remember the most recently sent packets.
+ */
 class PacketBuffer
 :
 	private Uncopyable
 {
 public:
+	static const size_t SLOT_ALIGNMENT = 64;
+
 	PacketBuffer(size_t packetMaxSize, uint16_t headLength, uint16_t tailLength = 0);
 	~PacketBuffer();
 
@@ -40,16 +46,22 @@ public:
 		size_t payloadSize;
 		size_t originalSize; // of payload before compression, encoding or padding
 		uint16_t frameCount;
+		bool isFilled; // packet data has been produced, not just reserved
 #pragma warning(push)
 #pragma warning(disable:4200)
 		byte_t packetData[];
 #pragma warning(pop)
 	};
 
-	      Slot& nextAvailable();
+	      Slot& nextAvailable(); // only slot header fields are initialized
 	      Slot& nextBuffered();
+	      Slot& prevBuffered(uint16_t tailIndex);
 	const Slot& prevBuffered(uint16_t tailIndex) const;
 
+	// finds slot by count of packets written before it since reset; caller
+	// must ensure that packet is still in memory
+	const Slot& packetAt(uint64_t packetIndex) const;
+
 private:
 	const size_t _slotLength;
 	const size_t _headLength;
@@ -57,7 +69,9 @@ private:
 	size_t _bufferAvailability;
 	size_t _bufferReadIndex;
 	size_t _bufferWriteIndex;
+	size_t _bufferLength;
 	buffer_t _buffer;
+	byte_t* _bufferStart; // first aligned slot
 };
 
 
@@ -0,0 +1,152 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "RAOPCipher.h"
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+
+RAOPCipher::RAOPCipher()
+:
+	_context(EVP_CIPHER_CTX_new()),
+	_decryptContext(EVP_CIPHER_CTX_new()),
+	_initialized(false)
+{
+	if (_context == NULL || _decryptContext == NULL)
+	{
+		EVP_CIPHER_CTX_free(_context);
+		EVP_CIPHER_CTX_free(_decryptContext);
+
+		throw std::runtime_error("EVP_CIPHER_CTX_new failed");
+	}
+}
+
+
+RAOPCipher::~RAOPCipher()
+{
+	EVP_CIPHER_CTX_free(_context);
+	EVP_CIPHER_CTX_free(_decryptContext);
+}
+
+
+void RAOPCipher::init(const byte_t* const key, const byte_t* const iv)
+{
+	assert(key != NULL && iv != NULL);
+
+	_initialized = false;
+
+	if (!EVP_EncryptInit_ex(_context, EVP_aes_128_cbc(), NULL, key, iv))
+	{
+		throw std::runtime_error("EVP_EncryptInit_ex failed");
+	}
+
+	if (!EVP_DecryptInit_ex(_decryptContext, EVP_aes_128_cbc(), NULL, key, iv))
+	{
+		throw std::runtime_error("EVP_DecryptInit_ex failed");
+	}
+
+	// payloads are whole blocks plus clear remainder, so never pad
+	EVP_CIPHER_CTX_set_padding(_context, 0);
+	EVP_CIPHER_CTX_set_padding(_decryptContext, 0);
+
+	std::memcpy(_iv, iv, BLOCK_SIZE);
+	_initialized = true;
+}
+
+
+void RAOPCipher::encrypt(const byte_t* const input, byte_t* const output, const size_t length)
+{
+	if (!_initialized)
+	{
+		throw std::logic_error("RAOPCipher not initialized");
+	}
+
+	const size_t remainderLength = (length % BLOCK_SIZE);
+	const size_t encryptLength = (length - remainderLength);
+
+	if (encryptLength > 0)
+	{
+		// restart cipher block chaining from original initialization vector;
+		// key schedule is retained, so nothing is allocated or recomputed
+		if (!EVP_EncryptInit_ex(_context, NULL, NULL, NULL, _iv))
+		{
+			throw std::runtime_error("EVP_EncryptInit_ex failed");
+		}
+
+		int outputLength = 0;
+		if (!EVP_EncryptUpdate(_context, output, &outputLength, input, static_cast<int>(encryptLength))
+			|| static_cast<size_t>(outputLength) != encryptLength)
+		{
+			throw std::runtime_error("EVP_EncryptUpdate failed");
+		}
+	}
+
+	if (remainderLength > 0 && input != output)
+	{
+		std::memcpy(output + encryptLength, input + encryptLength, remainderLength);
+	}
+}
+
+
+void RAOPCipher::decrypt(const byte_t* const input, byte_t* const output, const size_t length)
+{
+	if (!_initialized)
+	{
+		throw std::logic_error("RAOPCipher not initialized");
+	}
+
+	const size_t remainderLength = (length % BLOCK_SIZE);
+	const size_t decryptLength = (length - remainderLength);
+
+	if (decryptLength > 0)
+	{
+		if (!EVP_DecryptInit_ex(_decryptContext, NULL, NULL, NULL, _iv))
+		{
+			throw std::runtime_error("EVP_DecryptInit_ex failed");
+		}
+
+		int outputLength = 0;
+		if (!EVP_DecryptUpdate(_decryptContext, output, &outputLength, input, static_cast<int>(decryptLength))
+			|| static_cast<size_t>(outputLength) != decryptLength)
+		{
+			throw std::runtime_error("EVP_DecryptUpdate failed");
+		}
+	}
+
+	if (remainderLength > 0 && input != output)
+	{
+		std::memcpy(output + decryptLength, input + decryptLength, remainderLength);
+	}
+}
+
+
+void RAOPCipher::convertPacket(const byte_t* const input, byte_t* const output,
+	const size_t headerLength, const size_t payloadLength, const bool encrypting)
+{
+	assert(input != output);
+
+	std::memcpy(output, input, headerLength);
+
+	if (encrypting)
+	{
+		encrypt(input + headerLength, output + headerLength, payloadLength);
+	}
+	else
+	{
+		decrypt(input + headerLength, output + headerLength, payloadLength);
+	}
+}
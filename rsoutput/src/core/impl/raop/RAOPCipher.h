@@ -0,0 +1,61 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RAOPCipher_h
+#define RAOPCipher_h
+
+
+#include "Platform.h"
+#include "Uncopyable.h"
+#include <openssl/evp.h>
+
+
+/**
+ * AES-128-CBC encryption (and decryption) of RAOP audio payloads.  Each
+ * payload is encrypted from the same initialization vector, and any trailing
+ * partial block is left in the clear.  OpenSSL's EVP layer selects hardware
+ * AES (e.g. AES-NI) automatically when the processor supports it.
+ */
+class RAOPCipher
+:
+	private Uncopyable
+{
+public:
+	static const size_t KEY_SIZE = 16;
+	static const size_t BLOCK_SIZE = 16;
+
+	RAOPCipher();
+	~RAOPCipher();
+
+	void init(const byte_t* key, const byte_t* iv);
+
+	// input and output may be the same buffer
+	void encrypt(const byte_t* input, byte_t* output, size_t length);
+	void decrypt(const byte_t* input, byte_t* output, size_t length);
+
+	// copies packet header and encrypts (or decrypts) payload that follows it
+	void convertPacket(const byte_t* input, byte_t* output,
+		size_t headerLength, size_t payloadLength, bool encrypting);
+
+private:
+	EVP_CIPHER_CTX* _context;
+	EVP_CIPHER_CTX* _decryptContext;
+	byte_t _iv[BLOCK_SIZE];
+	bool _initialized;
+};
+
+
+#endif // RAOPCipher_h
@@ -44,16 +44,39 @@
 /** maximum number of samples per channel in an RAOP audio data packet */
 extern const unsigned int RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL;
 
-/** number of samples per second for RAOP audio data */
+/** number of samples per second for RAOP audio data, unless negotiated */
 extern const unsigned int RAOP_SAMPLES_PER_SECOND;
 
-/** number of bits per sample for RAOP audio data */
+/** number of bits per sample for RAOP audio data, unless negotiated */
 extern const unsigned int RAOP_BITS_PER_SAMPLE;
 
+/** maximum number of bits per sample for RAOP audio data */
+extern const unsigned int RAOP_MAX_BITS_PER_SAMPLE;
+
 /** number of channels for RAOP audio data */
 extern const unsigned int RAOP_CHANNEL_COUNT;
 
 
+/** format of the RAOP audio data stream of a session */
+struct RAOPStreamFormat
+{
+	unsigned int samplesPerSecond;
+	unsigned int bitsPerSample;
+	unsigned int channelCount;
+	unsigned int framesPerPacket; // samples per channel in each data packet
+
+	size_t frameSize() const
+	{
+		return (channelCount * (bitsPerSample / 8));
+	}
+
+	size_t packetDataSize() const
+	{
+		return (framesPerPacket * frameSize());
+	}
+};
+
+
 //------------------------------------------------------------------------------
 
 
@@ -25,58 +25,12 @@
 #include <cmath>
 #include <cstring>
 #include <string>
-#include <Poco/ByteOrder.h>
 #include <Poco/Format.h>
 
-using Poco::ByteOrder;
 using Poco::Net::IPAddress;
 using Poco::Net::SocketAddress;
 using Poco::Net::StreamSocket;
 
-static void dmapAppend(buffer_t &buf, const char *key, const void *val, const uint32_t len)
-{
-	assert(std::strlen(key) == 4);
-
-	buffer_t::size_type idx = buf.size();
-
-	// increase capacity of buffer to accommodate key, value length and value
-	buf.resize(idx + 8 + len);
-
-	std::memcpy(&buf[idx], key, 4);
-	idx += 4;
-
-	const uint32_t length = ByteOrder::toNetwork(len);
-	std::memcpy(&buf[idx], &length, 4);
-	idx += 4;
-
-	if (len > 0)
-	{
-		std::memcpy(&buf[idx], val, len);
-		idx += len;
-	}
-
-	assert(idx == buf.size());
-}
-
-template <typename integer_t>
-inline void dmapAppend(buffer_t &buf, const char *key, integer_t val)
-{
-	val = ByteOrder::toNetwork(val);
-	dmapAppend(buf, key, &val, sizeof(integer_t));
-}
-
-template <>
-inline void dmapAppend(buffer_t &buf, const char *key, const int8_t val)
-{
-	dmapAppend(buf, key, &val, 1);
-}
-
-template <>
-inline void dmapAppend(buffer_t &buf, const char *key, const uint8_t val)
-{
-	dmapAppend(buf, key, &val, 1);
-}
-
 //------------------------------------------------------------------------------
 
 RAOPDevice::RAOPDevice(RAOPEngine &raopEngine, const std::string &publicKey,
@@ -111,6 +65,7 @@ int RAOPDevice::test(StreamSocket &socket, const bool firstTime)
 {
 	if (_rtspClient.get() == NULL || !_rtspClient->isReady())
 	{
+		releaseClient();
 		_rtspClient.reset(new RTSPClient(socket, _remoteControlId));
 	}
 
@@ -137,6 +92,7 @@ int RAOPDevice::open(StreamSocket &socket, AudioJackStatus &audioJackStatus)
 
 	if (_rtspClient.get() == NULL || !_rtspClient->isReady())
 	{
+		releaseClient();
 		_rtspClient.reset(new RTSPClient(socket, _remoteControlId));
 	}
 
@@ -154,7 +110,8 @@ int RAOPDevice::open(StreamSocket &socket, AudioJackStatus &audioJackStatus)
 	// send announce message to remote speakers
 	returnCode = _rtspClient->doAnnounce(
 		secureDataStream() ? _raopEngine._encodedKey : "",
-		secureDataStream() ? _raopEngine._encodedIV : "");
+		secureDataStream() ? _raopEngine._encodedIV : "",
+		_raopEngine._streamFormat, _raopEngine._isPCMPayload);
 	if (returnCode != RTSP_STATUS_CODE_OK)
 	{
 		return returnCode;
@@ -184,6 +141,9 @@ int RAOPDevice::open(StreamSocket &socket, AudioJackStatus &audioJackStatus)
 		return returnCode;
 	}
 
+	// session is established; later requests need not wait their turn
+	_rtspClient->attach(_raopEngine._socketReactor);
+
 	_raopEngine.attach(this);
 
 	return 0;
@@ -194,10 +154,19 @@ void RAOPDevice::close()
 	_audioLatency = 0;
 	_audioSocketAddr = _controlSocketAddr = _timingSocketAddr = SocketAddress();
 
-	// ensure RTSP client is destroyed even if detach or teardown throw
-	std::unique_ptr<RTSPClient> rtspClient(std::move(_rtspClient));
-
-	_raopEngine.detach(this);
+	// detach first so engine threads, which check if device is open, are done
+	// with it before client is released; destroy client even if detach throws
+	std::unique_ptr<RTSPClient> rtspClient;
+	try
+	{
+		_raopEngine.detach(this);
+	}
+	catch (...)
+	{
+		rtspClient = releaseClient();
+		throw;
+	}
+	rtspClient = releaseClient();
 
 	if (rtspClient.get() != NULL && rtspClient->isReady())
 	{
@@ -206,6 +175,20 @@ void RAOPDevice::close()
 	}
 }
 
+std::unique_ptr<RTSPClient> RAOPDevice::releaseClient()
+{
+	std::unique_ptr<RTSPClient> rtspClient(std::move(_rtspClient));
+
+	// scheduler and dispatcher must not send to client after it is destroyed
+	if (rtspClient.get() != NULL)
+	{
+		_raopEngine._controlScheduler.removeClient(*rtspClient);
+		_raopEngine._metadataDispatcher.removeClient(*rtspClient);
+	}
+
+	return rtspClient;
+}
+
 bool RAOPDevice::isOpen(const bool pollConnection) const
 {
 	return (_rtspClient.get() != NULL && (!pollConnection || _rtspClient->isReady()));
@@ -243,7 +226,8 @@ void RAOPDevice::putVolume(const float volume)
 
 	assert(_rtspClient.get() != NULL && _rtspClient->isReady());
 	// reiterate volume to device; some wait for echo before changing levels
-	_rtspClient->doSetParameter("volume", Poco::format("%hf", _deviceVolume));
+	_raopEngine._controlScheduler.update(*_rtspClient, ControlScheduler::VOLUME,
+		Poco::format("%hf", _deviceVolume));
 }
 
 void RAOPDevice::setVolume(const float absolute, const float relative)
@@ -267,60 +251,25 @@ void RAOPDevice::setVolume(const float absolute, const float relative)
 		decibels = -144.0f;
 
 	assert(_rtspClient.get() != NULL && _rtspClient->isReady());
-	_rtspClient->doSetParameter("volume", Poco::format("%hf", decibels));
+	// scheduler sends it, replacing any volume not yet sent, so caller moves
+	// on to next device without waiting for this one
+	_raopEngine._controlScheduler.update(*_rtspClient, ControlScheduler::VOLUME,
+		Poco::format("%hf", decibels));
 }
 
-void RAOPDevice::flush()
+std::future<int> RAOPDevice::flush()
 {
 	assert(_rtspClient.get() != NULL && _rtspClient->isReady());
-	_rtspClient->doFlush(_raopEngine._rtpSeqNumOutgoing, _raopEngine._rtpTimeOutgoing);
+	return _rtspClient->postFlush(_raopEngine._rtpSeqNumOutgoing, _raopEngine._rtpTimeOutgoing);
 }
 
 void RAOPDevice::updateMetadata(const OutputMetadata &metadata)
 {
-	const uint32_t rtpTime = _raopEngine._rtpTimeIncoming;
-
-	if (_metadataFlags & MD_TEXT)
+	if (_metadataFlags & (MD_TEXT | MD_IMAGE))
 	{
-		const std::string &title = metadata.title();
-		const std::string &album = metadata.album();
-		const std::string &artist = metadata.artist();
-
-		// append metadata strings to DMAP tag buffer
-		buffer_t tags;
-		dmapAppend(tags, "mikd", int8_t(2));
-		//	dmapAppend(tags, "miid", uint32_t(0));
-		dmapAppend(tags, "minm", &title[0], title.length());
-		dmapAppend(tags, "asal", &album[0], album.length());
-		dmapAppend(tags, "asar", &artist[0], artist.length());
-		dmapAppend(tags, "asdk", int8_t(metadata.length() > 0 ? 0 : 1));
-		dmapAppend(tags, "astn", metadata.playlistPos().first);
-		dmapAppend(tags, "astc", metadata.playlistPos().second);
-
-		// wrap tags in metadata list container
-		buffer_t mlit;
-		dmapAppend(mlit, "mlit", &tags[0], tags.size());
-
-		assert(_rtspClient.get() != NULL && _rtspClient->isReady());
-		_rtspClient->doSetParameter("application/x-dmap-tagged", mlit, rtpTime);
-	}
-
-	if (_metadataFlags & MD_IMAGE)
-	{
-		// check size characteristics to prevent transmitting a dangerous image
-		bool tooBig = (metadata.artworkData().size() > 262144); // 256 KB
-		if (!tooBig)
-		{
-			const shorts_t dims = metadata.artworkDims();
-			if (dims.first > 1000 || dims.second > 1000)
-				tooBig = true;
-		}
-
-		const buffer_t &imageData = (!tooBig ? metadata.artworkData() : buffer_t());
-		const std::string &imageType = (!tooBig ? metadata.artworkType() : "image/none");
-
 		assert(_rtspClient.get() != NULL && _rtspClient->isReady());
-		_rtspClient->doSetParameter(imageType, imageData, rtpTime);
+		_raopEngine._metadataDispatcher.update(*_rtspClient, _metadataFlags, metadata,
+			_raopEngine._rtpTimeIncoming);
 	}
 }
 
@@ -333,6 +282,7 @@ void RAOPDevice::updateProgress(const OutputInterval &interval)
 		const uint32_t pos = _raopEngine._rtpTimeIncoming;
 
 		assert(_rtspClient.get() != NULL && _rtspClient->isReady());
-		_rtspClient->doSetParameter("progress", Poco::format("%u/%u/%u", beg, pos, end));
+		_raopEngine._controlScheduler.update(*_rtspClient, ControlScheduler::PROGRESS,
+			Poco::format("%u/%u/%u", beg, pos, end));
 	}
 }
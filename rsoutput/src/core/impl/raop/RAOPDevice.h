@@ -21,6 +21,7 @@
 #include "Platform.h"
 #include "Uncopyable.h"
 #include "impl/Device.h"
+#include <future>
 #include <memory>
 #include <string>
 #include <Poco/Net/SocketAddress.h>
@@ -53,7 +54,8 @@ public:
 	int open(Poco::Net::StreamSocket&, AudioJackStatus&);
 	bool isOpen(bool pollConnection = true) const;
 	void close();
-	void flush();
+	// future yields status code once device acknowledges
+	std::future<int> flush();
 
 	float getVolume();
 	void putVolume(float);
@@ -71,6 +73,8 @@ public:
 	const Poco::Net::SocketAddress& timingSocketAddr() const;
 
 private:
+	std::unique_ptr<class RTSPClient> releaseClient();
+
 	              class RAOPEngine& _raopEngine;
 	std::unique_ptr<class RTSPClient> _rtspClient;
 
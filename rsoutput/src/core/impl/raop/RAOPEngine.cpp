@@ -19,17 +19,20 @@
 #endif
 
 #include "Debugger.h"
+#include "Options.h"
 #include "Platform.h"
 #include "Random.h"
 #include "RAOPDefs.h"
 #include "RAOPDevice.h"
 #include "RAOPEngine.h"
+#include "RTSPClient.h"
 #include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstring>
 #include <ctime>
 #include <functional>
+#include <future>
 #include <limits>
 #include <stdexcept>
 #include <string>
@@ -37,7 +40,10 @@
 #if defined(_WIN32)
 #include <mswsock.h>
 #endif
-#include <openssl/aes.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RAOP_ENGINE_SSE2
+#endif
 #include <openssl/evp.h>
 #include <openssl/rsa.h>
 #include <Poco/ByteOrder.h>
@@ -72,26 +78,83 @@ static const uint16_t LOCAL_TIMING_PORT = 6002;
 static const uint16_t PACKET_BUFFER_COUNT = 250;
 static const uint16_t PACKET_MEMORY_COUNT = 500;
 
+// buffer approximately 64 milliseconds of audio data ahead of the encoder
+static const uint16_t PCM_BUFFER_COUNT = 8;
+
+// maximum time for encoder to wait for audio data or a free packet slot
+static const long ENCODER_WAIT_MSEC = 10;
+
+// maximum time for sender to wait for encoded packets while idle
+static const long SENDER_WAIT_MSEC = 10;
+
+// devices that fall behind are sent several older packets per new packet, but
+// only from within a window of about a second, which is less than their latency
+static const uint16_t CATCH_UP_PACKET_LIMIT = 4;
+static const uint16_t CATCH_UP_PACKET_WINDOW = 125;
+
+// devices that fail to accept a data packet are skipped for a growing interval
+static const int64_t SEND_BACKOFF_MIN_USEC = 8000;
+static const int64_t SEND_BACKOFF_MAX_USEC = 1000000;
+
+// adaptive encoder effort is lowered when packets are encoded after their
+// deadline or average encode time exceeds a share of packet duration, and
+// raised again once average encode time has stayed low for about a second;
+// alac-effort-bench puts each level up to default at no more than about 3.5
+// times the encode time of the one below, so a level raised from under 10%
+// stays well under the 50% at which it would be lowered again
+static const int64_t ADAPTIVE_EFFORT_AVERAGING = 16;
+static const int64_t ADAPTIVE_EFFORT_LOWER_PERCENT = 50;
+static const int64_t ADAPTIVE_EFFORT_RAISE_PERCENT = 10;
+static const unsigned int ADAPTIVE_EFFORT_HOLD_PACKETS = 32;
+static const unsigned int ADAPTIVE_EFFORT_RAISE_PACKETS = 125;
+
+// audio latency of remote speakers, and how far behind RTP time sync packets
+// tell them to play (two seconds of buffered packets less that latency)
+static const int64_t AUDIO_LATENCY_MSEC = 250;
+static const int64_t SYNC_LATENCY_MSEC = 1750;
+
+// interval between sync packets and between packet lateness reports
+static const int64_t SYNC_INTERVAL_USEC = 1000000;
+static const int64_t LATENESS_REPORT_INTERVAL_USEC = 30000000;
+
 const unsigned int RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL = 352;
 const unsigned int RAOP_SAMPLES_PER_SECOND = 44100;
 const unsigned int RAOP_BITS_PER_SAMPLE = 16;
+const unsigned int RAOP_MAX_BITS_PER_SAMPLE = 24;
 const unsigned int RAOP_CHANNEL_COUNT = 2;
 
+// buffers are sized for the largest stream format a session may negotiate
 static const size_t RAOP_PACKET_MAX_DATA_SIZE =
-	(RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL * (RAOP_BITS_PER_SAMPLE / 8) * RAOP_CHANNEL_COUNT);
+	(RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL * (RAOP_MAX_BITS_PER_SAMPLE / 8) * RAOP_CHANNEL_COUNT);
 
 static const size_t RAOP_PACKET_MAX_SIZE =
 	(RTP_DATA_HEADER_SIZE + RAOP_PACKET_MAX_DATA_SIZE + 80 /* <-- ALAC encoder headroom */);
 
-static inline AudioFormatDescription alac_in_format()
+// worst-case ALAC encoder output, before it falls back to an uncompressed frame
+// (matches the bound ALACEncoder uses for its own work buffer)
+static const size_t ALAC_ENCODER_MAX_OUTPUT_SIZE =
+	(RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL * RAOP_CHANNEL_COUNT * ((10 + 32) / 8) + 1);
+
+static inline RAOPStreamFormat raop_stream_format(const OutputFormat &format)
+{
+	RAOPStreamFormat rsf;
+
+	rsf.samplesPerSecond = format.sampleRate();
+	rsf.bitsPerSample = format.sampleSize() * 8;
+	rsf.channelCount = format.channelCount();
+	rsf.framesPerPacket = RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL;
+
+	return rsf;
+}
+static inline AudioFormatDescription alac_in_format(const RAOPStreamFormat &format)
 {
 	AudioFormatDescription afd;
 
 	afd.mFormatID = kALACFormatLinearPCM;
 	afd.mFormatFlags = kALACFormatFlagIsSignedInteger | kALACFormatFlagIsPacked;
-	afd.mSampleRate = RAOP_SAMPLES_PER_SECOND;
-	afd.mBitsPerChannel = RAOP_BITS_PER_SAMPLE;
-	afd.mChannelsPerFrame = RAOP_CHANNEL_COUNT;
+	afd.mSampleRate = format.samplesPerSecond;
+	afd.mBitsPerChannel = format.bitsPerSample;
+	afd.mChannelsPerFrame = format.channelCount;
 	afd.mFramesPerPacket = 1;
 	afd.mReserved = 0;
 
@@ -100,16 +163,16 @@ static inline AudioFormatDescription alac_in_format()
 
 	return afd;
 }
-static inline AudioFormatDescription alac_out_format()
+static inline AudioFormatDescription alac_out_format(const RAOPStreamFormat &format)
 {
 	AudioFormatDescription afd;
 
 	afd.mFormatID = kALACFormatAppleLossless;
-	afd.mFormatFlags = 1;
-	afd.mSampleRate = RAOP_SAMPLES_PER_SECOND;
+	afd.mFormatFlags = (format.bitsPerSample == 24 ? 3 : 1); // source bit depth (1 = 16, 3 = 24)
+	afd.mSampleRate = format.samplesPerSecond;
 	afd.mBitsPerChannel = 0;
-	afd.mChannelsPerFrame = RAOP_CHANNEL_COUNT;
-	afd.mFramesPerPacket = RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL;
+	afd.mChannelsPerFrame = format.channelCount;
+	afd.mFramesPerPacket = format.framesPerPacket;
 	afd.mReserved = 0;
 
 	afd.mBytesPerFrame = 0;
@@ -117,8 +180,6 @@ static inline AudioFormatDescription alac_out_format()
 
 	return afd;
 }
-static const AudioFormatDescription ALAC_IN_FORMAT(alac_in_format());
-static const AudioFormatDescription ALAC_OUT_FORMAT(alac_out_format());
 
 //------------------------------------------------------------------------------
 
@@ -149,6 +210,50 @@ static void bindToNextAvailablePort(DatagramSocket &socket, uint16_t port)
 	}
 }
 
+// tests whether audio data is digital silence (all samples zero); near-silent
+// audio is still encoded, so that output remains lossless
+static bool isSilence(const byte_t *const buffer, const size_t length)
+{
+	size_t i = 0;
+
+#ifdef RAOP_ENGINE_SSE2
+	__m128i bits = _mm_setzero_si128();
+	for (; i + 64 <= length; i += 64)
+	{
+		const __m128i *const block = reinterpret_cast<const __m128i *>(buffer + i);
+		bits = _mm_or_si128(bits, _mm_or_si128(
+			_mm_or_si128(_mm_loadu_si128(block + 0), _mm_loadu_si128(block + 1)),
+			_mm_or_si128(_mm_loadu_si128(block + 2), _mm_loadu_si128(block + 3))));
+	}
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128())) != 0xFFFF)
+	{
+		return false;
+	}
+#else
+	uint64_t bits = 0;
+	for (; i + sizeof(bits) <= length; i += sizeof(bits))
+	{
+		uint64_t word;
+		std::memcpy(&word, buffer + i, sizeof(word));
+		bits |= word;
+	}
+	if (bits != 0)
+	{
+		return false;
+	}
+#endif
+
+	for (; i < length; i += 1)
+	{
+		if (buffer[i] != 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static void sendTo(DatagramSocket &socket, const SocketAddress &address,
 				   const void *const buffer, const size_t length)
 {
@@ -164,39 +269,63 @@ static void sendTo(DatagramSocket &socket, const SocketAddress &address,
 
 //------------------------------------------------------------------------------
 
-const OutputFormat &RAOPEngine::outputFormat()
+const OutputFormat &RAOPEngine::defaultOutputFormat()
 {
 	static const OutputFormat format(SampleRate(RAOP_SAMPLES_PER_SECOND),
 									 SampleSize(RAOP_BITS_PER_SAMPLE / 8), ChannelCount(RAOP_CHANNEL_COUNT));
 	return format;
 }
 
-int64_t RAOPEngine::samplesToMicroseconds(const int64_t samples)
+int64_t RAOPEngine::samplesToMicroseconds(const int64_t samples) const
 {
 	static const int64_t MICROSECONDS_PER_SECOND = 1000000;
 
-	return ((samples * MICROSECONDS_PER_SECOND) / RAOP_SAMPLES_PER_SECOND);
+	return ((samples * MICROSECONDS_PER_SECOND) / _streamFormat.samplesPerSecond);
 }
 
-int32_t RAOPEngine::samplesToMilliseconds(const int64_t samples)
+int32_t RAOPEngine::samplesToMilliseconds(const int64_t samples) const
 {
 	static const int64_t MILLISECONDS_PER_SECOND = 1000;
 
-	return static_cast<int32_t>((samples * MILLISECONDS_PER_SECOND) / RAOP_SAMPLES_PER_SECOND);
+	return static_cast<int32_t>((samples * MILLISECONDS_PER_SECOND) / _streamFormat.samplesPerSecond);
+}
+
+uint32_t RAOPEngine::millisecondsToSamples(const int64_t milliseconds) const
+{
+	static const int64_t MILLISECONDS_PER_SECOND = 1000;
+
+	return static_cast<uint32_t>((milliseconds * _streamFormat.samplesPerSecond) / MILLISECONDS_PER_SECOND);
 }
 
 //------------------------------------------------------------------------------
 
 RAOPEngine::RAOPEngine(OutputObserver &outputObserver)
-	: _aesIV(16),
-	  _audioLatency(11025),
+	: _aesIV(RAOPCipher::BLOCK_SIZE),
 	  _outputObserver(outputObserver),
+	  _pcmData(RAOP_PACKET_MAX_DATA_SIZE, PCM_BUFFER_COUNT),
 	  _rtpDataSecured(RAOP_PACKET_MAX_SIZE, PACKET_BUFFER_COUNT, PACKET_MEMORY_COUNT),
 	  _rtpDataUnsecured(RAOP_PACKET_MAX_SIZE, PACKET_BUFFER_COUNT, PACKET_MEMORY_COUNT),
+	  _securedDeviceCount(0),
+	  _unsecuredDeviceCount(0),
+	  _skippedEncodeCount(0),
+	  _outputFormat(defaultOutputFormat()),
+	  _streamFormat(raop_stream_format(_outputFormat)),
+	  _isPCMPayload(false),
+	  _audioLatency(millisecondsToSamples(AUDIO_LATENCY_MSEC)),
+	  _encodeScratch(ALAC_ENCODER_MAX_OUTPUT_SIZE),
+	  _encoderEffort(Options::ENCODER_EFFORT_DEFAULT),
+	  _encodeTimeAverage(0),
+	  _adaptivePacketCount(0),
 	  _controlRequestHandler(*this, &RAOPEngine::handleControlRequest),
 	  _timingRequestHandler(*this, &RAOPEngine::handleTimingRequest),
 	  _reactorThread("RAOPEngine.SocketReactor::run"),
-	  _senderThread("RAOPEngine::run")
+	  _senderThread("RAOPEngine::run"),
+	  _encoderThread("RAOPEngine::encode"),
+	  _encoderRunnable(*this, &RAOPEngine::encode),
+	  _dataBatch(_dataSocket),
+	  _variantScratchCount(0),
+	  _resendService(_controlSocket, _rtpDataSecured, _rtpDataUnsecured, PACKET_MEMORY_COUNT,
+					 _memoryMutex)
 {
 	// seed random number generator
 	Random::seed(static_cast<unsigned int>(std::time(NULL)));
@@ -303,24 +432,33 @@ RAOPEngine::~RAOPEngine()
 	CATCH_ALL
 }
 
-void RAOPEngine::reinit(OutputInterval &outputInterval)
+void RAOPEngine::reinit(OutputInterval &outputInterval, const OutputFormat &outputFormat, const bool pcmPayload)
 {
-	// stop sending data and sync packets
+	// stop encoding and sending data and sync packets
 	stop();
 
 	// test thread states
 	assert(_reactorThread.isRunning());
 	assert(!_senderThread.isRunning());
+	assert(!_encoderThread.isRunning());
+
+	// stream format is negotiated per session; it must be one the encoder and
+	// stream buffers are able to carry
+	if ((outputFormat.sampleSize() != 2 && outputFormat.sampleSize() != 3)
+		|| outputFormat.sampleEncoding() != SampleEncoding::INTEGER
+		|| outputFormat.channelCount() != static_cast<int>(RAOP_CHANNEL_COUNT)
+		|| outputFormat.sampleRate() > 192000)
+	{
+		throw std::invalid_argument("Unsupported RAOP stream format");
+	}
+	_outputFormat = outputFormat;
+	_streamFormat = raop_stream_format(outputFormat);
+	_audioLatency = millisecondsToSamples(AUDIO_LATENCY_MSEC);
 
 	// generate new AES encryption key
-	buffer_t key(16);
+	buffer_t key(RAOPCipher::KEY_SIZE);
 	Random::fill(&key[0], key.size());
 
-	if (AES_set_encrypt_key(&key[0], key.size() * 8, &_aesKey))
-	{
-		throw std::runtime_error("AES_set_encrypt_key failed");
-	}
-
 	// RSA encrypt AES key
 	buffer_t encryptedKey(RSA_size(rsaKey()));
 	const int encryptedKeyLength = RSA_public_encrypt(
@@ -374,6 +512,10 @@ void RAOPEngine::reinit(OutputInterval &outputInterval)
 	}
 	_encodedIV.assign(&encodedIV[0], encodedIV.size());
 
+	// set up cipher once; each packet restarts from same key and IV
+	_aesCipher.init(&key[0], &_aesIV[0]);
+	_aesDemandCipher.init(&key[0], &_aesIV[0]);
+
 	// generate new starting RTP packet sequence number
 	uint16_t rtpSeqNum;
 	Random::fill(&rtpSeqNum, sizeof(uint16_t));
@@ -406,16 +548,49 @@ void RAOPEngine::reinit(OutputInterval &outputInterval)
 	Random::fill(&_rtpSsrc, sizeof(uint32_t));
 
 	// reinitialize remaining object state
-	_firstDataTime = _lastClockSyncTime = _lastStreamSyncTime = 0;
+	_firstDataTime = _lastStreamSyncTime = 0;
+	_lastClockSyncTime = 0;
 	_isFirstDataPacket = _isFirstSyncPacket = true;
+	_isStreamStarted = false;
+	_pcmData.reset(_streamFormat.packetDataSize());
 	_rtpDataUnsecured.reset();
 	_rtpDataSecured.reset();
 	_raopDevices.clear();
+	_transmitStates.clear();
+	_resendService.clearDevices();
+	_resendService.reset(_rtpSeqNumOutgoing);
+	countStreamVariants();
 	_samplesWritten = 0;
 
+	// choose between one sendmmsg per data packet or one sendto per device
+	const Options::SharedPtr options = Options::getOptions();
+	_dataBatch.setBatching(options.isNull() || options->getBatchedSend());
+	_dataBatch.resetCounts();
+	_resendService.init(&key[0], &_aesIV[0], _dataBatch.isBatching());
+	_maxSendFailures = (options.isNull() ? 0 : options->getMaxSendFailures());
+
+	// devices announce payload format of stream as it is set here; devices
+	// that accept uncompressed audio accept it only as L16
+	_isPCMPayload = (pcmPayload && _streamFormat.bitsPerSample == 16);
+	Debugger::printf("Streaming audio as %s payloads; sample rate = %u Hz, sample size = %u bits.",
+					 (_isPCMPayload ? "uncompressed (PCM)" : "ALAC"),
+					 _streamFormat.samplesPerSecond, _streamFormat.bitsPerSample);
+
+	_silencePayloadSecured.clear();
+	_silencePayloadUnsecured.clear();
+	_skippedEncodeCount = 0;
+
+	// trade compression for encoder CPU time as configured; adaptive effort
+	// starts at the default and is adjusted by the encoder thread
+	_encoderEffort = (options.isNull() ? Options::ENCODER_EFFORT_DEFAULT : options->getEncoderEffort());
+	_encodeTimeAverage = 0;
+	_adaptivePacketCount = 0;
+
 	_alacEncoder.reset(new ALACEncoder);
-	_alacEncoder->SetFrameSize(ALAC_OUT_FORMAT.mFramesPerPacket);
-	const int32_t result = _alacEncoder->InitializeEncoder(ALAC_OUT_FORMAT);
+	_alacEncoder->SetFrameSize(_streamFormat.framesPerPacket);
+	_alacEncoder->SetEffort(_encoderEffort == Options::ENCODER_EFFORT_ADAPTIVE ? ALACEncoder::kEffortDefault
+																			   : static_cast<ALACEncoder::Effort>(_encoderEffort));
+	const int32_t result = _alacEncoder->InitializeEncoder(alac_out_format(_streamFormat));
 	assert(result == 0);
 }
 
@@ -428,9 +603,9 @@ OutputInterval RAOPEngine::getOutputInterval(const time_t length, const time_t o
 	const uint64_t maxTime = static_cast<uint64_t>((std::numeric_limits<uint32_t>::max)());
 
 	const uint64_t lengthSamples =
-		(length * static_cast<uint64_t>(RAOP_SAMPLES_PER_SECOND)) / 1000;
+		(length * static_cast<uint64_t>(_streamFormat.samplesPerSecond)) / 1000;
 	const uint64_t offsetSamples =
-		(offset * static_cast<uint64_t>(RAOP_SAMPLES_PER_SECOND)) / 1000;
+		(offset * static_cast<uint64_t>(_streamFormat.samplesPerSecond)) / 1000;
 
 	const uint32_t beg = static_cast<uint32_t>(
 		(rtpTime - offsetSamples) % (maxTime + 1));
@@ -440,6 +615,21 @@ OutputInterval RAOPEngine::getOutputInterval(const time_t length, const time_t o
 	return OutputInterval(beg, end);
 }
 
+const OutputFormat &RAOPEngine::outputFormat() const
+{
+	return _outputFormat;
+}
+
+bool RAOPEngine::isPCMPayload() const
+{
+	return _isPCMPayload;
+}
+
+uint64_t RAOPEngine::skippedEncodeCount() const
+{
+	return _skippedEncodeCount.load(std::memory_order_relaxed);
+}
+
 uint16_t RAOPEngine::controlPort() const
 {
 	return _controlSocket.address().port();
@@ -458,7 +648,7 @@ time_t RAOPEngine::latency(const OutputFormat &format) const
 	}
 
 	const time_t bufferLatency = samplesToMilliseconds(
-		PACKET_BUFFER_COUNT * RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL);
+		(PCM_BUFFER_COUNT + PACKET_BUFFER_COUNT) * _streamFormat.framesPerPacket);
 	const time_t deviceLatency = samplesToMilliseconds(_audioLatency);
 
 	return (bufferLatency + deviceLatency);
@@ -473,91 +663,215 @@ size_t RAOPEngine::canWrite() const
 {
 	ScopedLock lock(_mutex);
 
-	return (!_raopDevices.empty() && _rtpDataSecured.canWrite() ? RAOP_PACKET_MAX_DATA_SIZE : 0);
+	return (!_raopDevices.empty() && _pcmData.canWrite() ? _streamFormat.packetDataSize() : 0);
 }
 
-void RAOPEngine::write(const byte_t *buffer, size_t length)
+void RAOPEngine::write(const byte_t *const buffer, const size_t length)
 {
-	if (buffer == NULL || length == 0 || length > RAOP_PACKET_MAX_DATA_SIZE)
+	const size_t packetDataSize = _streamFormat.packetDataSize();
+	if (buffer == NULL || length == 0 || length > packetDataSize)
 	{
 		throw std::invalid_argument(
-			"buffer == NULL || length == 0 || length > RAOP_PACKET_MAX_DATA_SIZE");
+			"buffer == NULL || length == 0 || length > packetDataSize");
 	}
 
-	ScopedLock lock(_mutex);
+	if (length < packetDataSize)
+	{
+		Debugger::printf("Recovering from %i-byte audio segment by padding it with %i bytes (%.3f ms) of silence.",
+						 length, packetDataSize - length, samplesToMicroseconds((packetDataSize - length) / _streamFormat.frameSize()) * 0.001f);
+	}
+
+	// hand audio data off to encoder; it is padded with silence as necessary
+	_pcmData.push(buffer, length);
+	_encoderEvent.set();
+
+	ScopedLock threadLock(_threadMutex);
+
+	if (!_isStreamStarted)
+	{
+		_isStreamStarted = true;
+
+		// start encoding and sending data and sync packets when first data is written
+		start();
+	}
+}
+
+void RAOPEngine::encodePacket(const byte_t *const buffer, const size_t length,
+							  PacketBuffer::Slot &sslotRef, PacketBuffer::Slot &uslotRef,
+							  const uint16_t seqNum, const uint32_t rtpTime, const bool marker,
+							  const bool fillSecured, const bool fillUnsecured,
+							  const PacingTimer::Time deadline)
+{
+	assert(length > 0 && length <= _streamFormat.packetDataSize());
+	assert(fillSecured || fillUnsecured);
 
-	PacketBuffer::Slot &sslotRef = _rtpDataSecured.nextAvailable();
-	PacketBuffer::Slot &uslotRef = _rtpDataUnsecured.nextAvailable();
 	sslotRef.originalSize = uslotRef.originalSize = length;
 
 	DataPacketHeader packetHeader;
-	packetHeader.setMarker(_isFirstDataPacket);
+	packetHeader.setMarker(marker);
 	packetHeader.setPayloadType(PAYLOAD_TYPE_STREAM_DATA);
-	packetHeader.seqNum = _rtpSeqNumIncoming;
-	packetHeader.rtpTime = _rtpTimeIncoming;
+	packetHeader.seqNum = seqNum;
+	packetHeader.rtpTime = rtpTime;
 	packetHeader.ssrc = _rtpSsrc;
 	ByteOrder_toNetwork(packetHeader);
 
+	// headers and sizes are always filled in, so either variant can be produced later
 	std::memcpy(sslotRef.packetData, &packetHeader, RTP_DATA_HEADER_SIZE);
 	std::memcpy(uslotRef.packetData, &packetHeader, RTP_DATA_HEADER_SIZE);
 	byte_t *const securedPacketPtr = &sslotRef.packetData[RTP_DATA_HEADER_SIZE];
 	byte_t *const unsecuredPacketPtr = &uslotRef.packetData[RTP_DATA_HEADER_SIZE];
 
-	std::shared_ptr<void> buf;
-	if (length < RAOP_PACKET_MAX_DATA_SIZE)
+	// audio queue blocks are always padded with silence to full packet size;
+	// silent packets are copied from a payload that is encoded (and encrypted)
+	// once per stream, since the encryption IV is the same for each packet
+	int32_t dataLength;
+	if (isSilence(buffer, _streamFormat.packetDataSize()))
 	{
-		Debugger::printf("Recovering from %i-byte audio segment by padding it with %i bytes (%.3f ms) of silence.",
-						 length, RAOP_PACKET_MAX_DATA_SIZE - length, samplesToMicroseconds((RAOP_PACKET_MAX_DATA_SIZE - length) / 4) * 0.001f);
+		if (_silencePayloadUnsecured.empty())
+		{
+			dataLength = encodeAudio(buffer, deadline);
+			_silencePayloadUnsecured.assign(_encodeScratch.begin(), _encodeScratch.begin() + dataLength);
 
-		buf.reset(std::calloc(1, RAOP_PACKET_MAX_DATA_SIZE), std::free);
-		std::memcpy(buf.get(), buffer, length);
+			_silencePayloadSecured.resize(dataLength);
+			_aesCipher.encrypt(&_silencePayloadUnsecured[0], &_silencePayloadSecured[0], dataLength);
+		}
 
-		buffer = (const byte_t *)buf.get();
-		length = RAOP_PACKET_MAX_DATA_SIZE;
+		dataLength = static_cast<int32_t>(_silencePayloadUnsecured.size());
+		if (fillSecured)
+		{
+			std::memcpy(securedPacketPtr, &_silencePayloadSecured[0], dataLength);
+		}
+		if (fillUnsecured)
+		{
+			std::memcpy(unsecuredPacketPtr, &_silencePayloadUnsecured[0], dataLength);
+		}
+
+		_skippedEncodeCount += 1;
 	}
+	else
+	{
+		dataLength = encodeAudio(buffer, deadline);
 
-	// fill in unsecured packet payload with encoded audio data
-	int32_t dataLength = length;
-	_alacEncoder->Encode(ALAC_IN_FORMAT, ALAC_OUT_FORMAT, (byte_t *)buffer, unsecuredPacketPtr, &dataLength);
-	assert(dataLength > 0 && dataLength <= (RAOP_PACKET_MAX_SIZE - RTP_DATA_HEADER_SIZE)); // check for overrun
+		// encrypt audio data into secured packet payload
+		if (fillSecured)
+		{
+			_aesCipher.encrypt(&_encodeScratch[0], securedPacketPtr, dataLength);
+		}
+		if (fillUnsecured)
+		{
+			std::memcpy(unsecuredPacketPtr, &_encodeScratch[0], dataLength);
+		}
+	}
 
 	sslotRef.payloadSize = uslotRef.payloadSize = dataLength;
 	sslotRef.packetSize = uslotRef.packetSize = RTP_DATA_HEADER_SIZE + dataLength;
-	const size_t frameSize = (RAOP_CHANNEL_COUNT * (RAOP_BITS_PER_SAMPLE / 8));
-	assert((length / frameSize) <= (std::numeric_limits<uint16_t>::max)());
-	sslotRef.frameCount = uslotRef.frameCount = uint16_t(length / frameSize);
+	assert(_streamFormat.framesPerPacket <= (std::numeric_limits<uint16_t>::max)());
+	sslotRef.frameCount = uslotRef.frameCount = uint16_t(_streamFormat.framesPerPacket);
 
-	// make copy of initialization vector because it gets modified
-	buffer_t iv(_aesIV);
+	sslotRef.isFilled = fillSecured;
+	uslotRef.isFilled = fillUnsecured;
+}
 
-	// encrypt audio data into secured packet payload
-	const size_t remainderLength = uslotRef.payloadSize % AES_BLOCK_SIZE;
-	const size_t encryptLength = uslotRef.payloadSize - remainderLength;
-	AES_cbc_encrypt(
-		unsecuredPacketPtr,
-		securedPacketPtr,
-		encryptLength,
-		&_aesKey, &iv[0], AES_ENCRYPT);
-	std::memcpy(
-		securedPacketPtr + encryptLength,
-		unsecuredPacketPtr + encryptLength,
-		remainderLength);
+int32_t RAOPEngine::encodeAudio(const byte_t *const buffer, const PacingTimer::Time deadline)
+{
+	if (_isPCMPayload)
+	{
+		// L16 payload is the audio data itself in network byte order
+		assert(_streamFormat.bitsPerSample == 16);
+		const size_t packetDataSize = _streamFormat.packetDataSize();
+		for (size_t i = 0; i < packetDataSize; i += sizeof(int16_t))
+		{
+			int16_t sample;
+			std::memcpy(&sample, buffer + i, sizeof(int16_t));
+			sample = ByteOrder::toNetwork(sample);
+			std::memcpy(&_encodeScratch[i], &sample, sizeof(int16_t));
+		}
+		return static_cast<int32_t>(packetDataSize);
+	}
 
-	// increment RTP packet sequence number
-	_rtpSeqNumIncoming += 1;
+	const bool isAdaptive = (_encoderEffort == Options::ENCODER_EFFORT_ADAPTIVE);
+	const PacingTimer::Time startTime = (isAdaptive ? PacingTimer::now() : 0);
 
-	// increment RTP time (one tick for each frame)
-	_rtpTimeIncoming += uslotRef.frameCount;
+	// encoder writes speculatively past the size of an uncompressed frame
+	// before it falls back to one, so it is given room for its worst case
+	int32_t dataLength = static_cast<int32_t>(_streamFormat.packetDataSize());
+	_alacEncoder->Encode(alac_in_format(_streamFormat), alac_out_format(_streamFormat),
+						 (byte_t *)buffer, &_encodeScratch[0], &dataLength);
+	assert(dataLength > 0 && dataLength <= (RAOP_PACKET_MAX_SIZE - RTP_DATA_HEADER_SIZE)); // check for overrun
 
-	if (_isFirstDataPacket)
+	if (isAdaptive)
 	{
-		_isFirstDataPacket = false;
+		const PacingTimer::Time endTime = PacingTimer::now();
+		adaptEncoderEffort(endTime - startTime, deadline != 0 && endTime > deadline);
+	}
 
-		// start sending data and sync packets when first data is written
-		start();
+	return dataLength;
+}
+
+void RAOPEngine::adaptEncoderEffort(const int64_t encodeTime, const bool isLate)
+{
+	static const char *const EFFORT_NAMES[] = {"uncompressed", "fast", "default"};
+
+	const int64_t packetTime = samplesToMicroseconds(_streamFormat.framesPerPacket);
+	const int effort = _alacEncoder->GetEffort();
+
+	_encodeTimeAverage += (encodeTime - _encodeTimeAverage) / ADAPTIVE_EFFORT_AVERAGING;
+	_adaptivePacketCount += 1;
+
+	int change = 0;
+	if ((isLate && _adaptivePacketCount >= ADAPTIVE_EFFORT_HOLD_PACKETS) ||
+		_encodeTimeAverage > (packetTime * ADAPTIVE_EFFORT_LOWER_PERCENT) / 100)
+	{
+		change = (effort > ALACEncoder::kEffortUncompressed ? -1 : 0);
+	}
+	else if (_encodeTimeAverage < (packetTime * ADAPTIVE_EFFORT_RAISE_PERCENT) / 100 &&
+			 _adaptivePacketCount >= ADAPTIVE_EFFORT_RAISE_PACKETS)
+	{
+		change = (effort < ALACEncoder::kEffortDefault ? +1 : 0);
+	}
+
+	if (change != 0)
+	{
+		_alacEncoder->SetEffort(static_cast<ALACEncoder::Effort>(effort + change));
+		_encodeTimeAverage = 0;
+		_adaptivePacketCount = 0;
+
+		Debugger::printf("Encoder effort %s to %s (%s).", (change < 0 ? "lowered" : "raised"),
+						 EFFORT_NAMES[effort + change], (isLate ? "packet encoded after its deadline" : "encode time"));
 	}
 }
 
+const byte_t *RAOPEngine::packetFromMemory(const uint16_t age, const bool secured)
+{
+	const PacketBuffer::Slot &slotRef =
+		(secured ? _rtpDataSecured : _rtpDataUnsecured).prevBuffered(age);
+	if (slotRef.isFilled)
+	{
+		return slotRef.packetData;
+	}
+
+	// produce missing variant from the other, e.g. for a device that was
+	// attached after the packet was encoded; it goes into scratch memory
+	// because sent packets are read by the resend service without locking
+	const PacketBuffer::Slot &otherRef =
+		(secured ? _rtpDataUnsecured : _rtpDataSecured).prevBuffered(age);
+	if (!otherRef.isFilled)
+	{
+		throw std::logic_error("Packet in memory has neither variant filled");
+	}
+
+	if (_variantScratchCount == _variantScratch.size())
+	{
+		_variantScratch.push_back(buffer_t(RAOP_PACKET_MAX_SIZE));
+	}
+	buffer_t &scratch = _variantScratch[_variantScratchCount++];
+
+	_aesDemandCipher.convertPacket(otherRef.packetData, &scratch[0],
+								   RTP_DATA_HEADER_SIZE, otherRef.payloadSize, secured);
+
+	return &scratch[0];
+}
+
 struct isClosedOrUnresponsive
 {
 	bool operator()(const RAOPDevice *const device)
@@ -570,22 +884,25 @@ void RAOPEngine::flush()
 {
 	ScopedLock lock(_mutex);
 
-	// remove closed devices from the list
-	_raopDevices.remove_if(isClosedOrUnresponsive());
+	removeClosedDevices();
 }
 
 void RAOPEngine::reset()
 {
-	// stop sending data and sync packets
+	// stop encoding and sending data and sync packets
 	stop();
 
 	// test thread states
 	assert(_reactorThread.isRunning());
 	assert(!_senderThread.isRunning());
+	assert(!_encoderThread.isRunning());
 
 	ScopedLock lock(_mutex);
 
-	// try to flush each device's playback buffer
+	// try to flush each device's playback buffer; all requests go out before
+	// any response is awaited, so devices flush in parallel
+	std::vector< std::future<int> > flushes;
+	flushes.reserve(_raopDevices.size());
 	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
 		 it != _raopDevices.end(); ++it)
 	{
@@ -595,22 +912,41 @@ void RAOPEngine::reset()
 		{
 			if (raopDevice.isOpen())
 			{
-				raopDevice.flush();
+				flushes.push_back(raopDevice.flush());
 			}
 		}
 		CATCH_ALL
 	}
+	for (size_t i = 0; i < flushes.size(); ++i)
+	{
+		try
+		{
+			RTSPClient::awaitStatus(flushes[i]);
+		}
+		CATCH_ALL
+	}
 
-	// remove closed devices from the list
-	_raopDevices.remove_if(isClosedOrUnresponsive());
+	removeClosedDevices();
 
 	// reset remaining object state
-	_firstDataTime = _lastClockSyncTime = _lastStreamSyncTime = 0;
+	_firstDataTime = _lastStreamSyncTime = 0;
+	_lastClockSyncTime = 0;
 	_isFirstDataPacket = _isFirstSyncPacket = true;
+	_isStreamStarted = false;
 	_rtpSeqNumIncoming = _rtpSeqNumOutgoing;
 	_rtpTimeIncoming = _rtpTimeOutgoing;
+	for (TransmitStateMap::iterator it = _transmitStates.begin();
+		 it != _transmitStates.end(); ++it)
+	{
+		TransmitState &state = it->second;
+		state.nextSeqNum = _rtpSeqNumOutgoing;
+		state.consecutiveFailures = 0;
+		state.backoffUntil = 0;
+	}
+	_pcmData.reset(_streamFormat.packetDataSize());
 	_rtpDataUnsecured.reset();
 	_rtpDataSecured.reset();
+	_resendService.reset(_rtpSeqNumOutgoing);
 	_samplesWritten = 0;
 }
 
@@ -624,6 +960,16 @@ void RAOPEngine::attach(RAOPDevice *const raopDevice)
 	{
 		_raopDevices.push_back(raopDevice);
 
+		countStreamVariants();
+		_resendService.addDevice(*raopDevice);
+
+		// start sending device data packets from the next to go out
+		TransmitState &state = _transmitStates[raopDevice];
+		state.nextSeqNum = _rtpSeqNumOutgoing;
+		state.consecutiveFailures = state.totalFailures = state.skippedPackets = 0;
+		state.backoffUntil = 0;
+		state.isDropped = false;
+
 		// force a sync packet to help synchronize devices
 		_isFirstSyncPacket = true;
 	}
@@ -634,6 +980,9 @@ void RAOPEngine::detach(RAOPDevice *const raopDevice)
 	ScopedLockWithUnlock lock(_mutex);
 
 	_raopDevices.remove(raopDevice);
+	_transmitStates.erase(raopDevice);
+	_resendService.removeDevice(*raopDevice);
+	countStreamVariants();
 
 	if (_raopDevices.empty())
 	{
@@ -644,19 +993,145 @@ void RAOPEngine::detach(RAOPDevice *const raopDevice)
 	}
 }
 
+void RAOPEngine::removeClosedDevices()
+{
+	// remove closed devices from the list and forget their transmission state
+	for (RAOPDeviceList::iterator it = _raopDevices.begin(); it != _raopDevices.end();)
+	{
+		if (isClosedOrUnresponsive()(*it))
+		{
+			_transmitStates.erase(*it);
+			_resendService.removeDevice(**it);
+			it = _raopDevices.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	countStreamVariants();
+}
+
+void RAOPEngine::countStreamVariants()
+{
+	_securedDeviceCount = _unsecuredDeviceCount = 0;
+
+	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
+		 it != _raopDevices.end(); ++it)
+	{
+		if ((*it)->secureDataStream())
+		{
+			_securedDeviceCount += 1;
+		}
+		else
+		{
+			_unsecuredDeviceCount += 1;
+		}
+	}
+}
+
+// called with _threadMutex held
 void RAOPEngine::start()
 {
 	_stopSending = false;
+	_lastLatenessReport = PacingTimer::now();
+	_packetLateness.reset();
+	_encoderThread.start(_encoderRunnable);
 	_senderThread.start(*this);
 	_senderThread.setOSPriority(THREAD_PRIORITY_ABOVE_NORMAL);
 }
 
 void RAOPEngine::stop()
 {
+	ScopedLock threadLock(_threadMutex);
+
 	_stopSending = true;
+	_encoderEvent.set();
+	_senderEvent.set();
+	_encoderThread.join();
 	_senderThread.join();
 }
 
+void RAOPEngine::encode()
+{
+	while (!_stopSending)
+	{
+		try
+		{
+			PacketBuffer::Slot *sslotPtr = NULL;
+			PacketBuffer::Slot *uslotPtr = NULL;
+			uint16_t seqNum;
+			uint32_t rtpTime;
+			bool marker;
+			bool fillSecured;
+			bool fillUnsecured;
+			PacingTimer::Time deadline;
+
+			if (_pcmData.canRead())
+			{
+				ScopedLock lock(_mutex);
+
+				// reserve packet slots; sender won't read them until committed,
+				// and resend service won't copy from them once they are reserved
+				if (_rtpDataSecured.canWrite())
+				{
+					{
+						ScopedLock memoryLock(_memoryMutex);
+						sslotPtr = &_rtpDataSecured.nextAvailable();
+						uslotPtr = &_rtpDataUnsecured.nextAvailable();
+					}
+					seqNum = _rtpSeqNumIncoming;
+					rtpTime = _rtpTimeIncoming;
+					marker = _isFirstDataPacket;
+
+					// produce only the stream variants attached devices need
+					fillSecured = (_securedDeviceCount > 0);
+					fillUnsecured = (_unsecuredDeviceCount > 0 || !fillSecured);
+
+					// sender's deadline for packet, once stream timing is established
+					deadline = (_samplesWritten == 0) ? 0
+						: _firstDataTime + samplesToMicroseconds(_samplesWritten +
+							int64_t(uint16_t(seqNum - _rtpSeqNumOutgoing)) * _streamFormat.framesPerPacket);
+				}
+			}
+
+			if (sslotPtr == NULL)
+			{
+				// no audio data to encode or no room for another packet; wait
+				// for player to write data or for sender to free a packet slot
+				_encoderEvent.tryWait(ENCODER_WAIT_MSEC);
+				continue;
+			}
+
+			size_t length;
+			const byte_t *const buffer = _pcmData.front(length);
+
+			// encode and encrypt without holding lock so sender is not delayed
+			encodePacket(buffer, length, *sslotPtr, *uslotPtr, seqNum, rtpTime, marker,
+						 fillSecured, fillUnsecured, deadline);
+
+			_pcmData.pop();
+
+			{
+				ScopedLock lock(_mutex);
+
+				_isFirstDataPacket = false;
+
+				// increment RTP packet sequence number
+				_rtpSeqNumIncoming += 1;
+
+				// increment RTP time (one tick for each frame)
+				_rtpTimeIncoming += uslotPtr->frameCount;
+			}
+
+			// notify sender that a packet is ready
+			_senderEvent.set();
+		}
+		CATCH_ALL
+	}
+}
+
 void RAOPEngine::run()
 {
 	while (!_stopSending)
@@ -665,38 +1140,88 @@ void RAOPEngine::run()
 		{
 			ScopedLockWithUnlock lock(_mutex);
 
-			Timestamp currentTime;
+			const PacingTimer::Time currentTime = PacingTimer::now();
 
 			// send sync packet at start of stream and periodically afterwards
-			if (_isFirstSyncPacket || (currentTime - _lastStreamSyncTime) >= 1000000L)
+			if (_isFirstSyncPacket || (currentTime - _lastStreamSyncTime) >= SYNC_INTERVAL_USEC)
 			{
-				sendSyncPacket(currentTime);
+				sendSyncPacket(Timestamp()); // NTP time is taken from system clock
+				_lastStreamSyncTime = currentTime;
 			}
+			const PacingTimer::Time syncDeadline = _lastStreamSyncTime + SYNC_INTERVAL_USEC;
 
-			// send data packet whenever system time meets or exceeds stream time
-			if (!_raopDevices.empty() && _rtpSeqNumIncoming != _rtpSeqNumOutgoing && (currentTime - _firstDataTime) >= samplesToMicroseconds(_samplesWritten))
+			if (!_raopDevices.empty() && _rtpSeqNumIncoming != _rtpSeqNumOutgoing)
 			{
-				const size_t dataLength = sendDataPacket(currentTime);
+				// deadline of each data packet is fixed relative to first packet of stream
+				const bool isFirstPacket = (_samplesWritten == 0);
+				const PacingTimer::Time dataDeadline = isFirstPacket ? currentTime
+					: _firstDataTime + samplesToMicroseconds(_samplesWritten);
 
-				lock.unlock();
+				if (currentTime >= dataDeadline)
+				{
+					if (!isFirstPacket)
+					{
+						_packetLateness.record(currentTime - dataDeadline);
+					}
+
+					const size_t dataLength = sendDataPacket(currentTime);
+
+					lock.unlock();
+
+					// send data packet to each device without holding lock
+					sendDataBatch();
 
-				// notify observer of successful output
-				_outputObserver.onBytesOutput(dataLength);
+					// notify encoder that a packet slot is available
+					_encoderEvent.set();
+
+					// notify observer of successful output
+					_outputObserver.onBytesOutput(dataLength);
+				}
+				else
+				{
+					lock.unlock();
+
+					// sleep until data packet is due (or sync packet, if sooner)
+					_pacingTimer.sleepUntil((std::min)(dataDeadline, syncDeadline));
+				}
 			}
 			else
 			{
-				// no active devices or no data to send or it's too soon to send
+				// no active devices or no data to send
 
 				lock.unlock();
 
-				Thread::sleep(1);
+				_senderEvent.tryWait(SENDER_WAIT_MSEC);
+			}
+
+			if ((currentTime - _lastLatenessReport) >= LATENESS_REPORT_INTERVAL_USEC)
+			{
+				if (_packetLateness.count() > 0)
+				{
+					Debugger::printf("Data packet lateness: %s",
+						_packetLateness.toString().c_str());
+					Debugger::printf("Data packet sends: %llu datagrams in %llu %s calls.",
+						(unsigned long long)_dataBatch.datagramCount(),
+						(unsigned long long)_dataBatch.syscallCount(),
+						(_dataBatch.isBatching() ? "sendmmsg" : "sendto"));
+					Debugger::printf("Data packet encodes: %llu silent packets skipped since stream start.",
+						(unsigned long long)skippedEncodeCount());
+					_packetLateness.reset();
+					_dataBatch.resetCounts();
+				}
+				_lastLatenessReport = currentTime;
 			}
 		}
 		CATCH_ALL
 	}
+
+	if (_packetLateness.count() > 0)
+	{
+		Debugger::printf("Data packet lateness: %s", _packetLateness.toString().c_str());
+	}
 }
 
-size_t RAOPEngine::sendDataPacket(const Timestamp &currentTime)
+size_t RAOPEngine::sendDataPacket(const PacingTimer::Time currentTime)
 {
 	PacketBuffer::Slot &sslotRef = _rtpDataSecured.nextBuffered();
 	PacketBuffer::Slot &uslotRef = _rtpDataUnsecured.nextBuffered();
@@ -704,30 +1229,56 @@ size_t RAOPEngine::sendDataPacket(const Timestamp &currentTime)
 	const DataPacketHeader &packetHeader =
 		*reinterpret_cast<DataPacketHeader *>(sslotRef.packetData);
 
-	// send data packet to each device
+	// update counters; slots now belong to packet memory, where they are not
+	// modified until recycled and are found by age (1 for this packet)
+	_rtpSeqNumOutgoing += 1;
+	_rtpTimeOutgoing += sslotRef.frameCount;
+	_samplesWritten += sslotRef.frameCount;
+	_resendService.packetSent();
+
+	// address data packets to each device from its own position in packet memory
+	_dataBatch.clear();
+	_dataBatchEntries.clear();
+	_variantScratchCount = 0;
 	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
 		 it != _raopDevices.end(); ++it)
 	{
-		RAOPDevice &raopDevice = **it;
+		RAOPDevice *const raopDevice = *it;
+		TransmitState &state = _transmitStates[raopDevice];
 
-		try
+		if (state.isDropped || currentTime < state.backoffUntil || !raopDevice->isOpen())
 		{
-			if (raopDevice.isOpen())
+			continue;
+		}
+
+		uint16_t age = (_rtpSeqNumOutgoing - state.nextSeqNum);
+		if (age == 0)
+		{
+			continue;
+		}
+		else if (age > CATCH_UP_PACKET_WINDOW)
+		{
+			// skip packets that would arrive too late to be played
+			if (age <= PACKET_MEMORY_COUNT)
 			{
-				sendTo(_dataSocket,
-					   raopDevice.audioSocketAddr(),
-					   raopDevice.secureDataStream()
-						   ? sslotRef.packetData
-						   : uslotRef.packetData,
-					   sslotRef.packetSize);
+				state.skippedPackets += (age - 1);
 			}
+			state.nextSeqNum = (_rtpSeqNumOutgoing - 1);
+			age = 1;
 		}
-		catch (const std::exception &ex)
+
+		for (uint16_t count = 0; age > 0 && count <= CATCH_UP_PACKET_LIMIT; --age, ++count)
 		{
-			Debugger::printException(ex, Poco::format(
-											 "Sending data packet %hu to %s",
-											 ByteOrder::fromNetwork(packetHeader.seqNum),
-											 raopDevice.audioSocketAddr().toString()));
+			// sizes are the same in both variants
+			const size_t packetSize = _rtpDataUnsecured.prevBuffered(age).packetSize;
+
+			_dataBatch.add(raopDevice->audioSocketAddr(),
+						   packetFromMemory(age, raopDevice->secureDataStream()), packetSize);
+
+			const DataBatchEntry entry = {raopDevice, state.nextSeqNum};
+			_dataBatchEntries.push_back(entry);
+
+			state.nextSeqNum += 1;
 		}
 	}
 
@@ -737,12 +1288,112 @@ size_t RAOPEngine::sendDataPacket(const Timestamp &currentTime)
 		_firstDataTime = currentTime;
 	}
 
-	// update counters
-	_rtpSeqNumOutgoing += 1;
-	_rtpTimeOutgoing += sslotRef.frameCount;
-	_samplesWritten += sslotRef.frameCount;
+	return uslotRef.originalSize;
+}
+
+void RAOPEngine::sendDataBatch()
+{
+	const size_t count = _dataBatch.size();
+	if (count == 0)
+	{
+		return;
+	}
+	const bool allSent = (_dataBatch.send() == count);
+
+	const PacingTimer::Time currentTime = PacingTimer::now();
+
+	ScopedLock lock(_mutex);
+
+	// entries for each device are adjacent and in sequence number order
+	for (size_t first = 0, last = 0; first < count; first = last)
+	{
+		RAOPDevice *const device = _dataBatchEntries[first].device;
+		last = first + 1;
+		while (last < count && _dataBatchEntries[last].device == device)
+		{
+			last += 1;
+		}
+
+		// device may have been detached while batch was sent
+		TransmitStateMap::iterator pos = _transmitStates.find(device);
+		if (pos == _transmitStates.end())
+		{
+			continue;
+		}
+		TransmitState &state = pos->second;
+
+		bool isAnySent = false;
+		bool isAnyFailed = false;
+		bool isFaulted = false;
+		size_t firstUnsent = last; // of packets that failed after the last one sent
+
+		for (size_t i = first; i < last; i += 1)
+		{
+			if (allSent || _dataBatch.error(i).empty())
+			{
+				isAnySent = true;
+				firstUnsent = last;
+				continue;
+			}
+
+			if (!isAnyFailed)
+			{
+				isAnyFailed = true;
+				Debugger::printException(std::runtime_error(_dataBatch.error(i)),
+										 Poco::format("Sending data packet %hu to %s",
+													  _dataBatchEntries[i].seqNum, _dataBatch.address(i).toString()));
+			}
+
+			if (firstUnsent == last)
+			{
+				firstUnsent = i;
+			}
+
+			// only errors particular to the device count against it; others,
+			// such as a full send buffer, come from the socket all devices share
+			if (_dataBatch.isDestinationError(i))
+			{
+				isFaulted = true;
+			}
+		}
 
-	return sslotRef.originalSize;
+		// send packets that failed at the end of the run again next time; any
+		// that failed before one that went out are left for the device to
+		// request, so that no packet is sent twice
+		if (firstUnsent < last)
+		{
+			state.nextSeqNum = _dataBatchEntries[firstUnsent].seqNum;
+		}
+
+		if (!isFaulted)
+		{
+			if (isAnySent && state.consecutiveFailures > 0)
+			{
+				Debugger::printf("Sending data packets to %s resumed after %u failure(s); %u packet(s) skipped in total.",
+								 _dataBatch.address(first).toString().c_str(),
+								 state.consecutiveFailures, state.skippedPackets);
+				state.consecutiveFailures = 0;
+			}
+			continue;
+		}
+
+		state.consecutiveFailures += 1;
+		state.totalFailures += 1;
+
+		if (_maxSendFailures > 0 && state.consecutiveFailures >= _maxSendFailures)
+		{
+			state.isDropped = true;
+
+			Debugger::printf("Stopped sending data packets to %s after %u consecutive failures.",
+							 _dataBatch.address(first).toString().c_str(), state.consecutiveFailures);
+		}
+		else
+		{
+			// back off exponentially so healthy devices are unaffected
+			const unsigned int shift = (std::min)(state.consecutiveFailures - 1, 7u);
+			state.backoffUntil = currentTime + (std::min)(SEND_BACKOFF_MIN_USEC << shift, SEND_BACKOFF_MAX_USEC);
+		}
+	}
 }
 
 void RAOPEngine::sendSyncPacket(const Timestamp &currentTime)
@@ -754,7 +1405,7 @@ void RAOPEngine::sendSyncPacket(const Timestamp &currentTime)
 	syncPacket.seqNum = 7;
 	syncPacket.ntpTime = currentTime;
 	syncPacket.rtpTime = _rtpTimeOutgoing;
-	syncPacket.rtpTimeLessLatency = (_rtpTimeOutgoing - 77175);
+	syncPacket.rtpTimeLessLatency = (_rtpTimeOutgoing - millisecondsToSamples(SYNC_LATENCY_MSEC));
 	ByteOrder_toNetwork(syncPacket);
 
 	// send sync packet to each device
@@ -763,6 +1414,12 @@ void RAOPEngine::sendSyncPacket(const Timestamp &currentTime)
 	{
 		RAOPDevice &raopDevice = **it;
 
+		const TransmitStateMap::const_iterator pos = _transmitStates.find(*it);
+		if (pos == _transmitStates.end() || pos->second.isDropped)
+		{
+			continue;
+		}
+
 		try
 		{
 			if (raopDevice.isOpen())
@@ -781,7 +1438,6 @@ void RAOPEngine::sendSyncPacket(const Timestamp &currentTime)
 	}
 
 	_isFirstSyncPacket = false;
-	_lastStreamSyncTime = currentTime;
 }
 
 void RAOPEngine::handleTimingRequest(ReadableNotification *)
@@ -878,7 +1534,7 @@ void RAOPEngine::handleControlRequest(ReadableNotification *)
 			std::memcpy(&request, &buffer[0], RTP_RESEND_REQUEST_SIZE);
 			ByteOrder_fromNetwork(request);
 
-			handleResendRequest(request, sender);
+			_resendService.request(sender, request.missedSeqNum, request.missedPktCnt);
 		}
 		else
 		{
@@ -888,90 +1544,3 @@ void RAOPEngine::handleControlRequest(ReadableNotification *)
 	}
 	CATCH_ALL
 }
-
-void RAOPEngine::handleResendRequest(ResendRequestPacket &request,
-									 const SocketAddress &requestorAddress)
-{
-	Debugger::printf(
-		"Resend requested by %s for %hu packet(s) starting at sequence number %hu.",
-		requestorAddress.toString().c_str(), request.missedPktCnt, request.missedSeqNum);
-
-	ScopedLock lock(_mutex);
-
-	uint16_t missedPktAge = (request.missedSeqNum <= _rtpSeqNumOutgoing
-								 ? _rtpSeqNumOutgoing - request.missedSeqNum
-								 : _rtpSeqNumOutgoing + ((std::numeric_limits<uint16_t>::max)() - request.missedSeqNum) + 1);
-
-	if (missedPktAge < 1 || missedPktAge > PACKET_MEMORY_COUNT)
-	{
-		Debugger::printf("Requested packet(s) too old to resend; "
-						 "only the last %hu sent packets are kept.",
-						 PACKET_MEMORY_COUNT);
-		return;
-	}
-
-	// determine which device is the requestor
-	RAOPDevice *requestor = NULL;
-	for (RAOPDeviceList::const_iterator it = _raopDevices.begin();
-		 it != _raopDevices.end(); ++it)
-	{
-		const RAOPDevice &raopDevice = **it;
-
-		if (raopDevice.controlSocketAddr().host() == requestorAddress.host() && (raopDevice.controlSocketAddr().port() == requestorAddress.port() || raopDevice.audioSocketAddr().port() == requestorAddress.port() || raopDevice.audioSocketAddr().port() + 1 == requestorAddress.port()))
-		{
-			requestor = *it;
-			break;
-		}
-	}
-
-	if (requestor == NULL)
-	{
-		Debugger::printf("Requestor %s not found in list of devices.",
-						 requestorAddress.toString().c_str());
-		return;
-	}
-	else if (!requestor->isOpen())
-	{
-		Debugger::printf("Requestor %s no longer open for playback.",
-						 requestorAddress.toString().c_str());
-		return;
-	}
-
-	// obtain reference to correct packet stream for requesting device
-	const PacketBuffer &rtpData =
-		(requestor->secureDataStream() ? _rtpDataSecured : _rtpDataUnsecured);
-
-	RTPPacketHeader header;
-	header.setMarker();
-	header.setPayloadType(PAYLOAD_TYPE_RESEND_RESPONSE);
-	buffer_t response(RTP_BASE_HEADER_SIZE + RAOP_PACKET_MAX_SIZE);
-
-	while (request.missedPktCnt > 0)
-	{
-		const PacketBuffer::Slot &slotRef = rtpData.prevBuffered(missedPktAge);
-
-		const uint16_t dataPacketSeqNum = ByteOrder::fromNetwork(
-			reinterpret_cast<const DataPacketHeader *>(slotRef.packetData)->seqNum);
-		if (request.missedSeqNum != dataPacketSeqNum)
-		{
-			Debugger::printf("Data packet with sequence number %hu was not found"
-							 " at anticipated position in packet history; %hu was in its place.",
-							 request.missedSeqNum, dataPacketSeqNum);
-			return;
-		}
-
-		// pass packet frame count, which may not be easy to determine from size
-		header.seqNum = ByteOrder::toNetwork(slotRef.frameCount);
-
-		std::memcpy(&response[0], &header, RTP_BASE_HEADER_SIZE);
-		const size_t packetSize = (std::min)(slotRef.packetSize, RAOP_PACKET_MAX_SIZE);
-		std::memcpy(&response[RTP_BASE_HEADER_SIZE], slotRef.packetData, packetSize);
-
-		sendTo(_controlSocket, requestorAddress, &response[0], RTP_BASE_HEADER_SIZE + packetSize);
-
-		// update loop counters
-		missedPktAge -= 1;
-		request.missedPktCnt -= 1;
-		request.missedSeqNum += 1;
-	}
-}
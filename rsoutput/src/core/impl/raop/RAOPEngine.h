@@ -18,21 +18,33 @@
 #define RAOPEngine_h
 
 
+#include "AudioQueue.h"
+#include "ControlScheduler.h"
+#include "DatagramBatch.h"
+#include "MetadataDispatcher.h"
+#include "Options.h"
 #include "OutputFormat.h"
+#include "PacingTimer.h"
 #include "PacketBuffer.h"
 #include "Platform.h"
+#include "RAOPCipher.h"
 #include "RAOPDefs.h"
 #include "RAOPDevice.h"
+#include "ResendService.h"
 #include "Uncopyable.h"
 #include "impl/OutputObserver.h"
 #include "impl/OutputSink.h"
+#include <atomic>
 #include <list>
+#include <map>
 #include <memory>
 #include <string>
-#include <openssl/aes.h>
+#include <vector>
 #include <openssl/rsa.h>
+#include <Poco/Event.h>
 #include <Poco/Mutex.h>
 #include <Poco/Runnable.h>
+#include <Poco/RunnableAdapter.h>
 #include <Poco/ScopedLock.h>
 #include <Poco/Thread.h>
 #include <Poco/Timestamp.h>
@@ -42,7 +54,7 @@
 #include <Poco/Net/SocketReactor.h>
 
 
-class RAOPEngine
+class RAOPEngine final
 :
 	public OutputSink,
 	public Poco::Runnable,
@@ -51,21 +63,32 @@ class RAOPEngine
 	friend RAOPDevice;
 
 public:
-	static const OutputFormat& outputFormat();
+	static const OutputFormat& defaultOutputFormat();
 
 private:
-	static int64_t samplesToMicroseconds(int64_t);
-	static int32_t samplesToMilliseconds(int64_t);
+	int64_t samplesToMicroseconds(int64_t) const;
+	int32_t samplesToMilliseconds(int64_t) const;
+	uint32_t millisecondsToSamples(int64_t) const;
 
 public:
 	explicit RAOPEngine(OutputObserver&);
 	~RAOPEngine();
 
-	void reinit(OutputInterval&); // also recalibrates interval to new RTP time
+	// also recalibrates interval to new RTP time
+	void reinit(OutputInterval&, const OutputFormat& = defaultOutputFormat(), bool pcmPayload = false);
+
+	// audio format of current session, as written to engine
+	const OutputFormat& outputFormat() const;
+
+	// whether audio is streamed as uncompressed (L16) rather than ALAC payloads
+	bool isPCMPayload() const;
 
 	// returns interval for given length and offset relative to internal RTP time
 	OutputInterval getOutputInterval(time_t length, time_t offset) const;
 
+	// number of silent packets copied from cache instead of being encoded
+	uint64_t skippedEncodeCount() const;
+
 	uint16_t controlPort() const;
 	uint16_t timingPort() const;
 
@@ -80,36 +103,74 @@ public:
 private:
 	void attach(class RAOPDevice*);
 	void detach(class RAOPDevice*);
+	void removeClosedDevices();
 
 	void start();
 	void stop();
 	void run();
-
-	size_t sendDataPacket(const Poco::Timestamp&);
+	void encode();
+	void encodePacket(const byte_t*, size_t, PacketBuffer::Slot& secured,
+		PacketBuffer::Slot& unsecured, uint16_t seqNum, uint32_t rtpTime, bool marker,
+		bool fillSecured, bool fillUnsecured, PacingTimer::Time deadline);
+	int32_t encodeAudio(const byte_t*, PacingTimer::Time deadline);
+	void adaptEncoderEffort(int64_t encodeTime, bool isLate);
+	const byte_t* packetFromMemory(uint16_t age, bool secured);
+	void countStreamVariants();
+
+	size_t sendDataPacket(PacingTimer::Time);
+	void sendDataBatch();
 	void sendSyncPacket(const Poco::Timestamp&);
 	void handleTimingRequest(Poco::Net::ReadableNotification*);
 	void handleControlRequest(Poco::Net::ReadableNotification*);
-	void handleResendRequest(ResendRequestPacket&, const Poco::Net::SocketAddress&);
 
 private:
 	/** RSA encryption public key */
 	std::shared_ptr<RSA> _rsaKey;
 	RSA* rsaKey() { return _rsaKey.get(); }
 
-	/** AES encryption key (binary and base64-encoded) */
-	AES_KEY _aesKey;
+	/** AES encryption key (base64-encoded) and cipher */
 	std::string _encodedKey;
+	RAOPCipher _aesCipher;
 
 	/** AES encryption initialization vector (binary and base64-encoded) */
 	buffer_t _aesIV;
 	std::string _encodedIV;
 
-	/** RTP audio latency (in number of samples per channel) */
-	unsigned int _audioLatency;
+	/** PCM audio data written by player and not yet encoded */
+	AudioQueue _pcmData;
 
-	/** RTP audio data packets */
+	/** RTP audio data packets; each variant is produced only while needed */
 	PacketBuffer _rtpDataSecured;
 	PacketBuffer _rtpDataUnsecured;
+	Poco::FastMutex _memoryMutex; // held to reserve slots and to copy for resends
+	unsigned int _securedDeviceCount;
+	unsigned int _unsecuredDeviceCount;
+
+	/** encoded and encrypted payload of a silent packet, cached per stream */
+	buffer_t _silencePayloadSecured;
+	buffer_t _silencePayloadUnsecured;
+	std::atomic<uint64_t> _skippedEncodeCount;
+
+	/** audio format of current session, as written and as streamed */
+	OutputFormat _outputFormat;
+	RAOPStreamFormat _streamFormat;
+
+	/** stream carries L16 payloads, negotiated when all devices accept them */
+	bool _isPCMPayload;
+
+	/** RTP audio latency (in number of samples per channel at stream rate) */
+	unsigned int _audioLatency;
+
+	/** encoder output, sized for its worst case, and effort configuration */
+	buffer_t _encodeScratch;
+	Options::EncoderEffort _encoderEffort;
+	int64_t _encodeTimeAverage; // in microseconds, while adaptive
+	unsigned int _adaptivePacketCount; // since last adaptive effort change
+
+	/** cipher and scratch memory for missing variants of sent packets */
+	RAOPCipher _aesDemandCipher;
+	std::vector<buffer_t> _variantScratch;
+	size_t _variantScratchCount;
 
 	/** RTP packet sequence number */
 	uint16_t _rtpSeqNumIncoming;
@@ -125,14 +186,28 @@ private:
 	/** count of samples written to remote speakers in current audio stream */
 	int64_t _samplesWritten;
 
+	std::atomic<bool> _isStreamStarted; // tested and set under _threadMutex
 	bool _isFirstDataPacket;
 	bool _isFirstSyncPacket;
-	Poco::Timestamp _firstDataTime;
+	PacingTimer::Time _firstDataTime;
 	Poco::Timestamp _lastClockSyncTime;
-	Poco::Timestamp _lastStreamSyncTime;
+	PacingTimer::Time _lastStreamSyncTime;
+
+	/** sleeps sender thread until each packet's monotonic deadline */
+	PacingTimer _pacingTimer;
+	LatenessHistogram _packetLateness;
+	PacingTimer::Time _lastLatenessReport;
 
+	/** serializes starting and stopping the encoder and sender threads, which
+	    writer, device and open-pool threads may each do; never held while
+	    taking _mutex, since the threads it joins take that */
+	Poco::FastMutex _threadMutex;
 	volatile bool _stopSending;
 	Poco::Thread _senderThread;
+	Poco::Event _senderEvent;
+	Poco::Thread _encoderThread;
+	Poco::Event _encoderEvent;
+	Poco::RunnableAdapter<RAOPEngine> _encoderRunnable;
 	Poco::Thread _reactorThread;
 	Poco::Net::SocketReactor _socketReactor;
 
@@ -143,6 +218,21 @@ private:
 	Poco::Net::DatagramSocket _timingSocket;
 	Poco::Net::DatagramSocket _dataSocket;
 
+	/** data packets addressed to each device, sent outside of lock */
+	DatagramBatch _dataBatch;
+
+	struct DataBatchEntry
+	{
+		class RAOPDevice* device;
+		uint16_t seqNum;
+	};
+	std::vector<DataBatchEntry> _dataBatchEntries;
+
+	/** answers resend requests from packet memory on its own thread */
+	ResendService _resendService;
+	ControlScheduler _controlScheduler;
+	MetadataDispatcher _metadataDispatcher;
+
 	OutputObserver& _outputObserver;
 
 	std::unique_ptr<class ALACEncoder> _alacEncoder;
@@ -150,6 +240,22 @@ private:
 	typedef std::list<class RAOPDevice*> RAOPDeviceList;
 	RAOPDeviceList _raopDevices;
 
+	/** data packet transmission state of each device */
+	struct TransmitState
+	{
+		uint16_t nextSeqNum; // of next data packet to send to device
+		unsigned int consecutiveFailures;
+		unsigned int totalFailures;
+		unsigned int skippedPackets;
+		PacingTimer::Time backoffUntil;
+		bool isDropped;
+	};
+	typedef std::map<class RAOPDevice*, TransmitState> TransmitStateMap;
+	TransmitStateMap _transmitStates;
+
+	/** consecutive send failures before device is dropped (0 for never) */
+	unsigned int _maxSendFailures;
+
 	mutable Poco::FastMutex _mutex;
 	typedef const Poco::FastMutex::ScopedLock ScopedLock;
 	typedef Poco::ScopedLockWithUnlock<Poco::FastMutex> ScopedLockWithUnlock;
@@ -21,12 +21,19 @@
 #include "Random.h"
 #include "RAOPDefs.h"
 #include "RTSPClient.h"
+#include "RTSPResponse.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <iterator>
 #include <map>
-#include <regex>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -35,17 +42,31 @@
 #include <openssl/rsa.h>
 #include <Poco/Format.h>
 #include <Poco/Mutex.h>
+#include <Poco/Observer.h>
 #include <Poco/StringTokenizer.h>
 #include <Poco/Timespan.h>
 #include <Poco/Net/NetException.h>
+#include <Poco/Net/SocketNotification.h>
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+#endif
 
 using Poco::FastMutex;
 using Poco::StringTokenizer;
 using Poco::Timespan;
 using Poco::Net::ConnectionResetException;
+using Poco::Net::ReadableNotification;
 using Poco::Net::Socket;
+using Poco::Net::SocketReactor;
 using Poco::Net::StreamSocket;
 
+// seconds to wait on socket operations and for responses to arrive
+static const long RESPONSE_TIMEOUT = 10;
+
 static const std::string ACTIVE_REMOTE_HEADER("Active-Remote");
 static const std::string AUDIO_JACK_STATUS_HEADER("Audio-Jack-Status");
 static const std::string AUDIO_LATENCY_HEADER("Audio-Latency");
@@ -69,47 +90,68 @@ static const std::string WWW_AUTHENTICATE_HEADER("WWW-Authenticate");
 class RTSPRequest
 {
 public:
-	explicit RTSPRequest(const std::string &method) : _method(method) {}
+	explicit RTSPRequest(const std::string &method) : _method(method), _body(NULL), _bodyLength(0), _isText(false) {}
 
 	const std::string &method() const { return _method; }
 
+	// body is sent from where it lies, so it must outlive request
+	const byte_t *body() const { return _body; }
+	size_t bodyLength() const { return _bodyLength; }
+
 	void setBody(const buffer_t &contentData, const std::string &contentType)
 	{
 		setHeader(CONTENT_LENGTH_HEADER, Poco::format("%z", contentData.size()));
 		setHeader(CONTENT_TYPE_HEADER, contentType);
-		_bodyData = contentData;
+		_body = (contentData.empty() ? NULL : &contentData[0]);
+		_bodyLength = contentData.size();
+		_isText = false;
 	}
 
 	void setBody(const std::string &contentData, const std::string &contentType)
 	{
 		setHeader(CONTENT_LENGTH_HEADER, Poco::format("%u", contentData.length()));
 		setHeader(CONTENT_TYPE_HEADER, contentType);
-		_bodyText = contentData;
+		_body = reinterpret_cast<const byte_t *>(contentData.data());
+		_bodyLength = contentData.length();
+		_isText = true;
 	}
 
+	// body is referenced rather than copied, so a temporary would not live long enough
+	void setBody(buffer_t &&, const std::string &) = delete;
+	void setBody(std::string &&, const std::string &) = delete;
+
 	void setHeader(const std::string &name, const std::string &value)
 	{
 		_headers.insert(std::make_pair(name, value));
 	}
 
-	void build(buffer_t &requestData, std::string &requestText, const std::string &requestURI)
+	// builds status line and headers, which are sent ahead of body, and the
+	// whole request in printable form for output (if requested)
+	void build(std::string &requestHead, std::string *const requestText, const std::string &requestURI)
 	{
-		requestText.assign(Poco::format("%s %s RTSP/1.0\r\n", _method, requestURI));
+		requestHead.assign(Poco::format("%s %s RTSP/1.0\r\n", _method, requestURI));
 
 		typedef std::map<const std::string, const std::string>::const_iterator headers_iterator;
 		for (headers_iterator it = _headers.begin(); it != _headers.end(); ++it)
 		{
-			requestText.append(it->first + ": " + it->second + "\r\n");
+			requestHead.append(it->first + ": " + it->second + "\r\n");
 		}
 
-		requestText.append("\r\n");
+		requestHead.append("\r\n");
 
-		requestData.assign(requestText.begin(), requestText.end());
-
-		if (!_bodyData.empty())
+		if (requestText == NULL)
 		{
-			requestData.insert(requestData.end(), _bodyData.begin(), _bodyData.end());
+			return;
+		}
 
+		requestText->assign(requestHead);
+
+		if (_isText)
+		{
+			requestText->append(reinterpret_cast<const char *>(_body), _bodyLength);
+		}
+		else if (_bodyLength > 0)
+		{
 			struct to_printable
 			{
 				char operator()(const byte_t b)
@@ -119,114 +161,92 @@ public:
 			};
 
 			// transform short request bodies to printable characters for output
-			if (_bodyData.size() <= 1024)
+			if (_bodyLength <= 1024)
 			{
-				std::transform(_bodyData.begin(), _bodyData.end(),
-							   std::back_inserter(requestText), to_printable());
-				if (*(requestText.rbegin()) != '\n')
-					requestText.push_back('\n');
+				std::transform(_body, _body + _bodyLength,
+							   std::back_inserter(*requestText), to_printable());
+				if (*(requestText->rbegin()) != '\n')
+					requestText->push_back('\n');
 			}
 		}
-		else if (!_bodyText.empty())
-		{
-			requestData.insert(requestData.end(), _bodyText.begin(), _bodyText.end());
-
-			requestText.append(_bodyText);
-		}
 	}
 
 private:
 	std::string _method;
-	buffer_t _bodyData;
-	std::string _bodyText;
+	const byte_t *_body;
+	size_t _bodyLength;
+	bool _isText;
 	std::map<const std::string, const std::string> _headers;
 };
 
-class RTSPResponse
+/**
+ * Receives outcome of a request once its response arrives or is given up on.
+ */
+class RTSPCompletion
 {
 public:
-	explicit RTSPResponse(const std::string &responseText)
-	{
-		assert(!responseText.empty());
+	virtual ~RTSPCompletion() {}
 
-		std::string::size_type beg = 0, end;
-
-		// parse response for protocol
-		end = responseText.find_first_of("/", beg);
-		if (end <= beg || end == std::string::npos)
-		{
-			throw std::invalid_argument("responseText");
-		}
-		_protocol = responseText.substr(beg, end - beg);
-		beg = responseText.find_first_not_of("/", end);
+	virtual void complete(const RTSPResponse &) = 0;
+	virtual void fail(std::exception_ptr) = 0;
+};
 
-		// parse response for version
-		end = responseText.find_first_of(" ", beg);
-		if (end <= beg || end == std::string::npos)
-		{
-			throw std::invalid_argument("responseText");
-		}
-		_version = responseText.substr(beg, end - beg);
-		beg = responseText.find_first_not_of(" ", end);
+template <typename T>
+class RTSPPromise : public RTSPCompletion
+{
+public:
+	std::future<T> future() { return _promise.get_future(); }
 
-		// parse response for status code
-		end = responseText.find_first_of(" ", beg);
-		if (end <= beg || end == std::string::npos)
-		{
-			throw std::invalid_argument("responseText");
-		}
-		_statusCode = NumberParser::parseDecimalIntegerTo<int>(
-			responseText.substr(beg, end - beg));
-		beg = responseText.find_first_not_of(" ", end);
+	virtual void fail(std::exception_ptr error) { _promise.set_exception(error); }
 
-		// parse response for status text
-		end = responseText.find_first_of("\r\n", beg);
-		if (end <= beg || end == std::string::npos)
-		{
-			throw std::invalid_argument("responseText");
-		}
-		_statusText = responseText.substr(beg, end - beg);
-		beg = responseText.find_first_not_of("\r\n", end);
+protected:
+	std::promise<T> _promise;
+};
 
-		// parse response headers
-		while (beg != std::string::npos && end <= responseText.length() - 4 && responseText.compare(end, 4, "\r\n\r\n"))
-		{
-			// tokenize header into name and value
-			end = responseText.find_first_of(":", beg);
-			const std::string name = responseText.substr(beg, end - beg);
-			beg = responseText.find_first_not_of(": ", end);
+class RTSPResponsePromise : public RTSPPromise<RTSPResponse>
+{
+public:
+	virtual void complete(const RTSPResponse &response) { _promise.set_value(response); }
+};
 
-			end = responseText.find_first_of("\r\n", beg);
-			const std::string value = responseText.substr(beg, end - beg);
-			beg = end + 2;
+class RTSPStatusPromise : public RTSPPromise<int>
+{
+public:
+	explicit RTSPStatusPromise(Poco::Event *const completed) : _completed(completed) {}
 
-			_headers.insert(std::make_pair(name, value));
-		}
+	virtual void complete(const RTSPResponse &response)
+	{
+		_promise.set_value(response.statusCode());
+		signal();
+	}
 
-		const std::string::size_type contentLength = responseText.length() - (end + 4);
-		if (contentLength > 0)
-		{
-			assert(hasHeader(CONTENT_LENGTH_HEADER));
-			assert(contentLength == NumberParser::parseDecimalIntegerTo<
-										std::string::size_type>(getHeader(CONTENT_LENGTH_HEADER)));
+	virtual void fail(std::exception_ptr error)
+	{
+		RTSPPromise<int>::fail(error);
+		signal();
+	}
 
-			body = responseText.substr(end + 4);
-		}
+private:
+	void signal()
+	{
+		if (_completed != NULL)
+			_completed->set();
 	}
 
-	int statusCode() const { return _statusCode; }
-	bool hasHeader(const std::string &name) const { return !!_headers.count(name); }
-	const std::string &getHeader(const std::string &name) { return _headers[name]; }
+	Poco::Event *const _completed;
+};
 
-	std::string body;
+template <typename T>
+static T awaitResult(std::future<T> &result)
+{
+	if (result.wait_for(std::chrono::seconds(RESPONSE_TIMEOUT)) != std::future_status::ready)
+	{
+		throw std::runtime_error("timed out waiting for RTSP response");
+	}
+	return result.get();
+}
 
-private:
-	int _statusCode;
-	std::string _statusText;
-	std::string _protocol;
-	std::string _version;
-	std::map<const std::string, const std::string> _headers;
-};
+//------------------------------------------------------------------------------
 
 class RTSPClientImpl : private Uncopyable
 {
@@ -235,18 +255,52 @@ class RTSPClientImpl : private Uncopyable
 	RTSPClientImpl(StreamSocket &, const uint32_t &remoteControlId);
 	~RTSPClientImpl();
 
+	struct PendingRequest
+	{
+		uint32_t cSeq;
+		std::string method;
+		std::shared_ptr<RTSPCompletion> completion;
+	};
+
 	RTSPResponse sendRequestReceiveResponse(RTSPRequest &);
-	void sendRequest(const buffer_t &);
-	std::string receiveResponse();
+	std::future<int> postRequest(RTSPRequest &, Poco::Event *completed = NULL);
+	void postRequest(RTSPRequest &, const std::shared_ptr<RTSPCompletion> &);
+	void buildRequest(RTSPRequest &, uint32_t cSeq, std::string &, std::string *);
+	void sendRequest(const std::string &requestHead, const byte_t *body, size_t bodyLength);
+	void completeRequest(const PendingRequest &, const RTSPResponse &);
+
+	RTSPResponse receiveResponse();
+	void receiveMore();
+	size_t receivedHeaderLength();
+	bool takeResponse(RTSPResponse &, size_t headerLength);
+
+	void handleReadable(ReadableNotification *);
+	void dispatchResponse(const RTSPResponse &);
+	void closeConnection(const std::string &reason);
+	void failPendingRequests(const std::string &reason);
 
 	void parseAuthenticateHeader(const std::string &);
 	std::string buildAuthorizationHeader(
 		const std::string &requestMethod, const std::string &requestURI) const;
 
 private:
-	FastMutex _rtspMutex;
+	FastMutex _writeMutex; // held while sending; never taken by reactor's thread
+	FastMutex _rtspMutex; // held for state shared with reactor's thread, never while sending
 	StreamSocket _rtspSocket;
 
+	// received bytes not yet returned in a response lie between start and end;
+	// those up to start plus scanned hold no end of headers
+	std::vector<char> _receiveBuffer;
+	size_t _receiveStart;
+	size_t _receiveEnd;
+	size_t _receiveScanned;
+
+	// requests sent while attached to a reactor, awaiting responses in order
+	std::deque<PendingRequest> _pendingRequests;
+	std::atomic<SocketReactor *> _socketReactor;
+	std::atomic<bool> _isClosed;
+	Poco::Observer<RTSPClientImpl, ReadableNotification> _readableHandler;
+
 	bool _teardownRequired;
 	uint32_t _messageSequenceNumber;
 	uint32_t _localSessionId;
@@ -269,6 +323,12 @@ RTSPClient::RTSPClient(StreamSocket &socket, const uint32_t &remoteControlId)
 
 RTSPClient::~RTSPClient()
 {
+	try
+	{
+		detach();
+	}
+	CATCH_ALL
+
 	delete _impl;
 }
 
@@ -280,7 +340,12 @@ bool RTSPClient::isReady() const
 	{
 		if (!_impl->_rtspSocket.poll(0, Socket::SELECT_ERROR))
 		{
-			if (_impl->_rtspSocket.poll(0, Socket::SELECT_READ))
+			if (_impl->_socketReactor != NULL)
+			{
+				// reactor's thread reads the socket and notes when it is closed
+				isReady = !_impl->_isClosed;
+			}
+			else if (_impl->_rtspSocket.poll(0, Socket::SELECT_READ))
 			{
 				int buffer;
 				const int result = const_cast<RTSPClient *>(this)->_impl->_rtspSocket.receiveBytes(&buffer, sizeof(buffer), MSG_PEEK);
@@ -301,6 +366,31 @@ bool RTSPClient::isReady() const
 	return isReady;
 }
 
+void RTSPClient::attach(SocketReactor &socketReactor)
+{
+	if (_impl->_socketReactor.exchange(&socketReactor) == NULL)
+	{
+		socketReactor.addEventHandler(_impl->_rtspSocket, _impl->_readableHandler);
+	}
+	else
+	{
+		assert(_impl->_socketReactor == &socketReactor);
+	}
+}
+
+void RTSPClient::detach()
+{
+	SocketReactor *const socketReactor = _impl->_socketReactor.exchange(NULL);
+	if (socketReactor != NULL)
+	{
+		// waits for a handler in progress, so must not hold RTSP mutex
+		socketReactor->removeEventHandler(_impl->_rtspSocket, _impl->_readableHandler);
+
+		FastMutex::ScopedLock lock(_impl->_rtspMutex);
+		_impl->failPendingRequests("client detached");
+	}
+}
+
 void RTSPClient::setPassword(const std::string &password)
 {
 	_impl->_authenticationPassword = password;
@@ -452,9 +542,12 @@ int RTSPClient::doPostAuth(const std::string &pk)
  *
  * @param aesKey AES encryption key
  * @param aesIV AES initialization vector
+ * @param format format of audio data stream
+ * @param pcmPayload <code>true</code> to announce uncompressed (L16/L24) audio
  * @return response status code (positive)
  */
-int RTSPClient::doAnnounce(const std::string &aesKey, const std::string &aesIV)
+int RTSPClient::doAnnounce(const std::string &aesKey, const std::string &aesIV,
+						   const RAOPStreamFormat &format, const bool pcmPayload)
 {
 	// generate local session identifier
 	Random::fill(&_impl->_localSessionId, sizeof(uint32_t));
@@ -469,14 +562,27 @@ int RTSPClient::doAnnounce(const std::string &aesKey, const std::string &aesIV)
 		_impl->_rtspSocket.address().host().toString(),
 		_impl->_rtspSocket.peerAddress().host().toString()));
 
-	requestBody.append(Poco::format(
-		"m=audio 0 RTP/AVP 96\r\n"
-		"a=rtpmap:96 AppleLossless\r\n"
-		"a=fmtp:96 %u 0 %u 40 10 14 %u 255 0 0 %u\r\n",
-		RAOP_PACKET_MAX_SAMPLES_PER_CHANNEL,
-		RAOP_BITS_PER_SAMPLE,
-		RAOP_CHANNEL_COUNT,
-		RAOP_SAMPLES_PER_SECOND));
+	// engine streams uncompressed audio only as 16-bit samples, the one size
+	// devices accept it in (cn=0)
+	if (pcmPayload && format.bitsPerSample == 16)
+	{
+		requestBody.append(Poco::format(
+			"m=audio 0 RTP/AVP 96\r\n"
+			"a=rtpmap:96 L16/%u/%u\r\n",
+			format.samplesPerSecond,
+			format.channelCount));
+	}
+	else
+	{
+		requestBody.append(Poco::format(
+			"m=audio 0 RTP/AVP 96\r\n"
+			"a=rtpmap:96 AppleLossless\r\n"
+			"a=fmtp:96 %u 0 %u 40 10 14 %u 255 0 0 %u\r\n",
+			format.framesPerPacket,
+			format.bitsPerSample,
+			format.channelCount,
+			format.samplesPerSecond));
+	}
 
 	if (!aesKey.empty() && !aesIV.empty())
 	{
@@ -640,13 +746,9 @@ int RTSPClient::doRecord(
  */
 int RTSPClient::doFlush(const uint16_t rtpSeqNum, const uint32_t rtpTime)
 {
-	RTSPRequest request("FLUSH");
-	request.setHeader(RTP_INFO_HEADER,
-					  Poco::format("seq=%hu;rtptime=%u", rtpSeqNum, rtpTime));
+	std::future<int> statusCode(postFlush(rtpSeqNum, rtpTime));
 
-	RTSPResponse response(_impl->sendRequestReceiveResponse(request));
-
-	return response.statusCode();
+	return awaitStatus(statusCode);
 }
 
 /**
@@ -682,13 +784,15 @@ int RTSPClient::doGetParameter(
 	parameterValue.clear();
 	assert(!parameterName.empty());
 
+	const std::string requestBody(parameterName + "\r\n");
+
 	RTSPRequest request("GET_PARAMETER");
-	request.setBody(parameterName + "\r\n", "text/parameters");
+	request.setBody(requestBody, "text/parameters");
 	RTSPResponse response(_impl->sendRequestReceiveResponse(request));
 
 	if (response.statusCode() == RTSP_STATUS_CODE_OK && response.getHeader(CONTENT_TYPE_HEADER) == "text/parameters")
 	{
-		parameterValue = StringTokenizer(response.body, ":", StringTokenizer::TOK_TRIM)[1];
+		parameterValue = StringTokenizer(response.body(), ":", StringTokenizer::TOK_TRIM)[1];
 	}
 
 	return response.statusCode();
@@ -703,6 +807,55 @@ int RTSPClient::doGetParameter(
  */
 int RTSPClient::doSetParameter(
 	const std::string &parameterName, const std::string &parameterValue)
+{
+	std::future<int> statusCode(postSetParameter(parameterName, parameterValue));
+
+	return awaitStatus(statusCode);
+}
+
+/**
+ * Sends RTSP SET_PARAMETER message.
+ *
+ * @param contentType parameter content type
+ * @param requestBody parameter content data
+ * @param rtpTime RTP stream time for server to apply parameter change
+ * @return response status code (positive)
+ */
+int RTSPClient::doSetParameter(
+	const std::string &contentType, const buffer_t &requestBody, const uint32_t rtpTime)
+{
+	std::future<int> statusCode(postSetParameter(contentType, requestBody, rtpTime));
+
+	return awaitStatus(statusCode);
+}
+
+/**
+ * Posts RTSP FLUSH message.
+ *
+ * @param rtpSeqNum RTP sequence number of next packet
+ * @param rtpTime RTP stream time for start of next packet
+ * @return future response status code (positive)
+ */
+std::future<int> RTSPClient::postFlush(const uint16_t rtpSeqNum, const uint32_t rtpTime)
+{
+	RTSPRequest request("FLUSH");
+	request.setHeader(RTP_INFO_HEADER,
+					  Poco::format("seq=%hu;rtptime=%u", rtpSeqNum, rtpTime));
+
+	return _impl->postRequest(request);
+}
+
+/**
+ * Posts RTSP SET_PARAMETER message.
+ *
+ * @param parameterName
+ * @param parameterValue
+ * @param completed optional event to set once response arrives or request fails
+ * @return future response status code (positive)
+ */
+std::future<int> RTSPClient::postSetParameter(
+	const std::string &parameterName, const std::string &parameterValue,
+	Poco::Event *const completed)
 {
 	assert(!parameterName.empty());
 	assert(!parameterValue.empty());
@@ -713,20 +866,18 @@ int RTSPClient::doSetParameter(
 	RTSPRequest request("SET_PARAMETER");
 	request.setBody(requestBody, "text/parameters");
 
-	RTSPResponse response(_impl->sendRequestReceiveResponse(request));
-
-	return response.statusCode();
+	return _impl->postRequest(request, completed);
 }
 
 /**
- * Sends RTSP SET_PARAMETER message.
+ * Posts RTSP SET_PARAMETER message.
  *
  * @param contentType parameter content type
  * @param requestBody parameter content data
  * @param rtpTime RTP stream time for server to apply parameter change
- * @return response status code (positive)
+ * @return future response status code (positive)
  */
-int RTSPClient::doSetParameter(
+std::future<int> RTSPClient::postSetParameter(
 	const std::string &contentType, const buffer_t &requestBody, const uint32_t rtpTime)
 {
 	assert(!contentType.empty());
@@ -735,9 +886,12 @@ int RTSPClient::doSetParameter(
 	request.setBody(requestBody, contentType);
 	request.setHeader(RTP_INFO_HEADER, Poco::format("rtptime=%u", rtpTime));
 
-	RTSPResponse response(_impl->sendRequestReceiveResponse(request));
+	return _impl->postRequest(request);
+}
 
-	return response.statusCode();
+int RTSPClient::awaitStatus(std::future<int> &statusCode)
+{
+	return awaitResult(statusCode);
 }
 
 //------------------------------------------------------------------------------
@@ -749,15 +903,22 @@ RTSPClientImpl::RTSPClientImpl(StreamSocket &rtspSocket, const uint32_t &remoteC
 	  _localSessionId(0),
 	  _remoteSessionId(),
 	  _remoteControlId(remoteControlId),
-	  _rtspSocket(rtspSocket)
+	  _rtspSocket(rtspSocket),
+	  _receiveBuffer(2048),
+	  _receiveStart(0),
+	  _receiveEnd(0),
+	  _receiveScanned(0),
+	  _socketReactor(NULL),
+	  _isClosed(false),
+	  _readableHandler(*this, &RTSPClientImpl::handleReadable)
 {
 	_rtspSocket.setBlocking(true);
 	_rtspSocket.setKeepAlive(true);
 	_rtspSocket.setLinger(true, 1);
 	_rtspSocket.setNoDelay(true);
 
-	_rtspSocket.setSendTimeout(Timespan(10, 0));
-	_rtspSocket.setReceiveTimeout(Timespan(10, 0));
+	_rtspSocket.setSendTimeout(Timespan(RESPONSE_TIMEOUT, 0));
+	_rtspSocket.setReceiveTimeout(Timespan(RESPONSE_TIMEOUT, 0));
 }
 
 RTSPClientImpl::~RTSPClientImpl()
@@ -771,13 +932,100 @@ RTSPClientImpl::~RTSPClientImpl()
 
 RTSPResponse RTSPClientImpl::sendRequestReceiveResponse(RTSPRequest &request)
 {
-	FastMutex::ScopedLock lock(_rtspMutex); // serialize request-response pairs
+	std::shared_ptr<RTSPResponsePromise> completion(new RTSPResponsePromise);
+	std::future<RTSPResponse> response(completion->future());
+
+	postRequest(request, completion);
+
+	return awaitResult(response);
+}
+
+std::future<int> RTSPClientImpl::postRequest(RTSPRequest &request, Poco::Event *const completed)
+{
+	std::shared_ptr<RTSPStatusPromise> completion(new RTSPStatusPromise(completed));
+	std::future<int> statusCode(completion->future());
+
+	postRequest(request, completion);
+
+	return statusCode;
+}
+
+void RTSPClientImpl::postRequest(RTSPRequest &request,
+								 const std::shared_ptr<RTSPCompletion> &completion)
+{
+	// serialize requests, so they are sent in sequence (and responses are
+	// received in turn if unattached); the reactor's thread never takes this
+	// lock, so a device slow to take a request holds up no other socket
+	FastMutex::ScopedLock writeLock(_writeMutex);
+
+	PendingRequest pending;
+	pending.method = request.method();
+	pending.completion = completion;
+
+	// printable copy of request is only built if it will be seen
+	const bool printRequest = Debugger::isEnabled();
+	std::string requestHead, requestText;
+	bool isAttached;
+	{
+		FastMutex::ScopedLock lock(_rtspMutex);
+
+		if (_isClosed)
+		{
+			throw std::runtime_error("RTSP connection is closed");
+		}
+
+		pending.cSeq = ++_messageSequenceNumber;
+		buildRequest(request, pending.cSeq, requestHead, printRequest ? &requestText : NULL);
+
+		// reactor's thread completes request when its response arrives, which
+		// may be as soon as it is sent, so queue it first
+		isAttached = (_socketReactor != NULL);
+		if (isAttached)
+		{
+			_pendingRequests.push_back(pending);
+		}
+	}
+
+	if (printRequest)
+	{
+		Debugger::print(requestText + std::string(80, '-'));
+	}
+	try
+	{
+		sendRequest(requestHead, request.body(), request.bodyLength());
+	}
+	catch (...)
+	{
+		FastMutex::ScopedLock lock(_rtspMutex);
+		for (std::deque<PendingRequest>::iterator it = _pendingRequests.begin();
+			 it != _pendingRequests.end(); ++it)
+		{
+			if (it->cSeq == pending.cSeq)
+			{
+				_pendingRequests.erase(it);
+				break;
+			}
+		}
+		throw;
+	}
+
+	if (!isAttached)
+	{
+		const RTSPResponse response(receiveResponse());
+
+		FastMutex::ScopedLock lock(_rtspMutex);
+		completeRequest(pending, response);
+	}
+}
 
+void RTSPClientImpl::buildRequest(RTSPRequest &request, const uint32_t cSeq,
+								  std::string &requestHead, std::string *const requestText)
+{
 	const std::string requestURI(_localSessionId == 0 ? (request.method() == "POST" ? "/auth-setup" : "*")
 													  : Poco::format("rtsp://%s/%u", _rtspSocket.address().host().toString(), _localSessionId));
 
 	request.setHeader(USER_AGENT_HEADER, Plugin::userAgent());
-	request.setHeader(CSEQ_HEADER, Poco::format("%u", _messageSequenceNumber + 1));
+	request.setHeader(CSEQ_HEADER, Poco::format("%u", cSeq));
 	request.setHeader(ACTIVE_REMOTE_HEADER, Poco::format("%u", _remoteControlId));
 	request.setHeader(CLIENT_INSTANCE_HEADER, Poco::format("%016?X", Plugin::dacpId()));
 	request.setHeader(DACP_ID_HEADER, Poco::format("%016?X", Plugin::dacpId()));
@@ -787,103 +1035,300 @@ RTSPResponse RTSPClientImpl::sendRequestReceiveResponse(RTSPRequest &request)
 		request.setHeader(AUTHORIZATION_HEADER,
 						  buildAuthorizationHeader(request.method(), requestURI));
 
-	buffer_t requestData;
-	std::string requestText;
-	request.build(requestData, requestText, requestURI);
-
-	Debugger::print(requestText + std::string(80, '-'));
-	sendRequest(requestData);
-
-	const std::string responseText(receiveResponse());
-	Debugger::print(responseText + std::string(80, '-'));
+	request.build(requestHead, requestText, requestURI);
+}
 
-	// increment sequence number after successful reception of response
-	_messageSequenceNumber += 1;
+void RTSPClientImpl::completeRequest(const PendingRequest &pending, const RTSPResponse &response)
+{
+	Debugger::print(response.text() + std::string(80, '-'));
 
-	RTSPResponse response(responseText);
+	try
+	{
+		// validate response sequence number
+		if (response.hasHeader(CSEQ_HEADER))
+		{
+			const std::string &cSeqHeader(response.getHeader(CSEQ_HEADER));
+			assert(pending.cSeq == NumberParser::parseDecimalIntegerTo<uint32_t>(cSeqHeader));
+		}
 
-	// validate response sequence number
-	if (response.hasHeader(CSEQ_HEADER))
+		// check response for authenticate header
+		if (response.hasHeader(WWW_AUTHENTICATE_HEADER))
+		{
+			parseAuthenticateHeader(response.getHeader(WWW_AUTHENTICATE_HEADER));
+		}
+	}
+	catch (...)
 	{
-		const std::string &cSeqHeader(response.getHeader(CSEQ_HEADER));
-		assert(_messageSequenceNumber == NumberParser::parseDecimalIntegerTo<uint32_t>(cSeqHeader));
+		pending.completion->fail(std::current_exception());
+		return;
 	}
 
-	// check response for authenticate header
-	if (response.hasHeader(WWW_AUTHENTICATE_HEADER))
+	if (response.statusCode() != RTSP_STATUS_CODE_OK)
 	{
-		parseAuthenticateHeader(response.getHeader(WWW_AUTHENTICATE_HEADER));
+		Debugger::printf("%s request %u returned status %i.",
+						 pending.method.c_str(), pending.cSeq, response.statusCode());
 	}
 
-	return response;
+	pending.completion->complete(response);
 }
 
-void RTSPClientImpl::sendRequest(const buffer_t &requestData)
+void RTSPClientImpl::sendRequest(const std::string &requestHead,
+								 const byte_t *const body, const size_t bodyLength)
 {
-	assert(!requestData.empty());
-
-	const byte_t *const requestBuffer = &requestData[0];
-	const size_t requestLength = requestData.size();
+	assert(!requestHead.empty());
+
+	const size_t requestLength = requestHead.length() + bodyLength;
+
+	// gather head and body into one send, so body is never copied
+#if defined(_WIN32)
+	WSABUF buffers[2];
+	buffers[0].buf = (CHAR *)requestHead.data();
+	buffers[0].len = (ULONG)requestHead.length();
+	buffers[1].buf = (CHAR *)body;
+	buffers[1].len = (ULONG)bodyLength;
+
+	DWORD bytesSent = 0;
+	const int returnCode = WSASend(_rtspSocket.impl()->sockfd(), buffers, (bodyLength > 0 ? 2 : 1),
+								   &bytesSent, 0, NULL, NULL);
+	if (returnCode != 0)
+	{
+		throw std::runtime_error(
+			Poco::format("WSASend returned error %i", WSAGetLastError()));
+	}
+	if (static_cast<size_t>(bytesSent) != requestLength)
+	{
+		throw std::runtime_error("bytesSent != requestLength");
+	}
+#else
+	struct iovec vectors[2];
+	vectors[0].iov_base = const_cast<char *>(requestHead.data());
+	vectors[0].iov_len = requestHead.length();
+	vectors[1].iov_base = const_cast<byte_t *>(body);
+	vectors[1].iov_len = bodyLength;
+
+	struct msghdr message;
+	std::memset(&message, 0, sizeof(message));
+	message.msg_iov = vectors;
+	message.msg_iovlen = (bodyLength > 0 ? 2 : 1);
 
 	size_t bytesSent = 0;
 	while (bytesSent < requestLength)
 	{
-		const int returnCode = _rtspSocket.sendBytes(
-			requestBuffer + bytesSent, requestLength - bytesSent);
+		const ssize_t returnCode = ::sendmsg(_rtspSocket.impl()->sockfd(), &message, MSG_NOSIGNAL);
 		if (returnCode <= 0)
 		{
+			if (returnCode < 0 && errno == EINTR)
+				continue;
 			throw std::runtime_error(
-				Poco::format("_rtspSocket.sendBytes returned %i", returnCode));
+				Poco::format("sendmsg returned %i (%s)", static_cast<int>(returnCode), std::string(std::strerror(errno))));
 		}
 
 		bytesSent += static_cast<size_t>(returnCode);
+
+		// skip past whatever was sent for next attempt
+		size_t skip = static_cast<size_t>(returnCode);
+		while (message.msg_iovlen > 0 && skip >= message.msg_iov->iov_len)
+		{
+			skip -= message.msg_iov->iov_len;
+			message.msg_iov += 1;
+			message.msg_iovlen -= 1;
+		}
+		if (message.msg_iovlen > 0)
+		{
+			message.msg_iov->iov_base = static_cast<char *>(message.msg_iov->iov_base) + skip;
+			message.msg_iov->iov_len -= skip;
+		}
 	}
-	if (bytesSent != requestLength)
+#endif
+}
+
+RTSPResponse RTSPClientImpl::receiveResponse()
+{
+	try
 	{
-		throw std::runtime_error("bytesSent != requestLength");
+		// receive until headers are complete, searching only new bytes each time
+		size_t headerLength;
+		while ((headerLength = receivedHeaderLength()) == 0)
+		{
+			receiveMore();
+		}
+
+		RTSPResponse response(&_receiveBuffer[_receiveStart], headerLength);
+
+		// receive rest of body if content length is provided
+		while (!takeResponse(response, headerLength))
+		{
+			receiveMore();
+		}
+
+		return response;
+	}
+	catch (...)
+	{
+		// partial response would be mistaken for start of next one
+		_receiveStart = _receiveEnd = _receiveScanned = 0;
+		throw;
+	}
+}
+
+void RTSPClientImpl::receiveMore()
+{
+	if (_receiveEnd == _receiveBuffer.size())
+	{
+		if (_receiveStart > 0)
+		{
+			// make room by moving unreturned bytes to front of buffer
+			std::copy(_receiveBuffer.begin() + _receiveStart,
+					  _receiveBuffer.begin() + _receiveEnd, _receiveBuffer.begin());
+			_receiveEnd -= _receiveStart;
+			_receiveStart = 0;
+		}
+		else
+		{
+			_receiveBuffer.resize(_receiveBuffer.size() * 2);
+		}
+	}
+
+	// take as many bytes as are available, up to space left in buffer
+	const int code = _rtspSocket.receiveBytes(
+		&_receiveBuffer[_receiveEnd], static_cast<int>(_receiveBuffer.size() - _receiveEnd));
+	if (code <= 0)
+	{
+		throw std::runtime_error(
+			Poco::format("_rtspSocket.receiveBytes returned %i", code));
+	}
+
+	_receiveEnd += static_cast<size_t>(code);
+}
+
+size_t RTSPClientImpl::receivedHeaderLength()
+{
+	const size_t received = _receiveEnd - _receiveStart;
+	const size_t headerLength = RTSPResponse::headerLength(
+		&_receiveBuffer[_receiveStart], received, _receiveScanned);
+	if (headerLength == 0)
+	{
+		_receiveScanned = received;
+	}
+
+	return headerLength;
+}
+
+bool RTSPClientImpl::takeResponse(RTSPResponse &response, const size_t headerLength)
+{
+	const size_t responseLength = headerLength + response.contentLength();
+	if (_receiveEnd - _receiveStart < responseLength)
+	{
+		return false;
+	}
+
+	response.setText(&_receiveBuffer[_receiveStart]);
+
+	// keep any bytes received after response for next time
+	_receiveStart += responseLength;
+	_receiveScanned = 0;
+	if (_receiveStart == _receiveEnd)
+	{
+		_receiveStart = _receiveEnd = 0;
 	}
+
+	return true;
 }
 
-std::string RTSPClientImpl::receiveResponse()
+void RTSPClientImpl::handleReadable(ReadableNotification *)
 {
-	std::vector<char> responseBuffer(512);
-	size_t responseLength = 0;
-	int32_t lastFour = 0;
-	char octet;
-	int code;
+	FastMutex::ScopedLock lock(_rtspMutex);
 
-	do
+	try
 	{
-		if (responseBuffer.size() == responseLength)
-			responseBuffer.resize(responseBuffer.size() * 2);
+		// take what has arrived, then as many responses as it completes
+		receiveMore();
 
-		if ((code = _rtspSocket.receiveBytes(&octet, 1)) <= 0)
+		size_t headerLength;
+		while ((headerLength = receivedHeaderLength()) > 0)
 		{
-			throw std::runtime_error(
-				Poco::format("_rtspSocket.receiveBytes returned %i", code));
+			RTSPResponse response(&_receiveBuffer[_receiveStart], headerLength);
+			if (!takeResponse(response, headerLength))
+			{
+				break;
+			}
+
+			dispatchResponse(response);
 		}
+	}
+	catch (const std::exception &ex)
+	{
+		closeConnection(ex.what());
+	}
+	catch (...)
+	{
+		closeConnection("unknown error");
+	}
+}
+
+void RTSPClientImpl::dispatchResponse(const RTSPResponse &response)
+{
+	// responses come in order of requests, so one without a sequence number
+	// answers the oldest pending request
+	uint32_t cSeq = (_pendingRequests.empty() ? 0 : _pendingRequests.front().cSeq);
+	if (response.hasHeader(CSEQ_HEADER))
+	{
+		cSeq = NumberParser::parseDecimalIntegerTo<uint32_t>(response.getHeader(CSEQ_HEADER));
+	}
 
-		lastFour = (lastFour << 8) | octet;
-		responseBuffer[responseLength] = octet;
-		responseLength += static_cast<size_t>(code);
-	} while (lastFour != 0x0D0A0D0A); // read until "\r\n\r\n"
+	// any request older than the one answered will not get a response
+	while (!_pendingRequests.empty() && static_cast<int32_t>(cSeq - _pendingRequests.front().cSeq) > 0)
+	{
+		const PendingRequest pending(_pendingRequests.front());
+		_pendingRequests.pop_front();
+
+		Debugger::printf("%s request %u received no response.", pending.method.c_str(), pending.cSeq);
+		pending.completion->fail(std::make_exception_ptr(
+			std::runtime_error("RTSP response skipped")));
+	}
 
-	// read response body if content length is provided
-	std::match_results<std::vector<char>::iterator> mr;
-	if (std::regex_search(responseBuffer.begin(), responseBuffer.end(),
-						  mr, std::regex("\\bContent-Length:\\s*(\\d+)\r\n")))
+	if (_pendingRequests.empty() || _pendingRequests.front().cSeq != cSeq)
 	{
-		const size_t contentLength = NumberParser::parseDecimalIntegerTo<size_t>(mr[1]);
+		Debugger::printf("Unexpected RTSP response %u dropped.", cSeq);
+		Debugger::print(response.text() + std::string(80, '-'));
+		return;
+	}
+
+	const PendingRequest pending(_pendingRequests.front());
+	_pendingRequests.pop_front();
+
+	completeRequest(pending, response);
+}
+
+void RTSPClientImpl::closeConnection(const std::string &reason)
+{
+	Debugger::printf("RTSP connection closed: %s", reason.c_str());
 
-		if (contentLength > responseBuffer.size() - responseLength)
-			responseBuffer.resize(responseLength + contentLength);
-		code = _rtspSocket.receiveBytes(&responseBuffer[responseLength], contentLength);
-		assert(static_cast<size_t>(code) == contentLength);
-		responseLength += contentLength;
+	// partial response would be mistaken for start of next one
+	_receiveStart = _receiveEnd = _receiveScanned = 0;
+	_isClosed = true;
+
+	// stop notifications, which recur while the socket stays readable;
+	// reactor allows this from within the handler
+	SocketReactor *const socketReactor = _socketReactor;
+	if (socketReactor != NULL)
+	{
+		socketReactor->removeEventHandler(_rtspSocket, _readableHandler);
 	}
 
-	assert(responseBuffer.size() >= responseLength);
-	return std::string(&responseBuffer[0], responseLength);
+	failPendingRequests(reason);
+}
+
+void RTSPClientImpl::failPendingRequests(const std::string &reason)
+{
+	while (!_pendingRequests.empty())
+	{
+		const PendingRequest pending(_pendingRequests.front());
+		_pendingRequests.pop_front();
+
+		Debugger::printf("%s request %u failed: %s", pending.method.c_str(), pending.cSeq, reason.c_str());
+		pending.completion->fail(std::make_exception_ptr(std::runtime_error(reason)));
+	}
 }
 
 void RTSPClientImpl::parseAuthenticateHeader(const std::string &authenticateHeader)
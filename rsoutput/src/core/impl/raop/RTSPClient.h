@@ -21,7 +21,10 @@
 #include "Platform.h"
 #include "Uncopyable.h"
 #include "impl/Device.h"
+#include <future>
 #include <string>
+#include <Poco/Event.h>
+#include <Poco/Net/SocketReactor.h>
 #include <Poco/Net/StreamSocket.h>
 
 
@@ -35,11 +38,17 @@ public:
 
 	bool isReady() const;
 
+	// once attached, responses are read on the reactor's thread, so requests
+	// can be posted without waiting for those before them to be answered
+	void attach(Poco::Net::SocketReactor&);
+	void detach();
+
 	void setPassword(const std::string&);
 
 	int doOptions(void* rsaKey);
 	int doPostAuth(const std::string& pubKey);
-	int doAnnounce(const std::string& aesKey, const std::string& aesIV);
+	int doAnnounce(const std::string& aesKey, const std::string& aesIV,
+		const struct RAOPStreamFormat&, bool pcmPayload);
 	int doSetup(uint16_t& serverPort, uint16_t& controlPort, uint16_t& timingPort,
 		unsigned int& audioLatency, AudioJackStatus&);
 	int doRecord(uint16_t rtpSeqNum, uint32_t rtpTime, unsigned int& audioLatency);
@@ -51,6 +60,18 @@ public:
 	int doSetParameter(const std::string& contentType, const buffer_t& requestBody,
 		uint32_t rtpTime);
 
+	// send request and return its eventual status code; any that cannot be
+	// sent throw, any that fail afterward rethrow from the future, which the
+	// given event (if any) signals once ready
+	std::future<int> postFlush(uint16_t rtpSeqNum, uint32_t rtpTime);
+	std::future<int> postSetParameter(const std::string& key, const std::string& val,
+		Poco::Event* completed = NULL);
+	std::future<int> postSetParameter(const std::string& contentType,
+		const buffer_t& requestBody, uint32_t rtpTime);
+
+	// waits as long as for a response to a blocking request
+	static int awaitStatus(std::future<int>&);
+
 private:
 	class RTSPClientImpl* const _impl;
 };
@@ -0,0 +1,207 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "RTSPResponse.h"
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+
+static const char CONTENT_LENGTH_HEADER[] = "Content-Length";
+
+
+static char toLower(const char c)
+{
+	return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+
+static bool equalsIgnoreCase(const char* a, const char* b, const size_t length)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		if (toLower(a[i]) != toLower(b[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// parses unsigned decimal digits, all of them; returns false on overflow or if
+// there are none
+static bool parseDecimal(const char* const data, const size_t length, size_t& value)
+{
+	if (length == 0)
+	{
+		return false;
+	}
+
+	value = 0;
+	for (size_t i = 0; i < length; ++i)
+	{
+		const unsigned int digit = static_cast<unsigned char>(data[i]) - '0';
+		if (digit > 9 || value > (std::numeric_limits<size_t>::max() - digit) / 10)
+		{
+			return false;
+		}
+		value = (value * 10) + digit;
+	}
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+size_t RTSPResponse::headerLength(const char* const data, const size_t length,
+	const size_t scanned)
+{
+	// back up in case the previous search stopped partway through "\r\n\r\n"
+	size_t i = (scanned > 3 ? scanned - 3 : 0);
+
+	while (i + 4 <= length)
+	{
+		const void* const cr = std::memchr(data + i, '\r', length - 3 - i);
+		if (cr == NULL)
+		{
+			break;
+		}
+
+		i = static_cast<const char*>(cr) - data;
+		if (std::memcmp(data + i, "\r\n\r\n", 4) == 0)
+		{
+			return i + 4;
+		}
+		++i;
+	}
+
+	return 0;
+}
+
+
+RTSPResponse::RTSPResponse(const char* const data, const size_t headerLength)
+:
+	_statusCode(0),
+	_contentLength(0),
+	_headerLength(headerLength),
+	_headerCount(0)
+{
+	assert(headerLength >= 4 && std::memcmp(data + headerLength - 4, "\r\n\r\n", 4) == 0);
+
+	const char* const end = data + headerLength - 2; // last line break
+	const char* p = data;
+
+	// parse status line for protocol and version, status code and status text
+	const char* const space = static_cast<const char*>(std::memchr(p, ' ', end - p));
+	if (space == NULL || space - p < 6 || std::memcmp(p, "RTSP/", 5) != 0)
+	{
+		throw std::invalid_argument("responseText");
+	}
+	p = space + 1;
+
+	size_t statusCode;
+	if (end - p < 4 || !parseDecimal(p, 3, statusCode) || (p[3] != ' ' && p[3] != '\r'))
+	{
+		throw std::invalid_argument("responseText");
+	}
+	_statusCode = static_cast<int>(statusCode);
+
+	p = static_cast<const char*>(std::memchr(p, '\r', end - p)) + 2;
+
+	// parse headers, recording where their names and values are
+	while (p < end)
+	{
+		const char* const lineEnd = static_cast<const char*>(std::memchr(p, '\r', end + 1 - p));
+		const char* const colon = static_cast<const char*>(std::memchr(p, ':', lineEnd - p));
+		if (colon == NULL || colon == p || lineEnd[1] != '\n')
+		{
+			throw std::invalid_argument("responseText");
+		}
+		if (_headerCount == MAX_HEADERS)
+		{
+			throw std::invalid_argument("too many headers");
+		}
+
+		const char* value = colon + 1;
+		while (value < lineEnd && (*value == ' ' || *value == '\t'))
+		{
+			++value;
+		}
+
+		Header& header = _headers[_headerCount++];
+		header.name.offset = p - data;
+		header.name.length = colon - p;
+		header.value.offset = value - data;
+		header.value.length = lineEnd - value;
+
+		p = lineEnd + 2;
+	}
+
+	// body length is needed before the body can be received
+	const Header* const contentLengthHeader = findHeader(data,
+		CONTENT_LENGTH_HEADER, sizeof(CONTENT_LENGTH_HEADER) - 1);
+	if (contentLengthHeader != NULL
+		&& !parseDecimal(data + contentLengthHeader->value.offset,
+			contentLengthHeader->value.length, _contentLength))
+	{
+		throw std::invalid_argument("Content-Length");
+	}
+}
+
+
+void RTSPResponse::setText(const char* const data)
+{
+	_text.assign(data, _headerLength + _contentLength);
+}
+
+
+bool RTSPResponse::hasHeader(const std::string& name) const
+{
+	return (findHeader(_text.data(), name.data(), name.length()) != NULL);
+}
+
+
+std::string RTSPResponse::getHeader(const std::string& name) const
+{
+	const Header* const header = findHeader(_text.data(), name.data(), name.length());
+	return (header == NULL ? std::string()
+		: _text.substr(header->value.offset, header->value.length));
+}
+
+
+std::string RTSPResponse::body() const
+{
+	return _text.substr(_headerLength);
+}
+
+
+const RTSPResponse::Header* RTSPResponse::findHeader(const char* const data,
+	const char* const name, const size_t nameLength) const
+{
+	for (size_t i = 0; i < _headerCount; ++i)
+	{
+		const Header& header = _headers[i];
+		if (header.name.length == nameLength
+			&& equalsIgnoreCase(data + header.name.offset, name, nameLength))
+		{
+			return &header;
+		}
+	}
+	return NULL;
+}
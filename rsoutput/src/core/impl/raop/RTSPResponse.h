@@ -0,0 +1,82 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RTSPResponse_h
+#define RTSPResponse_h
+
+
+#include "Platform.h"
+#include <string>
+
+
+/**
+ * RTSP response parsed in place. The status line and headers are parsed
+ * straight from the receive buffer into offsets, without building strings;
+ * the response then keeps one copy of its text so it outlives that buffer.
+ */
+class RTSPResponse
+{
+public:
+	// returns length of status line and headers through the blank line that
+	// ends them, or zero if not all received yet; search resumes at scanned
+	static size_t headerLength(const char* data, size_t length, size_t scanned = 0);
+
+	// parses headerLength bytes of data; throws std::invalid_argument if they
+	// are not a well-formed response
+	RTSPResponse(const char* data, size_t headerLength);
+
+	int statusCode() const { return _statusCode; }
+	// from Content-Length header; zero if absent
+	size_t contentLength() const { return _contentLength; }
+
+	// copies status line, headers and body (the next contentLength bytes)
+	void setText(const char* data);
+	const std::string& text() const { return _text; }
+
+	// header names are matched ignoring case
+	bool hasHeader(const std::string& name) const;
+	std::string getHeader(const std::string& name) const;
+	std::string body() const;
+
+private:
+	struct Span
+	{
+		size_t offset;
+		size_t length;
+	};
+
+	struct Header
+	{
+		Span name;
+		Span value;
+	};
+
+	enum { MAX_HEADERS = 32 };
+
+	const Header* findHeader(const char* data, const char* name, size_t nameLength) const;
+
+	int _statusCode;
+	size_t _contentLength;
+	size_t _headerLength;
+
+	Header _headers[MAX_HEADERS];
+	size_t _headerCount;
+
+	std::string _text;
+};
+
+
+#endif // RTSPResponse_h
@@ -0,0 +1,416 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "Debugger.h"
+#include "RAOPDevice.h"
+#include "ResendService.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <Poco/ByteOrder.h>
+#include <Poco/Format.h>
+
+using Poco::ByteOrder;
+using Poco::Net::DatagramSocket;
+using Poco::Net::SocketAddress;
+
+// packets close to being recycled for new audio data are not resent
+static const uint16_t RESEND_MEMORY_MARGIN = 50;
+
+// each device may have up to 125 packets (about a second of audio) resent in
+// a burst, and about twice the stream rate in the long run
+static const double RESEND_BURST_PACKETS = 125.0;
+static const double RESEND_PACKETS_PER_SECOND = 250.0;
+
+// maximum time to wait for resend requests before checking for shutdown
+static const long RESEND_WAIT_MSEC = 100;
+
+
+ResendService::ResendService(DatagramSocket& controlSocket,
+	const PacketBuffer& rtpDataSecured, const PacketBuffer& rtpDataUnsecured,
+	const uint16_t memoryCount, Poco::FastMutex& memoryMutex)
+:
+	_rtpDataSecured(rtpDataSecured),
+	_rtpDataUnsecured(rtpDataUnsecured),
+	_memoryCount(memoryCount),
+	_memoryMutex(memoryMutex),
+	_sentCount(0),
+	_firstSeqNum(0),
+	_batch(controlSocket),
+	_stopping(false),
+	_thread("RAOPEngine.ResendService::run"),
+	_runnable(*this, &ResendService::run)
+{
+	assert(memoryCount > RESEND_MEMORY_MARGIN);
+
+	_thread.start(_runnable);
+}
+
+
+ResendService::~ResendService()
+{
+	try
+	{
+		_stopping = true;
+		_requestEvent.set();
+		_thread.join();
+	}
+	CATCH_ALL
+}
+
+
+void ResendService::init(const byte_t* const key, const byte_t* const iv, const bool batching)
+{
+	ScopedLock lock(_mutex);
+
+	_cipher.init(key, iv);
+	_batch.setBatching(batching);
+}
+
+
+void ResendService::reset(const uint16_t firstSeqNum)
+{
+	{
+		Poco::FastMutex::ScopedLock lock(_requestMutex);
+		_requests.clear();
+	}
+
+	ScopedLock lock(_mutex);
+
+	_firstSeqNum = firstSeqNum;
+	_sentCount.store(0, std::memory_order_release);
+}
+
+
+void ResendService::addDevice(const RAOPDevice& raopDevice)
+{
+	ScopedLock lock(_mutex);
+
+	Requestor& requestor = _requestors[&raopDevice];
+	requestor.secured = raopDevice.secureDataStream();
+	requestor.tokens = RESEND_BURST_PACKETS;
+	requestor.lastRefill = PacingTimer::now();
+	requestor.packets.clear();
+
+	// devices send requests from their control port, audio port or the port
+	// after their audio port
+	const SocketAddress& controlAddr = raopDevice.controlSocketAddr();
+	const SocketAddress& audioAddr = raopDevice.audioSocketAddr();
+	_requestorLookup[lookupKey(controlAddr)] = &raopDevice;
+	_requestorLookup[lookupKey(audioAddr)] = &raopDevice;
+	_requestorLookup[lookupKey(SocketAddress(audioAddr.host(), audioAddr.port() + 1))] = &raopDevice;
+}
+
+
+void ResendService::removeDevice(const RAOPDevice& raopDevice)
+{
+	ScopedLock lock(_mutex);
+
+	_requestors.erase(&raopDevice);
+
+	for (std::map<std::string, const RAOPDevice*>::iterator it = _requestorLookup.begin();
+		it != _requestorLookup.end();)
+	{
+		if (it->second == &raopDevice)
+		{
+			it = _requestorLookup.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+
+void ResendService::clearDevices()
+{
+	ScopedLock lock(_mutex);
+
+	_requestors.clear();
+	_requestorLookup.clear();
+}
+
+
+void ResendService::request(const SocketAddress& requestor,
+	const uint16_t seqNum, const uint16_t count)
+{
+	Request request;
+	request.requestor = requestor;
+	request.seqNum = seqNum;
+	request.count = count;
+
+	{
+		Poco::FastMutex::ScopedLock lock(_requestMutex);
+		_requests.push_back(request);
+	}
+
+	_requestEvent.set();
+}
+
+
+std::string ResendService::lookupKey(const SocketAddress& address)
+{
+	return address.toString();
+}
+
+
+void ResendService::run()
+{
+	std::vector<Request> requests;
+
+	while (!_stopping)
+	{
+		try
+		{
+			_requestEvent.tryWait(RESEND_WAIT_MSEC);
+
+			// take all requests that arrived since last time, which coalesces
+			// overlapping requests made during a burst of packet loss
+			{
+				Poco::FastMutex::ScopedLock lock(_requestMutex);
+				requests.swap(_requests);
+			}
+
+			if (!requests.empty())
+			{
+				process(requests);
+				requests.clear();
+			}
+		}
+		CATCH_ALL
+	}
+}
+
+
+void ResendService::process(const std::vector<Request>& requests)
+{
+	ScopedLock lock(_mutex);
+
+	const uint64_t sentCount = _sentCount.load(std::memory_order_acquire);
+	const uint16_t nextSeqNum = static_cast<uint16_t>(_firstSeqNum + sentCount);
+	const uint64_t maxAge = (std::min)(sentCount,
+		static_cast<uint64_t>(_memoryCount - RESEND_MEMORY_MARGIN));
+
+	unsigned int tooOldCount = 0;
+
+	// gather requested packet indices for each device; duplicates collapse
+	for (std::vector<Request>::const_iterator it = requests.begin();
+		it != requests.end(); ++it)
+	{
+		const Request& request = *it;
+
+		Debugger::printf(
+			"Resend requested by %s for %hu packet(s) starting at sequence number %hu.",
+			request.requestor.toString().c_str(), request.count, request.seqNum);
+
+		std::map<std::string, const RAOPDevice*>::const_iterator pos =
+			_requestorLookup.find(lookupKey(request.requestor));
+		if (pos == _requestorLookup.end())
+		{
+			Debugger::printf("Requestor %s not found in list of devices.",
+				request.requestor.toString().c_str());
+			continue;
+		}
+		else if (!pos->second->isOpen())
+		{
+			Debugger::printf("Requestor %s no longer open for playback.",
+				request.requestor.toString().c_str());
+			continue;
+		}
+		Requestor& requestor = _requestors[pos->second];
+		requestor.responseAddr = request.requestor;
+
+		for (uint16_t i = 0; i < request.count; i += 1)
+		{
+			// age is 1 for the most recently sent packet
+			const uint16_t age = static_cast<uint16_t>(nextSeqNum - (request.seqNum + i));
+
+			if (age < 1 || age > maxAge)
+			{
+				tooOldCount += 1;
+				continue;
+			}
+			requestor.packets.insert(sentCount - age);
+		}
+	}
+
+	if (tooOldCount > 0)
+	{
+		Debugger::printf("%u requested packet(s) too old to resend; "
+			"only the last %hu sent packets are kept.",
+			tooOldCount, static_cast<uint16_t>(maxAge));
+	}
+
+	// headers must not move once added to batch, so size them up front
+	size_t packetCount = 0;
+	for (RequestorMap::const_iterator it = _requestors.begin(); it != _requestors.end(); ++it)
+	{
+		packetCount += it->second.packets.size();
+	}
+	if (packetCount == 0)
+	{
+		return;
+	}
+	_headers.resize(packetCount);
+	_scratchIndex.clear();
+	_batch.clear();
+
+	const PacingTimer::Time currentTime = PacingTimer::now();
+	unsigned int limitedCount = 0;
+	unsigned int recycledCount = 0;
+	size_t headerIndex = 0;
+
+	for (RequestorMap::iterator it = _requestors.begin(); it != _requestors.end(); ++it)
+	{
+		Requestor& requestor = it->second;
+		if (requestor.packets.empty())
+		{
+			continue;
+		}
+
+		// refill token bucket for time passed since last resend
+		requestor.tokens = (std::min)(RESEND_BURST_PACKETS, requestor.tokens
+			+ (currentTime - requestor.lastRefill) * RESEND_PACKETS_PER_SECOND / 1000000.0);
+		requestor.lastRefill = currentTime;
+
+		for (std::set<uint64_t>::const_iterator pkt = requestor.packets.begin();
+			pkt != requestor.packets.end(); ++pkt)
+		{
+			if (requestor.tokens < 1.0)
+			{
+				limitedCount += 1;
+				continue;
+			}
+			requestor.tokens -= 1.0;
+
+			// packet may have been recycled for new audio since it was requested
+			const PacketCopy* const packetCopy = copyOf(*pkt, requestor.secured);
+			if (packetCopy == NULL)
+			{
+				recycledCount += 1;
+				continue;
+			}
+			const byte_t* const packetData = &packetCopy->packetData[0];
+
+			const uint16_t seqNum = static_cast<uint16_t>(_firstSeqNum + *pkt);
+			const uint16_t dataPacketSeqNum = ByteOrder::fromNetwork(
+				reinterpret_cast<const DataPacketHeader*>(packetData)->seqNum);
+			if (seqNum != dataPacketSeqNum)
+			{
+				Debugger::printf("Data packet with sequence number %hu was not found"
+					" at anticipated position in packet memory; %hu was in its place.",
+					seqNum, dataPacketSeqNum);
+				continue;
+			}
+
+			// pass packet frame count, which may not be easy to determine from size
+			RTPPacketHeader& header = _headers[headerIndex++];
+			header = RTPPacketHeader();
+			header.setMarker();
+			header.setPayloadType(PAYLOAD_TYPE_RESEND_RESPONSE);
+			header.seqNum = ByteOrder::toNetwork(packetCopy->frameCount);
+
+			// send resend header followed by copy of stored packet
+			_batch.add(requestor.responseAddr, &header, RTP_BASE_HEADER_SIZE,
+				packetData, packetCopy->packetSize);
+		}
+		requestor.packets.clear();
+	}
+
+	if (limitedCount > 0)
+	{
+		Debugger::printf("%u requested packet(s) not resent due to rate limit.", limitedCount);
+	}
+	if (recycledCount > 0)
+	{
+		Debugger::printf("%u requested packet(s) recycled while being resent.", recycledCount);
+	}
+
+	const size_t count = _batch.size();
+	if (_batch.send() < count)
+	{
+		for (size_t i = 0; i < count; i += 1)
+		{
+			if (!_batch.error(i).empty())
+			{
+				Debugger::printException(std::runtime_error(_batch.error(i)),
+					Poco::format("Resending data packet to %s", _batch.address(i).toString()));
+			}
+		}
+	}
+}
+
+
+// copies packet out of memory, or returns NULL if it is no longer there
+const ResendService::PacketCopy* ResendService::copyOf(const uint64_t packetIndex,
+	const bool secured)
+{
+	// copy once per batch; key keeps secured and unsecured variants of same
+	// packet apart
+	const uint64_t key = (packetIndex << 1) | (secured ? 1 : 0);
+	std::map<uint64_t, size_t>::const_iterator pos = _scratchIndex.find(key);
+	if (pos != _scratchIndex.end())
+	{
+		return &_scratch[pos->second];
+	}
+
+	const size_t index = _scratchIndex.size();
+	if (index == _scratch.size())
+	{
+		_scratch.push_back(PacketCopy());
+	}
+	PacketCopy& scratch = _scratch[index];
+
+	{
+		// encoder reserves slots under this lock, and only those of packets
+		// that have left memory, so a slot still in memory while it is held
+		// cannot be written to
+		Poco::FastMutex::ScopedLock memoryLock(_memoryMutex);
+
+		if (_sentCount.load(std::memory_order_acquire) - packetIndex >= _memoryCount)
+		{
+			return NULL;
+		}
+
+		const PacketBuffer::Slot& slotRef = (secured
+			? _rtpDataSecured : _rtpDataUnsecured).packetAt(packetIndex);
+		scratch.packetSize = slotRef.packetSize;
+		scratch.frameCount = slotRef.frameCount;
+		scratch.packetData.resize((std::max)(scratch.packetData.size(), scratch.packetSize));
+		if (slotRef.isFilled)
+		{
+			std::memcpy(&scratch.packetData[0], slotRef.packetData, slotRef.packetSize);
+		}
+		else
+		{
+			// produce missing variant from the other
+			const PacketBuffer::Slot& otherRef = (secured
+				? _rtpDataUnsecured : _rtpDataSecured).packetAt(packetIndex);
+			if (!otherRef.isFilled)
+			{
+				throw std::logic_error("Packet in memory has neither variant filled");
+			}
+
+			_cipher.convertPacket(otherRef.packetData, &scratch.packetData[0],
+				RTP_DATA_HEADER_SIZE, otherRef.payloadSize, secured);
+		}
+	}
+	_scratchIndex[key] = index;
+
+	return &scratch;
+}
@@ -0,0 +1,141 @@
+/* Copyright (c) 2020  Eric Milles <eric.milles@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ResendService_h
+#define ResendService_h
+
+
+#include "DatagramBatch.h"
+#include "PacingTimer.h"
+#include "PacketBuffer.h"
+#include "Platform.h"
+#include "RAOPCipher.h"
+#include "RAOPDefs.h"
+#include "Uncopyable.h"
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <Poco/Event.h>
+#include <Poco/Mutex.h>
+#include <Poco/RunnableAdapter.h>
+#include <Poco/ScopedLock.h>
+#include <Poco/Thread.h>
+#include <Poco/Net/DatagramSocket.h>
+#include <Poco/Net/SocketAddress.h>
+
+
+/**
+ * Answers RTP resend requests on its own thread.  Requests are queued by the
+ * reactor thread, coalesced per device, rate limited and sent as one batch.
+ * Packets are found directly from their sequence numbers in the engine's
+ * packet memory without the engine lock.  Each is copied out under the
+ * engine's memory lock, which the encoder holds to reserve slots for new
+ * packets, so a slot checked to still be in memory is not reserved (and then
+ * overwritten) until its copy is done.
+ */
+class ResendService
+:
+	private Uncopyable
+{
+public:
+	ResendService(Poco::Net::DatagramSocket& controlSocket,
+		const PacketBuffer& rtpDataSecured, const PacketBuffer& rtpDataUnsecured,
+		uint16_t memoryCount, Poco::FastMutex& memoryMutex);
+	~ResendService();
+
+	// these must be called while engine is not sending data packets
+	void init(const byte_t* key, const byte_t* iv, bool batching);
+	void reset(uint16_t firstSeqNum);
+
+	// called by sender after each data packet moves into packet memory
+	void packetSent() { _sentCount.fetch_add(1, std::memory_order_release); }
+
+	void addDevice(const class RAOPDevice&);
+	void removeDevice(const class RAOPDevice&);
+	void clearDevices();
+
+	// queues request and returns immediately
+	void request(const Poco::Net::SocketAddress& requestor, uint16_t seqNum, uint16_t count);
+
+private:
+	struct Request
+	{
+		Poco::Net::SocketAddress requestor;
+		uint16_t seqNum;
+		uint16_t count;
+	};
+
+	struct Requestor
+	{
+		bool secured;
+		double tokens; // packets that may be resent now
+		PacingTimer::Time lastRefill;
+		Poco::Net::SocketAddress responseAddr;
+		std::set<uint64_t> packets; // indices of packets to resend
+	};
+
+	struct PacketCopy
+	{
+		buffer_t packetData;
+		size_t packetSize;
+		uint16_t frameCount;
+	};
+
+	void run();
+	void process(const std::vector<Request>&);
+	const PacketCopy* copyOf(uint64_t packetIndex, bool secured);
+
+	static std::string lookupKey(const Poco::Net::SocketAddress&);
+
+	const PacketBuffer& _rtpDataSecured;
+	const PacketBuffer& _rtpDataUnsecured;
+	const uint16_t _memoryCount;
+	Poco::FastMutex& _memoryMutex;
+
+	/** requests queued by reactor thread */
+	std::vector<Request> _requests;
+	Poco::FastMutex _requestMutex;
+	Poco::Event _requestEvent;
+
+	/** count of data packets sent since reset, and first sequence number */
+	std::atomic<uint64_t> _sentCount;
+	uint16_t _firstSeqNum;
+
+	/** devices that may request resends, found by any of their addresses */
+	typedef std::map<const class RAOPDevice*, Requestor> RequestorMap;
+	RequestorMap _requestors;
+	std::map<std::string, const class RAOPDevice*> _requestorLookup;
+
+	/** cipher and buffers for copies of packets, and variants not in memory */
+	RAOPCipher _cipher;
+	std::vector<PacketCopy> _scratch;
+	std::map<uint64_t, size_t> _scratchIndex;
+
+	DatagramBatch _batch;
+	std::vector<RTPPacketHeader> _headers;
+
+	volatile bool _stopping;
+	Poco::Thread _thread;
+	Poco::RunnableAdapter<ResendService> _runnable;
+
+	Poco::FastMutex _mutex;
+	typedef Poco::FastMutex::ScopedLock ScopedLock;
+};
+
+
+#endif // ResendService_h
@@ -744,6 +744,16 @@ Options::SharedPtr OptionsDialogImpl::buildOptions() const
 
 	const Options::SharedPtr options = Options::getOptions();
 
+	// transfer settings that have no dialog control
+	opts->setBatchedSend(options->getBatchedSend());
+	opts->setMaxSendFailures(options->getMaxSendFailures());
+	opts->setEncoderEffort(options->getEncoderEffort());
+	opts->setResamplerQuality(options->getResamplerQuality());
+	opts->setDownmixLevel(Options::DOWNMIX_CENTER, options->getDownmixLevel(Options::DOWNMIX_CENTER));
+	opts->setDownmixLevel(Options::DOWNMIX_SURROUND, options->getDownmixLevel(Options::DOWNMIX_SURROUND));
+	opts->setDownmixLevel(Options::DOWNMIX_LFE, options->getDownmixLevel(Options::DOWNMIX_LFE));
+	opts->setOutputBufferFrames(options->getOutputBufferFrames());
+
 	// transfer passwords
 	for (DeviceInfoSet::const_iterator it = opts->devices().begin();
 		 it != opts->devices().end(); ++it)
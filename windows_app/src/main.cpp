@@ -5,7 +5,9 @@
 #include <vector>
 #include <map>
 #include <mutex>
-#include <samplerate.h>
+#include <mmreg.h>
+#include <ks.h>
+#include <ksmedia.h>
 
 #include "WASAPICapture.h"
 #include "WindowsPlayer.h"
@@ -28,60 +30,24 @@ std::unique_ptr<WASAPICapture> g_capture;
 std::unique_ptr<WindowsPlayer> g_player;
 std::unique_ptr<OutputComponent> g_output;
 
-class AudioConverter
+// Describes the capture format for the output component, which converts it
+// (sample format, channel layout and rate) to the negotiated stream format
+OutputFormat CaptureFormat(const WAVEFORMATEX *wfx)
 {
-public:
-    AudioConverter(int inputRate, int outputRate)
-        : _srcState(nullptr), _ratio((double)outputRate / inputRate)
-    {
-        int error;
-        _srcState = src_new(SRC_SINC_FASTEST, 2, &error);
-    }
-
-    ~AudioConverter()
-    {
-        if (_srcState)
-            src_delete(_srcState);
-    }
-
-    std::vector<int16_t> Process(const float *input, size_t frames)
+    bool isFloat = (wfx->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+    if (wfx->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
     {
-        if (!_srcState)
-            return {};
-
-        // Prepare output buffer (approx size + margin)
-        size_t outFrames = (size_t)(frames * _ratio) + 256;
-        if (_floatBuffer.size() < outFrames * 2)
-        {
-            _floatBuffer.resize(outFrames * 2);
-        }
-
-        SRC_DATA data;
-        data.data_in = input;
-        data.data_out = _floatBuffer.data();
-        data.input_frames = (long)frames;
-        data.output_frames = (long)outFrames;
-        data.src_ratio = _ratio;
-        data.end_of_input = 0;
-
-        int error = src_process(_srcState, &data);
-        if (error != 0)
-            return {};
-
-        // Convert float to int16
-        std::vector<int16_t> output(data.output_frames_gen * 2);
-        src_float_to_short_array(data.data_out, output.data(), data.output_frames_gen * 2);
-
-        return output;
+        const WAVEFORMATEXTENSIBLE *wfxe = reinterpret_cast<const WAVEFORMATEXTENSIBLE *>(wfx);
+        isFloat = (wfxe->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
     }
 
-private:
-    SRC_STATE *_srcState;
-    double _ratio;
-    std::vector<float> _floatBuffer;
-};
+    if (wfx->nChannels < 1 || wfx->nChannels > 8)
+        throw std::runtime_error("Unsupported capture channel count");
 
-std::unique_ptr<AudioConverter> g_converter;
+    return OutputFormat(SampleRate(wfx->nSamplesPerSec), SampleSize(wfx->wBitsPerSample / 8),
+                        ChannelCount(wfx->nChannels),
+                        SampleEncoding(isFloat ? SampleEncoding::FLOAT : SampleEncoding::INTEGER));
+}
 
 // Device Management
 class TrayDeviceListener : public DeviceDiscovery::Listener
@@ -156,29 +122,15 @@ void InitBackend()
         // Initialize WASAPI Capture
         bool res = g_capture->Initialize([](const BYTE *data, size_t size)
                                          {
-            if (g_output && g_converter) {
-                // WASAPI Loopback is typically 32-bit Float Stereo
-                // We assume the input is float here based on typical Windows behavior
-                // A more robust app would check wfx->wBitsPerSample in the callback or setup a specific converter
-                
-                size_t frames = size / (sizeof(float) * 2);
-                auto converted = g_converter->Process((const float*)data, frames);
-                
-                if (!converted.empty()) {
-                    g_output->write((const BYTE*)converted.data(), converted.size() * sizeof(int16_t));
-                }
+            // captured frames go straight to the output chain, which converts
+            // them block by block without intermediate copies
+            if (g_output && size > 0) {
+                g_output->write(data, size);
             } });
 
         if (res)
         {
-            const WAVEFORMATEX *wfx = g_capture->GetFormat();
-            int inputRate = wfx->nSamplesPerSec;
-
-            // Initialize converter: Input Rate -> 44100
-            g_converter = std::make_unique<AudioConverter>(inputRate, 44100);
-
-            OutputFormat fmt(SampleRate(44100), SampleSize(16), ChannelCount(2));
-            g_output->open(fmt);
+            g_output->open(CaptureFormat(g_capture->GetFormat()));
             g_capture->Start();
         }
     }